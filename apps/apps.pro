@@ -4,9 +4,17 @@ CONFIG += ordered
 SUBDIRS += tests \
            centerCrystal \
            surfaceGrowth \
-           realChalkSetup #__next_app__
+           realChalkSetup \
+           iterationBenchmark \
+           ensemble #__next_app__
           # diamondSquareSurface
 
+include(../defaults.pri)
+
+MPI {
+    SUBDIRS += distributed
+}
+
 OTHER_FILES += defaults/default.pro.bones \
                defaults/defaultmain.cpp.bones \
                defaults/defaultconfig.cfg.bones
@@ -0,0 +1,100 @@
+#include <kMC>
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <mpi.h>
+
+using namespace libconfig;
+using namespace kMC;
+
+
+int main(int argc, char ** argv)
+{
+
+    MPI_Init(&argc, &argv);
+
+    Config cfg;
+    wall_clock t;
+
+
+    cfg.readFile("infiles/distributed.cfg");
+
+    const Setting & root = cfg.getRoot();
+
+    const Setting & distributedCFG = getSurfaceSetting(root, "Distributed");
+
+
+    KMCDebugger_SetEnabledTo(false);
+
+
+    DistributedEngine * engine = new DistributedEngine(root);
+
+    const bool isMaster = engine->rank() == 0;
+
+    engine->solver()->initializeSolutionBath();
+
+    //Ghosts filled by every rank's own initialization are replaced by their owners' sites.
+    engine->synchronize();
+
+
+    const uint nWindows         = getSurfaceSetting<uint>(distributedCFG, "nWindows");
+    const uint windowsPerOutput = getSurfaceSetting<uint>(distributedCFG, "windowsPerOutput");
+
+    const uint nParticles = engine->nParticles();
+
+    if (isMaster)
+    {
+        cout << "Rank grid " << engine->rankGrid()(0) << "x" << engine->rankGrid()(1) << "x" << engine->rankGrid()(2)
+             << ", " << nParticles << " particles." << endl;
+    }
+
+
+    t.tic();
+
+    uint window = 0;
+
+    while (window < nWindows)
+    {
+
+        uint n = min(windowsPerOutput, nWindows - window);
+
+        engine->advance(n);
+
+        window += n;
+
+        uint nEvents;
+        uint nEventsLocal = engine->nEvents();
+
+        MPI_Reduce(&nEventsLocal, &nEvents, 1, MPI_UNSIGNED, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        if (isMaster)
+        {
+            cout << "window " << window
+                 << "  time " << engine->simulatedTime()
+                 << "  events " << nEvents
+                 << "  efficiency " << engine->parallelEfficiency() << endl;
+        }
+
+    }
+
+
+    //Collective calls; every rank takes part.
+    const uint nMismatches = engine->countGhostMismatches();
+    const uint nParticlesEnd = engine->nParticles();
+
+    if (isMaster)
+    {
+        cout << "Simulation ended after " << t.toc() << " seconds" << endl;
+
+        cout << "Particles " << nParticles << " -> " << nParticlesEnd
+             << ", ghost sites out of step with their owners: " << nMismatches << endl;
+    }
+
+
+    delete engine;
+
+    MPI_Finalize();
+
+
+    return nMismatches == 0 ? 0 : 1;
+
+}
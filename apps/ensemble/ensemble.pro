@@ -0,0 +1,19 @@
+include(../app_defaults.pri)
+
+TARGET  = ensemble
+
+SOURCES = ensemblemain.cpp
+
+
+OTHER_FILES += infiles/ensemble.cfg
+
+
+copydata.commands = $(COPY_DIR) $$PWD/infiles $$OUT_PWD
+createDirs.commands = $(MKDIR) $$mkcommands
+
+first.depends = $(first) copydata createDirs
+export(first.depends)
+export(copydata.commands)
+export(createDirs.commands)
+
+QMAKE_EXTRA_TARGETS += first copydata createDirs
@@ -0,0 +1,307 @@
+#include <kMC>
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <iomanip>
+#include <fstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace libconfig;
+using namespace kMC;
+
+
+//! Running mean and variance of one observable (Welford), mergeable across threads (Chan et al.).
+struct Moments
+{
+    uint count = 0;
+    double mean = 0;
+    double M2 = 0;
+
+    void add(const double value)
+    {
+        count++;
+
+        double delta = value - mean;
+
+        mean += delta/count;
+        M2   += delta*(value - mean);
+    }
+
+    void merge(const Moments & other)
+    {
+        if (other.count == 0)
+        {
+            return;
+        }
+
+        uint total = count + other.count;
+
+        double delta = other.mean - mean;
+
+        mean += delta*other.count/total;
+        M2   += other.M2 + delta*delta*count*other.count/total;
+
+        count = total;
+    }
+
+    double variance() const
+    {
+        return count > 1 ? M2/(count - 1) : 0;
+    }
+};
+
+enum Observables
+{
+    Cycles,
+    Crystals,
+    Surfaces,
+    Energy,
+    KTot,
+    nObservables
+};
+
+const char * observableNames[nObservables] = {"cycles", "crystals", "surfaces", "energy", "kTot"};
+
+typedef array<double, nObservables> Observation;
+
+typedef array<Moments, nObservables> Sample;
+
+typedef vector<Sample> TimeSeries;
+
+
+void runReplica(const KMCSolver * prototype, const int seed, const uint nSamples, const double timePerSample, TimeSeries & series);
+
+void observe(KMCSolver * solver, Observation & observation);
+
+int main()
+{
+
+    Config cfg;
+    wall_clock t;
+
+
+    cfg.readFile("infiles/ensemble.cfg");
+
+    const Setting & root = cfg.getRoot();
+
+    const Setting & ensembleCFG = getSurfaceSetting(root, "Ensemble");
+    const Setting & solverCFG   = getSurfaceSetting(root, "Solver");
+
+
+    const uint nReplicas        = getSurfaceSetting<uint>(ensembleCFG, "nReplicas");
+    const uint nSamples         = getSurfaceSetting<uint>(ensembleCFG, "nSamples");
+    const double timePerSample  = getSurfaceSetting<double>(ensembleCFG, "timePerSample");
+
+    uint nThreads = getSurfaceSetting<uint>(ensembleCFG, "nThreads");
+
+    if (nThreads == 0)
+    {
+        nThreads = max(thread::hardware_concurrency(), 1u);
+    }
+
+    nThreads = min(nThreads, nReplicas);
+
+
+    int baseSeed;
+
+    if (getSurfaceSetting<uint>(solverCFG, "seedType") == Seed::specific)
+    {
+        baseSeed = getSurfaceSetting<int>(solverCFG, "specificSeed");
+    }
+
+    else
+    {
+        baseSeed = time(NULL);
+    }
+
+
+    //The tables and the teeth are set up once; every replica is built from the prototype,
+    //sharing its tables and copying its teeth, and adds a solution bath of its own.
+    KMCDebugger_SetEnabledTo(false);
+
+    KMCSolver * prototype = new KMCSolver(root);
+
+    prototype->initializeSurfaceTeeth(getSetting<uint>(root, {"Initialization", "toothWidth"}),
+                                      getSetting<uint>(root, {"Initialization", "toothSpacing"}));
+
+
+    //Each thread reduces the replicas it runs into its own series; these are merged at the end.
+    vector<TimeSeries> threadSeries(nThreads, TimeSeries(nSamples + 1));
+
+    //Threads take the next replica from a shared counter instead of stealing work from each
+    //other's queues. All replicas cost about the same, so the counter balances the load as
+    //well, with nothing but one atomic increment per replica.
+    atomic<uint> nextReplica(0);
+
+    mutex outputLock;
+
+
+    auto worker = [&] (const uint threadID)
+    {
+
+        //The debugger is set per thread.
+        KMCDebugger_SetEnabledTo(false);
+
+#ifdef _OPENMP
+        //The replicas already use the cores; parallel regions inside the solver would
+        //oversubscribe them.
+        omp_set_num_threads(1);
+#endif
+
+        uint replica;
+
+        while ((replica = nextReplica++) < nReplicas)
+        {
+
+            runReplica(prototype, baseSeed + replica, nSamples, timePerSample, threadSeries.at(threadID));
+
+            lock_guard<mutex> lock(outputLock);
+
+            cout << "Replica " << replica + 1 << " of " << nReplicas << " done." << endl;
+
+        }
+
+    };
+
+
+    t.tic();
+
+    vector<thread> threads;
+
+    for (uint i = 0; i < nThreads; ++i)
+    {
+        threads.push_back(thread(worker, i));
+    }
+
+    for (thread & th : threads)
+    {
+        th.join();
+    }
+
+    cout << "Ensemble of " << nReplicas << " replicas on " << nThreads
+         << " threads ended after " << t.toc() << " seconds" << endl;
+
+    delete prototype;
+
+
+    TimeSeries & series = threadSeries.at(0);
+
+    for (uint i = 1; i < nThreads; ++i)
+    {
+        for (uint s = 0; s <= nSamples; ++s)
+        {
+            for (uint o = 0; o < nObservables; ++o)
+            {
+                series.at(s)[o].merge(threadSeries.at(i).at(s)[o]);
+            }
+        }
+    }
+
+
+    ofstream o;
+    o.open("outfiles/ensemble.txt");
+
+    o << "#time";
+
+    for (uint i = 0; i < nObservables; ++i)
+    {
+        o << " " << observableNames[i] << "_mean " << observableNames[i] << "_var";
+    }
+
+    o << endl;
+
+    o << setprecision(10);
+
+    for (uint s = 0; s <= nSamples; ++s)
+    {
+        o << s*timePerSample;
+
+        for (uint i = 0; i < nObservables; ++i)
+        {
+            o << " " << series.at(s)[i].mean << " " << series.at(s)[i].variance();
+        }
+
+        o << endl;
+    }
+
+    o.close();
+
+
+    return 0;
+
+}
+
+void runReplica(const KMCSolver * prototype, const int seed, const uint nSamples, const double timePerSample, TimeSeries & series)
+{
+
+    KMCSolver * solver = new KMCSolver(*prototype);
+
+    solver->setRNGSeed(Seed::specific, seed);
+
+    solver->initializeSolutionBath();
+
+
+    //Replicas are compared at equal simulated times, not at equal cycle counts. A sample
+    //at time t sees the state which holds at t, the one from before the step passing it.
+    Observation observation;
+
+    uint s = 0;
+
+    while (s <= nSamples)
+    {
+
+        observe(solver, observation);
+
+        //Nothing can happen any more, so the state holds at every remaining sample.
+        if (solver->kTot() == 0)
+        {
+            for (; s <= nSamples; ++s)
+            {
+                for (uint o = 0; o < nObservables; ++o)
+                {
+                    series.at(s)[o].add(observation[o]);
+                }
+            }
+
+            break;
+        }
+
+        solver->step();
+
+        while (s <= nSamples && s*timePerSample < solver->simulatedTime())
+        {
+
+            for (uint o = 0; o < nObservables; ++o)
+            {
+                series.at(s)[o].add(observation[o]);
+            }
+
+            s++;
+
+        }
+
+    }
+
+
+    delete solver;
+
+}
+
+void observe(KMCSolver * solver, Observation & observation)
+{
+
+    solver->getRateVariables();
+
+    observation[Cycles]   = solver->currentCycle() - 1;
+    observation[Crystals] = Site::nCrystals();
+    observation[Surfaces] = Site::nSurfaces();
+    observation[Energy]   = Site::totalEnergy();
+    observation[KTot]     = solver->kTot();
+
+}
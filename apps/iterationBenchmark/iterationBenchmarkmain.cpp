@@ -0,0 +1,230 @@
+#include <kMC>
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <iomanip>
+
+using namespace libconfig;
+using namespace kMC;
+
+
+//Keeps the work done by the visitors from being optimized away.
+volatile double checksum;
+
+template<typename Sweep>
+double nanosecondsPerElement(const uint nRepeats, Sweep sweep);
+
+void report(const string & name, const double stdFunctionTime, const double templateTime);
+
+int main()
+{
+
+    Config cfg;
+    wall_clock t;
+
+
+    cfg.readFile("infiles/iterationBenchmark.cfg");
+
+    const Setting & root = cfg.getRoot();
+
+
+    KMCDebugger_SetFilename("iterationBenchmark");
+
+    KMCDebugger_SetEnabledTo(getSurfaceSetting<int>(root, "buildTrace") == 0 ? false : true);
+
+
+    KMCSolver* solver = new KMCSolver(root);
+
+    solver->initializeCrystal(getSetting<double>(root, {"Initialization", "RelativeSeedSize"}));
+
+
+    t.tic();
+
+    solver->mainloop();
+
+    cout << "Warmup ended after " << t.toc() << " seconds" << endl;
+
+
+    const uint nRepeats = getSetting<uint>(root, {"Benchmark", "nRepeats"});
+
+    double sum;
+    uint64_t nVisits;
+
+
+    //Passed as std::function, these go through the wrapping overloads, as all calls did before.
+    function<void (Site *)> sumSite = [&] (Site * site)
+    {
+        sum += site->nNeighbors();
+        nVisits++;
+    };
+
+    function<void (Site *)> sumNeighbor = [&] (Site * neighbor)
+    {
+        sum += neighbor->isActive();
+        nVisits++;
+    };
+
+    function<void (Reaction *)> sumReaction = [&] (Reaction * reaction)
+    {
+        sum += reaction->rate();
+        nVisits++;
+    };
+
+
+    auto sweepSites = [&] (bool templated)
+    {
+        sum = 0;
+        nVisits = 0;
+
+        if (templated)
+        {
+            solver->forEachSiteDo([&] (Site * site)
+            {
+                sum += site->nNeighbors();
+                nVisits++;
+            });
+        }
+
+        else
+        {
+            solver->forEachSiteDo(sumSite);
+        }
+
+        checksum = sum;
+
+        return nVisits;
+    };
+
+    auto sweepActiveSites = [&] (bool templated)
+    {
+        sum = 0;
+        nVisits = 0;
+
+        if (templated)
+        {
+            solver->forEachActiveSiteDo([&] (Site * site)
+            {
+                sum += site->nNeighbors();
+                nVisits++;
+            });
+        }
+
+        else
+        {
+            solver->forEachActiveSiteDo(sumSite);
+        }
+
+        checksum = sum;
+
+        //Every site is tested for activity.
+        return (uint64_t)solver->nSites();
+    };
+
+    auto sweepNeighbors = [&] (bool templated)
+    {
+        sum = 0;
+        nVisits = 0;
+
+        solver->forEachActiveSiteDo([&] (Site * site)
+        {
+            if (templated)
+            {
+                site->forEachNeighborDo([&] (Site * neighbor)
+                {
+                    sum += neighbor->isActive();
+                    nVisits++;
+                });
+            }
+
+            else
+            {
+                site->forEachNeighborDo(sumNeighbor);
+            }
+        });
+
+        checksum = sum;
+
+        return nVisits;
+    };
+
+    auto sweepReactions = [&] (bool templated)
+    {
+        sum = 0;
+        nVisits = 0;
+
+        solver->forEachActiveSiteDo([&] (Site * site)
+        {
+            if (templated)
+            {
+                site->forEachActiveReactionDo([&] (Reaction * reaction)
+                {
+                    sum += reaction->rate();
+                    nVisits++;
+                });
+            }
+
+            else
+            {
+                site->forEachActiveReactionDo(sumReaction);
+            }
+        });
+
+        checksum = sum;
+
+        return nVisits;
+    };
+
+
+    cout << "Cost per element, std::function -> template:" << endl;
+
+    report("KMCSolver::forEachSiteDo",
+           nanosecondsPerElement(nRepeats, [&] () {return sweepSites(false);}),
+           nanosecondsPerElement(nRepeats, [&] () {return sweepSites(true);}));
+
+    report("KMCSolver::forEachActiveSiteDo",
+           nanosecondsPerElement(nRepeats, [&] () {return sweepActiveSites(false);}),
+           nanosecondsPerElement(nRepeats, [&] () {return sweepActiveSites(true);}));
+
+    report("Site::forEachNeighborDo",
+           nanosecondsPerElement(nRepeats, [&] () {return sweepNeighbors(false);}),
+           nanosecondsPerElement(nRepeats, [&] () {return sweepNeighbors(true);}));
+
+    report("Site::forEachActiveReactionDo",
+           nanosecondsPerElement(nRepeats, [&] () {return sweepReactions(false);}),
+           nanosecondsPerElement(nRepeats, [&] () {return sweepReactions(true);}));
+
+
+    KMCDebugger_DumpFullTrace();
+
+    delete solver;
+
+
+    return 0;
+
+}
+
+
+template<typename Sweep>
+double nanosecondsPerElement(const uint nRepeats, Sweep sweep)
+{
+
+    wall_clock t;
+
+    uint64_t nVisits = 0;
+
+    t.tic();
+
+    for (uint i = 0; i < nRepeats; ++i)
+    {
+        nVisits += sweep();
+    }
+
+    return t.toc()*1E9/nVisits;
+
+}
+
+void report(const string & name, const double stdFunctionTime, const double templateTime)
+{
+    cout << setw(32) << left << name
+         << setw(10) << right << setprecision(3) << stdFunctionTime << " ns  -> "
+         << setw(10) << right << setprecision(3) << templateTime << " ns" << endl;
+}
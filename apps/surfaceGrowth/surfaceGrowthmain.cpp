@@ -4,9 +4,6 @@
 using namespace libconfig;
 using namespace kMC;
 
-
-void initialize_surfaceGrowth(KMCSolver * solver, const Setting & root);
-
 int main()
 {
 
@@ -26,7 +23,14 @@ int main()
 
     KMCSolver* solver = new KMCSolver(root);
 
-    initialize_surfaceGrowth(solver, root);
+    solver->beginBulkPlacement();
+
+    solver->initializeSurfaceTeeth(getSetting<uint>(root, {"Initialization", "toothWidth"}),
+                                   getSetting<uint>(root, {"Initialization", "toothSpacing"}));
+
+    solver->initializeSolutionBath();
+
+    solver->finalizeBulkPlacement();
 
 
     t.tic();
@@ -44,92 +48,3 @@ int main()
     return 0;
 
 }
-
-void initialize_surfaceGrowth(KMCSolver * solver, const Setting & root)
-{
-
-    const Setting & initCFG = getSurfaceSetting(root, "Initialization");
-
-    const uint & NX = solver->NX();
-    const uint & NY = solver->NY();
-
-    uint toothWidth   = getSurfaceSetting<uint>(initCFG, "toothWidth");
-    uint toothSpacing = getSurfaceSetting<uint>(initCFG, "toothSpacing");
-
-    uint toothHeight           =   toothWidth + 1;
-    uint fullToothSize         = 2*toothWidth + 1;
-    uint toothCenterSeparation = 2*toothWidth + toothSpacing;
-
-    uint toothCenterX = 0;
-    uint toothCenterY;
-
-    uint X, Y;
-
-    while (toothCenterX < NX)
-    {
-
-        toothCenterY = 0;
-
-        while (toothCenterY < NY)
-        {
-
-            //Loop Z coordinate
-            for (uint Z = 0; Z < toothHeight; ++Z)
-            {
-
-                //i, j = tooth coordiates relative to corners
-                for (uint i = Z; i < fullToothSize - Z; ++i)
-                {
-
-                    //if relative coordinates are outside of the box, we continue.
-                    if (toothCenterX + i < toothWidth)
-                    {
-                        continue;
-                    }
-
-                    //transforming to box coordinates
-                    X = toothCenterX + i - toothWidth;
-
-                    //if absolute coordiates are outside the box, we continue
-                    if (X >= NX)
-                    {
-                        continue;
-                    }
-
-                    for(uint j = Z; j < fullToothSize - Z; ++j)
-                    {
-
-                        if (toothCenterY + j < toothWidth)
-                        {
-                            continue;
-                        }
-
-                        Y = toothCenterY + j - toothWidth;
-
-                        if (Y >= NY)
-                        {
-                            continue;
-                        }
-
-                        //Z + 1 because Z = 0 boundary is already populated with fixed crystals
-                        //from the surface boundary condition. This automatically makes activation
-                        //crystals unless you set an insane condition for crystallization.
-                        solver->getSite(X, Y, Z + 1)->activate();
-
-                    }
-                }
-
-            }
-
-            toothCenterY += toothCenterSeparation;
-
-        }
-
-        toothCenterX += toothCenterSeparation;
-
-    }
-
-
-    solver->initializeSolutionBath();
-
-}
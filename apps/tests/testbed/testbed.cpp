@@ -2,9 +2,18 @@
 
 #include "../snapshot/snapshot.h"
 
+#include "../../../src/reactions/vectorexp.h"
+
 #include <unittest++/UnitTest++.h>
 
 #include <iostream>
+#include <map>
+#include <set>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 void testBed::makeSolver()
 {
@@ -26,6 +35,35 @@ void testBed::makeSolver()
 
 }
 
+void testBed::testSiteIndexing()
+{
+
+    uint index = 0;
+
+    solver->forEachSiteDo_sendIndices([&] (Site * site, uint x, uint y, uint z)
+    {
+
+        CHECK_EQUAL(x, site->x());
+        CHECK_EQUAL(y, site->y());
+        CHECK_EQUAL(z, site->z());
+
+        CHECK_EQUAL(index, solver->getSiteIndex(site));
+        CHECK_EQUAL(index, solver->getSiteIndex(x, y, z));
+
+        CHECK_EQUAL(site, solver->getSite(index));
+        CHECK_EQUAL(site, solver->getSite(x, y, z));
+
+        //Sites are stored contiguously in index order.
+        CHECK_EQUAL(solver->getSite(0) + index, site);
+
+        index++;
+
+    });
+
+    CHECK_EQUAL(solver->nSites(), index);
+
+}
+
 void testBed::testTotalParticleStateCounters()
 {
 
@@ -459,267 +497,1934 @@ void testBed::testPropertyCalculations()
     CHECK_EQUAL(NY()/2, boxTop(1, 1));
     CHECK_EQUAL(NZ()/2, boxTop(2, 1));
 
-    solver->getSite(0, 0, 0)->activate();
-    solver->getSite(1, 0, 0)->activate();
-    solver->getSite(0, 1, 0)->activate();
+    solver->getSite(0, 0, 0)->activate();
+    solver->getSite(1, 0, 0)->activate();
+    solver->getSite(0, 1, 0)->activate();
+
+
+    CHECK_EQUAL(3, Site::nSolutionParticles());
+
+    CHECK_EQUAL(3.0/124, Site::getCurrentSolutionDensity());
+
+    activateAllSites();
+
+
+    CHECK_EQUAL(0, Site::nSurfaces());
+    CHECK_EQUAL(125, Site::nCrystals());
+    CHECK_EQUAL(0, Site::nSolutionParticles());
+
+    CHECK_EQUAL(0, Site::getCurrentSolutionDensity());
+    CHECK_EQUAL(1.0, Site::getCurrentRelativeCrystalOccupancy());
+
+    boxTop = Site::getCurrentCrystalBoxTopology();
+
+    CHECK_EQUAL(0, boxTop(0, 0));
+    CHECK_EQUAL(0, boxTop(1, 0));
+    CHECK_EQUAL(0, boxTop(2, 0));
+
+    CHECK_EQUAL(NX()-1, boxTop(0, 1));
+    CHECK_EQUAL(NY()-1, boxTop(1, 1));
+    CHECK_EQUAL(NZ()-1, boxTop(2, 1));
+
+
+    CHECK_EQUAL(0, Site::getCurrentSolutionDensity());
+
+    deactivateAllSites();
+
+    center->spawnAsFixedCrystal();
+    solver->getSite(2, 2, 3)->activate();
+    solver->getSite(2, 2, 4)->activate();
+
+    solver->getSite(2, 1, 1)->activate();
+    solver->getSite(2, 1, 2)->activate();
+    solver->getSite(2, 1, 3)->activate();
+
+
+    solver->getSite(2, 3, 3)->activate();
+
+    /*
+     *        x x x
+     *          x x x
+     *            x
+     *
+     */
+
+
+    boxTop = Site::getCurrentCrystalBoxTopology();
+
+    CHECK_EQUAL(2, boxTop(0, 0));
+    CHECK_EQUAL(1, boxTop(1, 0));
+    CHECK_EQUAL(1, boxTop(2, 0));
+
+    CHECK_EQUAL(2, boxTop(0, 1));
+    CHECK_EQUAL(3, boxTop(1, 1));
+    CHECK_EQUAL(4, boxTop(2, 1));
+
+}
+
+void testBed::testRNG()
+{
+
+    double U  = 0;
+    double U2 = 0;
+    double N  = 0;
+    double N2 = 0;
+
+    double Ui;
+    double Ni;
+
+    uint COUNT = 1000000;
+    for (uint i = 0; i < COUNT; ++i)
+    {
+        Ui = KMC_RNG_UNIFORM();
+        Ni = KMC_RNG_NORMAL();
+
+        U  += Ui;
+        U2 += Ui*Ui;
+
+        N  += Ni;
+        N2 += Ni*Ni;
+    }
+
+    double stdU;
+    double stdN;
+
+    U  /= COUNT;
+    U2 /= COUNT;
+    N  /= COUNT;
+    N2 /= COUNT;
+
+
+    stdU = sqrt(U2 - U*U);
+    stdN = sqrt(N2 - N*N);
+
+
+    CHECK_CLOSE(0.5, U, 0.01);
+    CHECK_CLOSE(1.0/sqrt(12), stdU, 0.01);
+
+    CHECK_CLOSE(0, N, 0.01);
+    CHECK_CLOSE(1, stdN, 0.01);
+
+    vector<double> setn;
+    vector<double> setu;
+
+    solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+
+    for (uint i = 0; i < 1000000; ++i)
+    {
+        setu.push_back(KMC_RNG_UNIFORM());
+        setn.push_back(KMC_RNG_NORMAL());
+    }
+
+
+    solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+
+    for (uint i = 0; i < 1000000; ++i)
+    {
+        CHECK_EQUAL(KMC_RNG_UNIFORM(), setu.at(i));
+        CHECK_EQUAL(KMC_RNG_NORMAL(), setn.at(i));
+    }
+
+
+}
+
+void testBed::testBinarySearchChoise()
+{
+
+
+    Reaction * choice;
+    uint secondChoice;
+    double R;
+
+    vector<Reaction*> allReactions;
+    vector<double> accuAllRates;
+
+    solver->initializeCrystal(0.3);
+
+    solver->getRateVariables();
+
+    collectAllReactions(allReactions, accuAllRates);
+
+    CHECK_CLOSE(accuAllRates.back(), solver->kTot(), 1E-10*solver->kTot());
+
+    uint N = 10;
+    uint n = 0;
+
+    while(n != N)
+    {
+
+        R = solver->kTot()*KMC_RNG_UNIFORM();
+
+        choice = solver->getReactionChoice(R);
+
+        secondChoice = 0;
+        while (accuAllRates.at(secondChoice) <= R)
+        {
+            secondChoice++;
+        }
+
+        CHECK_EQUAL(allReactions.at(secondChoice), choice);
+
+        n++;
+
+    }
+
+
+
+}
+
+void testBed::testReactionChoise()
+{
+
+
+    uint count, count2;
+
+    double kTot, r_pre;
+
+    Reaction* reaction;
+
+    Reaction* choice;
+
+    vector<Reaction*> allReactions;
+    vector<double> accuAllRates;
+
+
+    uint N = 3;
+    uint n = 0;
+
+
+    solver->initializeCrystal(0.3);
+
+    solver->getRateVariables();
+
+    collectAllReactions(allReactions, accuAllRates);
+
+    while(n != N)
+    {
+
+        r_pre = 0;
+
+        count2 = 0;
+
+        for (double r_i : accuAllRates)
+        {
+
+            double R = (r_i + r_pre)/2;
+
+            choice = solver->getReactionChoice(R);
+
+            kTot = 0;
+
+            count = 0;
+
+            for (uint i = 0; i < NX(); ++i)
+            {
+                for (uint j = 0; j < NY(); ++j)
+                {
+                    for (uint k = 0; k < NZ(); ++k)
+                    {
+                        bool notSet = true;
+                        solver->getSite(i, j, k)->forEachActiveReactionDo([&] (Reaction * r)
+                        {
+                            if (!notSet)
+                            {
+                                return;
+                            }
+
+                            CHECK_EQUAL(r, allReactions.at(count));
+
+                            kTot += r->rate();
+
+                            CHECK_EQUAL(kTot, accuAllRates.at(count));
+
+                            //if by adding this reaction we surpass the limit, we
+                            //are done searching.
+                            if (kTot > R)
+                            {
+                                reaction = r;
+
+                                i = NX();
+                                j = NY();
+                                k = NZ();
+
+                                notSet = false;
+                            }
+
+                            if (notSet)
+                            {
+                                count++;
+                            }
+                        });
+                    }
+                }
+            }
+
+            CHECK_EQUAL(choice, reaction);
+            CHECK_EQUAL(allReactions.at(count), choice);
+            CHECK_EQUAL(count, count2);
+
+            count2++;
+
+            r_pre = r_i;
+        }
+
+        n++;
+
+    }
+
+
+}
+
+void testBed::testRateTreeUpdates()
+{
+
+    vector<Reaction*> allReactions;
+    vector<double> accuAllRates;
+
+    double siteRate;
+
+    const RateTree * rateTree = static_cast<const RateTree*>(solver->selectionEngine());
+
+    CHECK_EQUAL(SelectionEngine::RateTree, rateTree->type);
+
+    solver->initializeCrystal(0.3);
+
+    uint nCycles = 500;
+
+    for (uint cycle = 0; cycle < nCycles; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        collectAllReactions(allReactions, accuAllRates);
+
+        CHECK_CLOSE(accuAllRates.back(), solver->kTot(), 1E-10*solver->kTot());
+
+        CHECK_EQUAL(NX()*NY()*NZ(), rateTree->nLeaves());
+
+        solver->forEachSiteDo([&] (Site * site)
+        {
+            siteRate = 0;
+
+            site->forEachActiveReactionDo([&siteRate] (Reaction * r)
+            {
+                siteRate += r->rate();
+            });
+
+            CHECK_CLOSE(siteRate, rateTree->leaf(solver->getSiteIndex(site)), 1E-10);
+        });
+
+        solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+}
+
+void testBed::testCompositionRejection()
+{
+
+    vector<Reaction*> allReactions;
+    vector<double> accuAllRates;
+
+    solver->setSelectionEngine(SelectionEngine::CompositionRejection);
+
+    CompositionRejection * engine = static_cast<CompositionRejection*>(solver->selectionEngine());
+
+    CHECK_EQUAL(SelectionEngine::CompositionRejection, engine->type);
+
+    solver->initializeCrystal(0.3);
+
+    uint nCycles = 500;
+
+    for (uint cycle = 0; cycle < nCycles; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        collectAllReactions(allReactions, accuAllRates);
+
+        CHECK_CLOSE(accuAllRates.back(), solver->kTot(), 1E-10*solver->kTot());
+
+        //Every group member is within a factor two of the group bound.
+        for (uint group = 0; group < engine->nGroups(); ++group)
+        {
+            double upper = std::ldexp(1.0, int(group) + engine->minExponent());
+
+            CHECK(engine->groupTotal(group) < upper*engine->nReactionsInGroup(group) + 1E-10);
+            CHECK(engine->groupTotal(group) >= upper/2*engine->nReactionsInGroup(group) - 1E-10);
+        }
+
+        solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+
+    //The selection frequencies of a fixed configuration should follow the rates.
+    solver->getRateVariables();
+
+    collectAllReactions(allReactions, accuAllRates);
+
+    uint nReactions = allReactions.size();
+
+    map<Reaction*, uint> reactionIndices;
+
+    for (uint i = 0; i < nReactions; ++i)
+    {
+        reactionIndices[allReactions.at(i)] = i;
+    }
+
+    uint nDraws = 1000000;
+
+    vector<uint> counts(nReactions, 0);
+
+    for (uint draw = 0; draw < nDraws; ++draw)
+    {
+        counts.at(reactionIndices[solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())])++;
+    }
+
+    double chi2 = 0;
+    double r_pre = 0;
+
+    for (uint i = 0; i < nReactions; ++i)
+    {
+        double expected = nDraws*(accuAllRates.at(i) - r_pre)/accuAllRates.back();
+
+        chi2 += (counts.at(i) - expected)*(counts.at(i) - expected)/expected;
+
+        r_pre = accuAllRates.at(i);
+    }
+
+    CHECK(chi2/(nReactions - 1) < 1.3);
+
+    CHECK(engine->nRejections() < engine->nSelections());
+
+    solver->setSelectionEngine(SelectionEngine::RateTree);
+
+}
+
+void testBed::testNextReactionMethod()
+{
+
+    vector<Reaction*> allReactions;
+    vector<double> accuAllRates;
+
+    solver->setSelectionEngine(SelectionEngine::NextReactionMethod);
+
+    NextReactionMethod * engine = static_cast<NextReactionMethod*>(solver->selectionEngine());
+
+    CHECK_EQUAL(SelectionEngine::NextReactionMethod, engine->type);
+
+    solver->initializeCrystal(0.3);
+
+    double previousTime = 0;
+    double scaledTimeSteps = 0;
+
+    uint nCycles = 2000;
+
+    for (uint cycle = 0; cycle < nCycles; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        collectAllReactions(allReactions, accuAllRates);
+
+        CHECK_CLOSE(accuAllRates.back(), solver->kTot(), 1E-10*solver->kTot());
+
+        CHECK_EQUAL(allReactions.size(), engine->nScheduled());
+
+        CHECK(engine->heapIsValid());
+
+        Reaction * reaction = solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM());
+
+        CHECK(engine->currentTime() >= previousTime);
+
+        previousTime = engine->currentTime();
+
+        //Given the state, the waiting time is exponential with mean 1/kTot.
+        scaledTimeSteps += solver->kTot()*engine->getTimeStep(solver->kTot());
+
+        reaction->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+    CHECK_CLOSE(1.0, scaledTimeSteps/nCycles, 0.1);
+
+    solver->setSelectionEngine(SelectionEngine::RateTree);
+
+}
+
+void testBed::testUpdateFlagStencil()
+{
+
+    solver->setBoxSize({10, 10, 10}, false);
+
+    Site::resetBoundariesTo(Boundary::Periodic);
+
+    Site::resetNNeighborsLimitTo(3);
+
+    DiffusionReaction::resetSeparationTo(1);
+
+    solver->forEachSiteDo([] (Site * site)
+    {
+        if (KMC_RNG_UNIFORM() < 0.5 && site->isLegalToSpawn())
+        {
+            site->activate();
+        }
+    });
+
+    solver->getRateVariables();
+
+    Site * changedSite = solver->getSite(NX()/2, NY()/2 + 1, NZ()/2 - 1);
+
+    solver->forEachSiteDo([] (Site * site)
+    {
+        for (Reaction * r : site->reactions())
+        {
+            r->resetUpdateFlag();
+        }
+    });
+
+    Site::clearAffectedSites();
+
+    changedSite->setNeighboringDirectUpdateFlags();
+
+    uint nAffected = 0;
+
+    solver->forEachSiteDo([&] (Site * site)
+    {
+
+        uint distance = site->maxDistanceTo(changedSite);
+
+        bool affected = site->isActive() && site != changedSite && distance <= Site::nNeighborsLimit() + 1;
+
+        CHECK_EQUAL(affected, site->isAffected());
+
+        if (affected)
+        {
+            nAffected++;
+        }
+
+        for (Reaction * r : site->reactions())
+        {
+
+            if (!affected)
+            {
+                CHECK_EQUAL(Reaction::UNSET_UPDATE_FLAG, r->updateFlag());
+                continue;
+            }
+
+            const Site * destination = static_cast<DiffusionReaction*>(r)->destinationSite();
+
+            bool keepSaddle = r->rate() != Reaction::UNSET_RATE &&
+                    distance > 1 &&
+                    destination->maxDistanceTo(changedSite) > Site::nNeighborsLimit();
+
+            if (keepSaddle)
+            {
+                CHECK(r->updateFlag() != Reaction::defaultUpdateFlag);
+                CHECK(r->updateFlag() != Reaction::UNSET_UPDATE_FLAG);
+            }
+
+            else
+            {
+                CHECK_EQUAL(Reaction::defaultUpdateFlag, r->updateFlag());
+            }
+
+        }
+
+    });
+
+    CHECK_EQUAL(nAffected, Site::affectedSites().size());
+
+    //Sites are listed once no matter how often they are affected.
+    changedSite->setNeighboringDirectUpdateFlags();
+
+    CHECK_EQUAL(nAffected, Site::affectedSites().size());
+
+    Site::clearAffectedSites();
+
+    CHECK_EQUAL(0, Site::affectedSites().size());
+
+    solver->forEachSiteDo([] (Site * site)
+    {
+        CHECK(!site->isAffected());
+    });
+
+}
+
+void testBed::testParticleReactionStorage()
+{
+
+    uint nCycles = 1000;
+
+    vector<double> kTots;
+
+    //The same trajectory is run with reactions on every site and on occupied sites only.
+    for (uint storage = KMCSolver::AllSites; storage <= KMCSolver::OccupiedSites; ++storage)
+    {
+
+        solver->reset();
+
+        solver->setReactionStorage(storage);
+
+        CHECK_EQUAL(storage == KMCSolver::OccupiedSites, solver->reactionsFollowParticles());
+
+        solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+
+        solver->initializeCrystal(0.3);
+
+        for (uint cycle = 0; cycle < nCycles; ++cycle)
+        {
+
+            solver->getRateVariables();
+
+            if (storage == KMCSolver::AllSites)
+            {
+                kTots.push_back(solver->kTot());
+            }
+
+            else
+            {
+                CHECK_EQUAL(kTots.at(cycle), solver->kTot());
+
+                uint nParticles = 0;
+
+                solver->forEachSiteDo([&nParticles] (Site * site)
+                {
+                    bool hasParticle = site->isActive() && !site->isFixedCrystalSeed();
+
+                    CHECK_EQUAL(hasParticle, site->particleIndex() != Site::NO_PARTICLE);
+
+                    if (hasParticle)
+                    {
+                        CHECK_EQUAL(26, site->reactions().size());
+                        nParticles++;
+                    }
+
+                    else
+                    {
+                        CHECK_EQUAL(0, site->reactions().size());
+                    }
+                });
+
+                CHECK_EQUAL(nParticles, solver->nReactionBlocksInUse());
+            }
+
+            Reaction * reaction = solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM());
+
+            reaction->execute();
+
+            Site::updateBoundaries();
+
+        }
+
+    }
+
+    solver->reset();
+
+    solver->setReactionStorage(KMCSolver::AllSites);
+
+    CHECK_EQUAL(solver->nSites(), solver->nReactionBlocksInUse());
+
+}
+
+void testBed::testReactionFields()
+{
+
+    solver->initializeCrystal(0.3);
+
+    for (uint cycle = 0; cycle < 100; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        solver->forEachActiveSiteDo([] (Site * site)
+        {
+
+            if (site->reactions().size() == 0)
+            {
+                return;
+            }
+
+            const ReactionFields & fields = site->reactionFields();
+
+            double R = 0;
+
+            for (DiffusionReaction * reaction : site->reactions())
+            {
+                ivec3 path = reaction->getPath();
+
+                CHECK_EQUAL(Site::directionIndex(path(0), path(1), path(2)), fields.direction[reaction->slot()]);
+
+                CHECK_EQUAL(&fields.rate[reaction->slot()], &reaction->rate());
+
+                if (reaction->isAllowed())
+                {
+                    R += reaction->rate();
+                }
+            }
+
+            CHECK_EQUAL(R, site->rateSum());
+
+            //Each allowed reaction is selected by the middle of its share of the site rate.
+            double accuRates = 0;
+
+            for (DiffusionReaction * reaction : site->reactions())
+            {
+                if (!reaction->isAllowed())
+                {
+                    continue;
+                }
+
+                CHECK_EQUAL(reaction->slot(), site->selectSlot(accuRates + reaction->rate()/2));
+
+                accuRates += reaction->rate();
+            }
+
+        });
+
+        Reaction * reaction = solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM());
+
+        reaction->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+}
+
+void testBed::testBoltzmannFactors()
+{
+
+    solver->initializeCrystal(0.3);
+
+    for (uint cycle = 0; cycle < 100; ++cycle)
+    {
+        solver->getRateVariables();
+
+        solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+        Site::updateBoundaries();
+    }
+
+    solver->getRateVariables();
+
+    double accuEnergy = 0;
+
+    solver->forEachSiteDo([&accuEnergy] (Site * site)
+    {
+
+        double energy = 0;
+
+        site->forEachNeighborDo_sendIndices([&energy] (Site * neighbor, uint i, uint j, uint k)
+        {
+            if (neighbor->isActive())
+            {
+                energy += DiffusionReaction::potential(i, j, k);
+            }
+        });
+
+        CHECK_EQUAL(site->nNeighborsSum(), accu(site->distanceClassCounts()));
+
+        CHECK_CLOSE(energy, site->energy(), 1E-10);
+
+        CHECK_CLOSE(std::exp(-Reaction::beta()*site->energy()), site->boltzmannFactor(), 1E-10*site->boltzmannFactor());
+
+        accuEnergy += site->energy();
+
+        site->forEachActiveReactionDo([] (Reaction * r)
+        {
+            const DiffusionReaction * reaction = static_cast<DiffusionReaction*>(r);
+
+            double rate = Reaction::linearRateScale()*std::exp(-Reaction::beta()*(reaction->lastUsedEnergy() - reaction->lastUsedEsp()));
+
+            CHECK_CLOSE(rate, reaction->rate(), 1E-10*rate);
+        });
+
+    });
+
+    CHECK_CLOSE(accuEnergy, Site::totalEnergy(), 1E-10*accuEnergy);
+
+
+    //Changing beta after placement refreshes the cached factors.
+    const double beta = Reaction::beta();
+
+    Reaction::setBeta(2*beta);
+
+    solver->getRateVariables();
+
+    solver->forEachActiveSiteDo([] (Site * site)
+    {
+
+        CHECK_CLOSE(std::exp(-Reaction::beta()*site->energy()), site->boltzmannFactor(), 1E-10*site->boltzmannFactor());
+
+        site->forEachActiveReactionDo([] (Reaction * r)
+        {
+            const DiffusionReaction * reaction = static_cast<DiffusionReaction*>(r);
+
+            double rate = Reaction::linearRateScale()*std::exp(-Reaction::beta()*(reaction->lastUsedEnergy() - reaction->lastUsedEsp()));
+
+            CHECK_CLOSE(rate, reaction->rate(), 1E-10*rate);
+        });
+
+    });
+
+    Reaction::setBeta(beta);
+
+    solver->reset();
+
+    //Energies are kept as integer counts, so clearing the system leaves no round-off.
+    CHECK_EQUAL(0, Site::totalEnergy());
+
+}
+
+void testBed::testRateCache()
+{
+
+    uint nCycles = 1000;
+
+    vector<double> kTots;
+
+    const uint capacity = DiffusionReaction::rateCacheCapacity();
+
+    //Small enough to be filled several times over.
+    const uint smallCapacity = 64;
+
+    //The same trajectory is run without the cache, with it, and with it emptied as it fills.
+    for (uint enabled = 0; enabled < 3; ++enabled)
+    {
+
+        solver->reset();
+
+        DiffusionReaction::clearRateCache();
+
+        DiffusionReaction::setRateCacheEnabled(enabled != 0);
+
+        DiffusionReaction::setRateCacheCapacity(enabled == 2 ? smallCapacity : capacity);
+
+        solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+
+        solver->initializeCrystal(0.3);
+
+        for (uint cycle = 0; cycle < nCycles; ++cycle)
+        {
+
+            solver->getRateVariables();
+
+            if (enabled == 0)
+            {
+                kTots.push_back(solver->kTot());
+            }
+
+            //Cached saddle energies are summed in full, and agree with the incremental ones to round-off.
+            else
+            {
+                CHECK_CLOSE(kTots.at(cycle), solver->kTot(), 1E-10*kTots.at(cycle));
+            }
+
+            solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+            Site::updateBoundaries();
+
+        }
+
+        if (enabled == 0)
+        {
+            CHECK_EQUAL(0, DiffusionReaction::rateCacheHits() + DiffusionReaction::rateCacheMisses());
+        }
+
+        else if (enabled == 1)
+        {
+            CHECK_EQUAL(DiffusionReaction::rateCacheMisses(), DiffusionReaction::rateCacheSize());
+
+            CHECK(DiffusionReaction::rateCacheHits() != 0);
+        }
+
+        else
+        {
+            CHECK(DiffusionReaction::rateCacheSize() <= smallCapacity);
+
+            CHECK(DiffusionReaction::rateCacheMisses() > smallCapacity);
+
+            CHECK(DiffusionReaction::rateCacheHits() != 0);
+        }
+
+    }
+
+    DiffusionReaction::setRateCacheCapacity(capacity);
+
+    DiffusionReaction::setRateCacheEnabled(false);
+
+    DiffusionReaction::clearRateCache();
+
+}
+
+void testBed::testBatchedRates()
+{
+
+    DiffusionReaction::setBatchedRates(true);
+
+    solver->initializeCrystal(0.3);
+
+    for (uint cycle = 0; cycle < 1000; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        CHECK_EQUAL(cycle + 1, DiffusionReaction::nRateBatches());
+
+        solver->forEachSiteDo([] (Site * site)
+        {
+            site->forEachActiveReactionDo([site] (Reaction * r)
+            {
+                const DiffusionReaction * reaction = static_cast<DiffusionReaction*>(r);
+
+                double rate = Reaction::linearRateScale()*std::exp(-Reaction::beta()*(site->energy() - reaction->lastUsedEsp()));
+
+                CHECK_CLOSE(rate, reaction->rate(), 1E-12*rate);
+            });
+        });
+
+        solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+    CHECK(DiffusionReaction::nBatchedSaddles() != 0);
+
+    CHECK(DiffusionReaction::lastRateBatchSize() <= DiffusionReaction::nBatchedSaddles());
+
+    DiffusionReaction::setBatchedRates(false);
+
+}
+
+void testBed::testVectorExp()
+{
+
+    //Not a multiple of any path width, so the scalar tail runs as well.
+    const uint n = 1003;
+
+    vector<double> x(2*n);
+    vector<double> y(2*n);
+
+    for (uint i = 0; i < n; ++i)
+    {
+        x.at(i)     = -700 + 1400.0*i/(n - 1);
+        x.at(n + i) = -20 + 40.0*i/(n - 1);
+    }
+
+    CHECK(vectorExpWidth() == 1 || vectorExpWidth() == 4 || vectorExpWidth() == 8);
+
+    for (uint width : {1, 4, 8})
+    {
+
+        if (width > vectorExpWidth())
+        {
+            continue;
+        }
+
+        y.assign(2*n, 0);
+
+        vectorExp(x.data(), y.data(), 2*n, width);
+
+        for (uint i = 0; i < 2*n; ++i)
+        {
+            double exact = std::exp(x.at(i));
+
+            CHECK_CLOSE(exact, y.at(i), 1E-14*exact);
+        }
+
+    }
+
+    //Arguments past the limit are clamped on every path, to finite values.
+    const vector<double> outside = {709, 710, 750, 800, 1000, 1E4, 1E10, 1E300,
+                                    -709, -710, -750, -800, -1000, -1E4, -1E10, -1E300};
+
+    vector<double> clamped(outside.size());
+
+    for (uint width : {1, 4, 8})
+    {
+
+        if (width > vectorExpWidth())
+        {
+            continue;
+        }
+
+        vectorExp(outside.data(), clamped.data(), outside.size(), width);
+
+        for (uint i = 0; i < outside.size(); ++i)
+        {
+            double exact = std::exp(outside.at(i) > 0 ? 708.0 : -708.0);
+
+            CHECK(std::isfinite(clamped.at(i)));
+
+            CHECK_CLOSE(exact, clamped.at(i), 1E-14*exact);
+        }
+
+    }
+
+}
+
+void testBed::testIncrementalSaddleEnergy()
+{
+
+    solver->initializeCrystal(0.3);
+
+    //Long enough for several full recomputes of the most updated sums.
+    for (uint cycle = 0; cycle < 3000; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+    solver->getRateVariables();
+
+    solver->forEachSiteDo([] (Site * site)
+    {
+        site->forEachActiveReactionDo([] (Reaction * r)
+        {
+            DiffusionReaction * reaction = static_cast<DiffusionReaction*>(r);
+
+            CHECK_CLOSE(reaction->getSaddleEnergy(), reaction->lastUsedEsp(), 1E-10);
+
+            CHECK_CLOSE(reaction->getSaddleEnergy(), reaction->getUpdatedSaddleEnergy(), 1E-10);
+        });
+    });
+
+}
+
+void testBed::testAllowedDirections()
+{
+
+    const uint initialSeparation = DiffusionReaction::separation();
+
+    for (uint separation = 0; separation < 3; ++separation)
+    {
+
+        solver->reset();
+
+        DiffusionReaction::resetSeparationTo(separation);
+
+        solver->initializeCrystal(0.3);
+
+        for (uint cycle = 0; cycle < 500; ++cycle)
+        {
+
+            solver->getRateVariables();
+
+            solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+            Site::updateBoundaries();
+
+        }
+
+        solver->forEachSiteDo([] (Site * site)
+        {
+
+            bool legalToSpawn = !site->isActive();
+
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dz = -1; dz <= 1; ++dz)
+                    {
+
+                        const Site * destination = site->neighborhood(Site::nNeighborsLimit() + dx,
+                                                                      Site::nNeighborsLimit() + dy,
+                                                                      Site::nNeighborsLimit() + dz);
+
+                        if (destination == NULL || destination == site)
+                        {
+                            continue;
+                        }
+
+                        bool allowed = DiffusionReaction::isAllowed(site, destination);
+
+                        CHECK_EQUAL(allowed, site->isAllowedDirection(Site::directionIndex(dx, dy, dz)));
+
+                        legalToSpawn = legalToSpawn && allowed;
+
+                    }
+                }
+            }
+
+            CHECK_EQUAL(legalToSpawn, site->isLegalToSpawn());
+
+        });
+
+    }
+
+    solver->reset();
+
+    DiffusionReaction::resetSeparationTo(initialSeparation);
+
+}
+
+void testBed::testCrystalNeighborCounters()
+{
+
+    const uint initialSeparation = DiffusionReaction::separation();
+
+    for (uint separation = 0; separation < 3; ++separation)
+    {
+
+        solver->reset();
+
+        DiffusionReaction::resetSeparationTo(separation);
+
+        solver->initializeCrystal(0.3);
+
+        for (uint cycle = 0; cycle < 500; ++cycle)
+        {
+
+            solver->getRateVariables();
+
+            solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+            Site::updateBoundaries();
+
+        }
+
+        solver->forEachSiteDo([&separation] (Site * site)
+        {
+
+            CHECK_EQUAL(site->countNeighboring(ParticleStates::crystal, 1), site->nCrystalNeighbors());
+            CHECK_EQUAL(site->countNeighboring(ParticleStates::fixedCrystal, 1), site->nFixedCrystalNeighbors());
+            CHECK_EQUAL(site->countNeighboring(ParticleStates::crystal, separation), site->nCrystalNeighborsWithinSeparation());
+
+            //The skipped propagations must not leave any site in a state it no longer qualifies for.
+            if (site->particleState() == ParticleStates::crystal)
+            {
+                CHECK_EQUAL(true, site->qualifiesAsCrystal());
+            }
+
+            else if (site->isSurface())
+            {
+                CHECK_EQUAL(true, site->qualifiesAsSurface());
+            }
+
+        });
+
+    }
+
+    solver->reset();
+
+    DiffusionReaction::resetSeparationTo(initialSeparation);
+
+}
+
+void testBed::testActiveSiteList()
+{
+
+    auto checkActiveSites = [] ()
+    {
+
+        const vector<Site*> & activeSites = solver->activeSites();
+
+        CHECK_EQUAL(Site::totalActiveSites(), activeSites.size());
+
+        for (uint i = 0; i < activeSites.size(); ++i)
+        {
+            CHECK_EQUAL(true, activeSites.at(i)->isActive());
+            CHECK_EQUAL(i, activeSites.at(i)->activeSiteIndex());
+        }
+
+        uint nVisits = 0;
+
+        solver->forEachActiveSiteDo([&nVisits] (Site * site)
+        {
+            CHECK_EQUAL(true, site->isActive());
+            nVisits++;
+        });
+
+        CHECK_EQUAL(Site::totalActiveSites(), nVisits);
+
+    };
+
+    solver->reset();
+
+    checkActiveSites();
+
+    activateAllSites();
+
+    checkActiveSites();
+
+    //Removing every other site moves sites from the back into the holes.
+    solver->forEachSiteDo([] (Site * site)
+    {
+        if (solver->getSiteIndex(site)%2 == 0)
+        {
+            site->deactivate();
+        }
+    });
+
+    checkActiveSites();
+
+    solver->reset();
+
+    checkActiveSites();
+
+    solver->initializeCrystal(0.3);
+
+    for (uint cycle = 0; cycle < 1000; ++cycle)
+    {
+
+        solver->getRateVariables();
+
+        solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM())->execute();
+
+        Site::updateBoundaries();
+
+    }
+
+    checkActiveSites();
+
+    solver->reset();
+
+}
+
+void testBed::testBulkPlacement()
+{
+
+    //A crystal block around a seed, and a fixed scattering of legal solution particles.
+    auto place = [] ()
+    {
+
+        solver->getSite(NX()/2, NY()/2, NZ()/2)->spawnAsFixedCrystal();
+
+        solver->forEachSiteDo_sendIndices([] (Site * site, uint x, uint y, uint z)
+        {
+
+            if (site->isActive())
+            {
+                return;
+            }
+
+            bool inBlock = (x + 2 >= NX()/2 && x <= NX()/2 + 2 &&
+                            y + 2 >= NY()/2 && y <= NY()/2 + 2 &&
+                            z + 1 >= NZ()/2 && z <= NZ()/2 + 1);
+
+            if (inBlock || ((solver->getSiteIndex(site)*7919)%13 == 0 && site->isLegalToSpawn()))
+            {
+                site->activate();
+            }
+
+        });
+
+    };
+
+    vector<uint> states;
+    vector<double> energies;
+    vector<double> rates;
+
+    for (uint pass = 0; pass < 2; ++pass)
+    {
+
+        solver->reset();
+
+        if (pass == 0)
+        {
+            place();
+        }
+
+        else
+        {
+            solver->beginBulkPlacement();
+
+            place();
+
+            CHECK_EQUAL(true, solver->isPlacingInBulk());
+
+            solver->finalizeBulkPlacement();
+        }
+
+        CHECK_EQUAL(false, solver->isPlacingInBulk());
+
+        solver->getRateVariables();
+
+        uint n = 0;
+
+        solver->forEachSiteDo([&] (Site * site)
+        {
+
+            uint state = site->particleState() + 10*site->isActive() + 100*site->nNeighbors();
+
+            if (pass == 0)
+            {
+                states.push_back(state);
+                energies.push_back(site->energy());
+            }
+
+            else
+            {
+                CHECK_EQUAL(states.at(n), state);
+                CHECK_EQUAL(energies.at(n), site->energy());
+            }
+
+            n++;
+
+        });
+
+        n = 0;
+
+        solver->forEachActiveSiteDo([&] (Site * site)
+        {
+            site->forEachActiveReactionDo([&] (Reaction * reaction)
+            {
+
+                if (pass == 0)
+                {
+                    rates.push_back(reaction->rate());
+                }
+
+                else
+                {
+                    CHECK_EQUAL(rates.at(n), reaction->rate());
+                }
+
+                n++;
+
+            });
+        });
+
+        CHECK_EQUAL(rates.size(), n);
+
+    }
+
+    solver->reset();
+
+}
+
+void testBed::testConcurrentSolvers()
+{
+
+    //A system run from start to end on a solver of its own.
+    auto runSystem = [] ()
+    {
+
+        //The debugger is set per thread.
+        KMCDebugger_SetEnabledTo(false);
+
+        KMCSolver * ownSolver = new KMCSolver();
+
+        ownSolver->setRNGSeed(Seed::specific, 1000);
+
+        DiffusionReaction::setPotentialParameters(1.0, 0.5, false);
+
+        Site::setInitialBoundaries(Boundary::Periodic);
+
+        Site::setInitialNNeighborsLimit(2);
+
+        Reaction::setBeta(0.5);
+
+        ConcentrationWall::setMaxEventsPrCycle(7);
+
+        ownSolver->setBoxSize({10, 10, 10});
+
+        ownSolver->setNumberOfCycles(1000);
+
+        ownSolver->setCyclesPerOutput(1001);
+
+        ownSolver->initializeCrystal(0.2);
+
+        ownSolver->mainloop();
+
+        const SnapShot * snapShot = new SnapShot(ownSolver);
+
+        delete ownSolver;
+
+        return snapShot;
+
+    };
+
+    const uint nSites = solver->nSites();
+
+    const uint maxEventsPrCycle = ConcentrationWall::maxEventsPrCycle();
+
+    solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+
+    const double firstDraw = KMC_RNG_UNIFORM();
+
+    solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+
+    //Next to the test solver, which has to be made current again afterwards.
+    const SnapShot * reference = runSystem();
+
+    CHECK_EQUAL((KMCSolver*)NULL, KMCSolver::current());
+
+    solver->makeCurrent();
+
+    //The other solver drew from a stream of its own.
+    CHECK_EQUAL(firstDraw, KMC_RNG_UNIFORM());
+
+    //And so did the concentration walls read their settings from its own context.
+    CHECK_EQUAL(maxEventsPrCycle, ConcentrationWall::maxEventsPrCycle());
+
+    const uint nThreads = 2;
+
+    vector<const SnapShot*> snapShots(nThreads);
+
+    vector<thread> threads;
+
+    for (uint i = 0; i < nThreads; ++i)
+    {
+        threads.push_back(thread([&snapShots, &runSystem, i] ()
+        {
+            snapShots.at(i) = runSystem();
+        }));
+    }
+
+    for (thread & t : threads)
+    {
+        t.join();
+    }
+
+    for (const SnapShot * snapShot : snapShots)
+    {
+        CHECK_EQUAL(*reference, *snapShot);
+
+        delete snapShot;
+    }
+
+    delete reference;
+
+    CHECK_EQUAL(solver, KMCSolver::current());
+
+    CHECK_EQUAL(maxEventsPrCycle, ConcentrationWall::maxEventsPrCycle());
+
+    CHECK_EQUAL(nSites, solver->getSite(NX() - 1, NY() - 1, NZ() - 1) - solver->getSite(0) + 1);
+
+}
+
+void testBed::testParallelSetup()
+{
+
+#ifdef _OPENMP
+    const int maxThreads = omp_get_max_threads();
+#endif
+
+    //The site states, crystal neighbor counters and allowed directions of a system
+    //whose setup passes ran on the given number of threads. The rates go in a snapshot.
+    auto buildSystem = [] (const int nThreads, vector<uint> & siteStates)
+    {
+
+#ifdef _OPENMP
+        omp_set_num_threads(nThreads);
+#else
+        (void) nThreads;
+#endif
+
+        KMCSolver * ownSolver = new KMCSolver();
+
+        ownSolver->setRNGSeed(Seed::specific, 1000);
+
+        DiffusionReaction::setPotentialParameters(1.0, 0.5, false);
+
+        Site::setInitialBoundaries(Boundary::Periodic);
+
+        Site::setInitialNNeighborsLimit(2);
+
+        Reaction::setBeta(0.5);
+
+        ownSolver->setBoxSize({10, 10, 10});
+
+        ownSolver->setNumberOfCycles(200);
+
+        ownSolver->setCyclesPerOutput(201);
+
+        ownSolver->initializeCrystal(0.2);
+
+        ownSolver->mainloop();
+
+        //Sets the neighborhoods, counters and directions up again on the filled lattice.
+        Site::resetNNeighborsLimitTo(2);
+
+        ownSolver->getRateVariables();
+
+        siteStates.clear();
+
+        ownSolver->forEachSiteDo([&siteStates] (Site * site)
+        {
+
+            uint allowedDirections = 0;
+
+            for (uint direction = 0; direction < 27; ++direction)
+            {
+                allowedDirections |= (uint)site->isAllowedDirection(direction) << direction;
+            }
+
+            siteStates.push_back(site->particleState());
+            siteStates.push_back(site->isActive());
+            siteStates.push_back(site->nNeighborsSum());
+            siteStates.push_back(site->nCrystalNeighbors());
+            siteStates.push_back(site->nFixedCrystalNeighbors());
+            siteStates.push_back(site->nCrystalNeighborsWithinSeparation());
+            siteStates.push_back(allowedDirections);
+
+        });
+
+        const SnapShot * snapShot = new SnapShot(ownSolver);
+
+        delete ownSolver;
+
+        return snapShot;
+
+    };
+
+    vector<uint> serialStates;
+    vector<uint> parallelStates;
+
+    const SnapShot * serial = buildSystem(1, serialStates);
+
+    const SnapShot * parallel = buildSystem(4, parallelStates);
+
+#ifdef _OPENMP
+    omp_set_num_threads(maxThreads);
+#endif
+
+    solver->makeCurrent();
+
+    CHECK_EQUAL(serialStates.size(), parallelStates.size());
+
+    CHECK(serialStates == parallelStates);
+
+    CHECK_EQUAL(*serial, *parallel);
+
+    delete serial;
+    delete parallel;
+
+}
+
+void testBed::testCloneSolver()
+{
+
+    solver->initializeCrystal(0.3);
+
+    solver->getRateVariables();
+
+    const double kTot = solver->kTot();
+
+    const cube * potential = &DiffusionReaction::potentialBox();
+
+    const SnapShot * original = new SnapShot(solver);
+
+
+    KMCSolver * clone = new KMCSolver(*solver);
+
+    CHECK_EQUAL(clone, KMCSolver::current());
+
+    CHECK_EQUAL(solver->nSites(), clone->nSites());
+
+    CHECK_EQUAL(solver->simulatedTime(), clone->simulatedTime());
+
+    //The tables are shared, the occupation and the rates are copied.
+    CHECK_EQUAL(potential, &DiffusionReaction::potentialBox());
+
+    clone->getRateVariables();
+
+    CHECK_CLOSE(kTot, clone->kTot(), 1E-10*kTot);
+
+    const SnapShot * cloned = new SnapShot(clone);
+
+    CHECK_EQUAL(*original, *cloned);
+
+    delete cloned;
+
+
+    //Both continue the same random number stream.
+    clone->advance(1000);
+
+    cloned = new SnapShot(clone);
+
+    solver->makeCurrent();
+
+    solver->advance(1000);
+
+    delete original;
+
+    original = new SnapShot(solver);
+
+    CHECK_EQUAL(*original, *cloned);
+
+
+    //A solver setting its tables up again leaves the shared ones alone.
+    clone->makeCurrent();
+
+    const cube shared = *potential;
+
+    DiffusionReaction::setPotentialParameters(2.0, 0.5);
+
+    CHECK(potential != &DiffusionReaction::potentialBox());
+
+    for (uint i = 0; i < shared.n_elem; ++i)
+    {
+        CHECK_EQUAL(shared.memptr()[i], potential->memptr()[i]);
+    }
+
+    delete clone;
+
+    delete original;
+
+    delete cloned;
+
+    solver->makeCurrent();
+
+}
+
+void testBed::testOutputOrder()
+{
+
+    const uint nCycles = 3;
+
+    solver->initializeCrystal(0.2);
+
+    solver->setNumberOfCycles(nCycles);
+
+    solver->setCyclesPerOutput(1);
+
+    vector<uint> cycles;
+    vector<double> times;
+
+    solver->setOutputHook([&] ()
+    {
+        cycles.push_back(solver->currentCycle());
+        times.push_back(solver->simulatedTime());
+    });
+
+    solver->mainloop();
+
+    solver->setOutputHook(function<void ()>());
+
+
+    CHECK_EQUAL(nCycles, cycles.size());
+
+    //Each output is written before the clock moves past the cycle's reaction, so the
+    //first shows no time passed yet.
+    CHECK_EQUAL(0, times.front());
+
+    for (uint i = 0; i < cycles.size(); ++i)
+    {
+        CHECK_EQUAL(i + 1, cycles.at(i));
+
+        if (i != 0)
+        {
+            CHECK(times.at(i) > times.at(i - 1));
+        }
+    }
+
+    CHECK(solver->simulatedTime() > times.back());
+
+    CHECK_EQUAL(nCycles + 1, solver->currentCycle());
+
+}
+
+void testBed::testSublatticeEngine()
+{
+
+    Config cfg;
+
+    cfg.readFile("infiles/sublattice.cfg");
+
+    const Setting & root = cfg.getRoot();
+
+    SublatticeEngine engine(root, 0.5);
+
+    CHECK_EQUAL(solver, KMCSolver::current());
+
+    const uint nNeighborsLimit = getSetting<uint>(root, {"System", "nNeighborsLimit"});
+
+    const uint minWidth = nNeighborsLimit + getSetting<uint>(root, {"Reactions", "Diffusion", "separation"}) + 1;
+
+    uvec3 N;
+
+    uint nDomains = 1;
+
+    for (uint dim = 0; dim < 3; ++dim)
+    {
+        N(dim) = getSetting(root, {"System", "BoxSize"})[dim];
+
+        CHECK_EQUAL(0, engine.nDomains()(dim)%2);
+
+        CHECK(engine.domainWidths()(dim) >= minWidth);
+
+        nDomains *= engine.nDomains()(dim);
+    }
+
+    CHECK_EQUAL(16, nDomains);
+
+    CHECK_EQUAL(8, engine.nColors());
+
+
+    const uvec3 & n = engine.nDomains();
+
+    auto color = [&n] (uint domain)
+    {
+        return domain%2 + 2*((domain/n(0))%2) + 4*((domain/(n(0)*n(1)))%2);
+    };
+
+    //Domains of one color never border each other.
+    for (uint x = 0; x < N(0); ++x)
+    {
+        for (uint y = 0; y < N(1); ++y)
+        {
+            for (uint z = 0; z < N(2); ++z)
+            {
+
+                const uint domain = engine.domainOf(x, y, z);
 
+                CHECK(domain < nDomains);
 
-    CHECK_EQUAL(3, Site::nSolutionParticles());
+                for (int dx = -(int)nNeighborsLimit; dx <= (int)nNeighborsLimit; ++dx)
+                {
+                    for (int dy = -(int)nNeighborsLimit; dy <= (int)nNeighborsLimit; ++dy)
+                    {
+                        for (int dz = -(int)nNeighborsLimit; dz <= (int)nNeighborsLimit; ++dz)
+                        {
 
-    CHECK_EQUAL(3.0/124, Site::getCurrentSolutionDensity());
+                            const uint other = engine.domainOf((x + N(0) + dx)%N(0),
+                                                               (y + N(1) + dy)%N(1),
+                                                               (z + N(2) + dz)%N(2));
 
-    activateAllSites();
+                            if (other != domain)
+                            {
+                                CHECK(color(domain) != color(other));
+                            }
 
+                        }
+                    }
+                }
 
-    CHECK_EQUAL(0, Site::nSurfaces());
-    CHECK_EQUAL(125, Site::nCrystals());
-    CHECK_EQUAL(0, Site::nSolutionParticles());
+            }
+        }
+    }
 
-    CHECK_EQUAL(0, Site::getCurrentSolutionDensity());
-    CHECK_EQUAL(1.0, Site::getCurrentRelativeCrystalOccupancy());
 
-    boxTop = Site::getCurrentCrystalBoxTopology();
+    engine.initializeSolutionBath();
 
-    CHECK_EQUAL(0, boxTop(0, 0));
-    CHECK_EQUAL(0, boxTop(1, 0));
-    CHECK_EQUAL(0, boxTop(2, 0));
+    CHECK_EQUAL(0, engine.countGhostMismatches());
 
-    CHECK_EQUAL(NX()-1, boxTop(0, 1));
-    CHECK_EQUAL(NY()-1, boxTop(1, 1));
-    CHECK_EQUAL(NZ()-1, boxTop(2, 1));
+    const uint nParticles = engine.nParticles();
 
+    CHECK(nParticles > 0);
 
-    CHECK_EQUAL(0, Site::getCurrentSolutionDensity());
 
-    deactivateAllSites();
+    const uint nWindows = 3;
 
-    center->spawnAsFixedCrystal();
-    solver->getSite(2, 2, 3)->activate();
-    solver->getSite(2, 2, 4)->activate();
+    engine.advance(nWindows);
 
-    solver->getSite(2, 1, 1)->activate();
-    solver->getSite(2, 1, 2)->activate();
-    solver->getSite(2, 1, 3)->activate();
+    CHECK_CLOSE(nWindows*engine.window(), engine.simulatedTime(), 1E-10);
 
+    CHECK(engine.nEvents() > 0);
 
-    solver->getSite(2, 3, 3)->activate();
+    CHECK(engine.nBoundaryEvents() > 0);
 
-    /*
-     *        x x x
-     *          x x x
-     *            x
-     *
-     */
+    CHECK(engine.nRejectedEvents() <= engine.nBoundaryEvents());
 
+    CHECK(engine.rejectionRate() >= 0 && engine.rejectionRate() <= 1);
 
-    boxTop = Site::getCurrentCrystalBoxTopology();
+    CHECK(engine.parallelEfficiency() > 0 && engine.parallelEfficiency() <= 1);
 
-    CHECK_EQUAL(2, boxTop(0, 0));
-    CHECK_EQUAL(1, boxTop(1, 0));
-    CHECK_EQUAL(1, boxTop(2, 0));
+    CHECK_EQUAL(nParticles, engine.nParticles());
 
-    CHECK_EQUAL(2, boxTop(0, 1));
-    CHECK_EQUAL(3, boxTop(1, 1));
-    CHECK_EQUAL(4, boxTop(2, 1));
+    //The changes of each phase reach the ghost layers of every other domain.
+    CHECK_EQUAL(0, engine.countGhostMismatches());
+
+    CHECK_EQUAL(solver, KMCSolver::current());
 
 }
 
-void testBed::testRNG()
+#ifdef KMC_MPI
+void testBed::testDistributedEngine()
 {
 
-    double U  = 0;
-    double U2 = 0;
-    double N  = 0;
-    double N2 = 0;
+    Config cfg;
 
-    double Ui;
-    double Ni;
+    cfg.readFile("infiles/distributed.cfg");
 
-    uint COUNT = 1000000;
-    for (uint i = 0; i < COUNT; ++i)
-    {
-        Ui = KMC_RNG_UNIFORM();
-        Ni = KMC_RNG_NORMAL();
+    const Setting & root = cfg.getRoot();
 
-        U  += Ui;
-        U2 += Ui*Ui;
+    const double window = getSetting<double>(root, {"Distributed", "window"});
 
-        N  += Ni;
-        N2 += Ni*Ni;
-    }
 
-    double stdU;
-    double stdN;
+    //Particles on half the sites with even coordinates, picked by their global index. No two
+    //are closest neighbors, so the state of a brick does not depend on the order it is filled
+    //in, and ghosts get the state of their owners without an exchange.
+    auto fill = [] (const Brick * brick)
+    {
 
-    U  /= COUNT;
-    U2 /= COUNT;
-    N  /= COUNT;
-    N2 /= COUNT;
+        brick->solver()->makeCurrent();
 
+        const uvec3 & N = brick->N();
 
-    stdU = sqrt(U2 - U*U);
-    stdN = sqrt(N2 - N*N);
+        brick->solver()->forEachSiteDo([brick, &N] (Site * site)
+        {
 
+            const uint index = brick->globalIndex(site);
 
-    CHECK_CLOSE(0.5, U, 0.01);
-    CHECK_CLOSE(1.0/sqrt(12), stdU, 0.01);
+            const uint x = index%N(0);
+            const uint y = (index/N(0))%N(1);
+            const uint z = index/(N(0)*N(1));
 
-    CHECK_CLOSE(0, N, 0.01);
-    CHECK_CLOSE(1, stdN, 0.01);
+            if (x%2 == 0 && y%2 == 0 && z%2 == 0 && ((index*2654435761u) >> 16)%2 == 0)
+            {
+                site->activate();
+            }
 
-    vector<double> setn;
-    vector<double> setu;
+        });
 
-    solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+    };
 
-    for (uint i = 0; i < 1000000; ++i)
+    //The total rate of the reactions of the owned sites.
+    auto ownedRate = [] (const Brick * brick)
     {
-        setu.push_back(KMC_RNG_UNIFORM());
-        setn.push_back(KMC_RNG_NORMAL());
-    }
 
+        brick->solver()->makeCurrent();
 
-    solver->setRNGSeed(Seed::specific, Seed::initialSeed);
+        brick->solver()->getRateVariables();
 
-    for (uint i = 0; i < 1000000; ++i)
-    {
-        CHECK_EQUAL(KMC_RNG_UNIFORM(), setu.at(i));
-        CHECK_EQUAL(KMC_RNG_NORMAL(), setn.at(i));
-    }
+        double rate = 0;
 
+        brick->solver()->forEachSiteDo([brick, &rate] (Site * site)
+        {
+            if (brick->owns(site))
+            {
+                site->forEachActiveReactionDo([&rate] (Reaction * reaction)
+                {
+                    rate += reaction->rate();
+                });
+            }
+        });
 
-}
+        return rate;
 
-void testBed::testBinarySearchChoise()
-{
+    };
 
 
-    uint choice;
-    uint secondChoice;
-    double R;
+    SublatticeEngine sublattice(root, window);
 
-    solver->initializeCrystal(0.3);
+    DistributedEngine distributed(root);
 
-    solver->getRateVariables();
+    const uint nDomains = prod(sublattice.nDomains());
 
-    uint N = 10;
-    uint n = 0;
+    double sublatticeRate = 0;
 
-    while(n != N)
+    for (uint domain = 0; domain < nDomains; ++domain)
     {
+        fill(sublattice.brick(domain));
 
-        R = solver->kTot()*KMC_RNG_UNIFORM();
+        sublatticeRate += ownedRate(sublattice.brick(domain));
+    }
 
-        choice = solver->getReactionChoice(R);
+    fill(distributed.brick());
 
-        secondChoice = 0;
-        while (solver->accuAllRates().at(secondChoice) <= R)
-        {
-            secondChoice++;
-        }
+    const double localRate = ownedRate(distributed.brick());
 
-        CHECK_EQUAL(secondChoice, choice);
+    double distributedRate;
 
-        n++;
+    MPI_Allreduce(&localRate, &distributedRate, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
-    }
+    CHECK_EQUAL(0, sublattice.countGhostMismatches());
 
+    CHECK_EQUAL(0, distributed.countGhostMismatches());
 
+    //The same system, however it is split.
+    const uint nParticles = sublattice.nParticles();
 
-}
+    CHECK(nParticles > 0);
 
-void testBed::testReactionChoise()
-{
+    CHECK_EQUAL(nParticles, distributed.nParticles());
 
+    CHECK(sublatticeRate > 0);
 
-    uint choice, count, count2;
+    CHECK_CLOSE(sublatticeRate, distributedRate, 1E-10*sublatticeRate);
 
-    double kTot, r_pre;
 
-    Reaction* reaction;
+    const uint nWindows = 3;
 
+    sublattice.advance(nWindows);
 
-    uint N = 3;
-    uint n = 0;
+    distributed.advance(nWindows);
 
+    CHECK(distributed.nEvents() > 0);
 
-    solver->initializeCrystal(0.3);
+    CHECK_CLOSE(sublattice.simulatedTime(), distributed.simulatedTime(), 1E-10);
 
-    solver->getRateVariables();
+    //Particles which moved into a ghost layer were handed on to their owners.
+    CHECK_EQUAL(nParticles, sublattice.nParticles());
 
-    while(n != N)
-    {
+    CHECK_EQUAL(nParticles, distributed.nParticles());
 
-        r_pre = 0;
+    CHECK_EQUAL(0, distributed.countGhostMismatches());
 
-        count2 = 0;
+    solver->makeCurrent();
 
-        for (double r_i : solver->accuAllRates())
-        {
+}
+#endif
 
-            double R = (r_i + r_pre)/2;
+void testBed::testTimeWarpEngine()
+{
 
-            choice = solver->getReactionChoice(R);
+    Config cfg;
 
-            kTot = 0;
+    cfg.readFile("infiles/knowncase.cfg");
 
-            count = 0;
+    const Setting & root = cfg.getRoot();
 
-            for (uint i = 0; i < NX(); ++i)
-            {
-                for (uint j = 0; j < NY(); ++j)
-                {
-                    for (uint k = 0; k < NZ(); ++k)
-                    {
-                        bool notSet = true;
-                        solver->getSite(i, j, k)->forEachActiveReactionDo([&] (Reaction * r)
-                        {
-                            if (!notSet)
-                            {
-                                return;
-                            }
+    TimeWarpEngine engine(root, {2, 2, 1}, 0.01);
 
-                            CHECK_EQUAL(r, solver->allReactions().at(count));
+    CHECK_EQUAL(solver, KMCSolver::current());
 
-                            kTot += r->rate();
+    CHECK_EQUAL(4, engine.nDomains());
 
-                            CHECK_EQUAL(kTot, solver->accuAllRates().at(count));
+    engine.initializeSolutionBath();
 
-                            //if by adding this reaction we surpass the limit, we
-                            //are done searching.
-                            if (kTot > R)
-                            {
-                                reaction = r;
+    CHECK_EQUAL(0, engine.countGhostMismatches());
 
-                                i = NX();
-                                j = NY();
-                                k = NZ();
+    const uint nParticles = engine.nParticles();
 
-                                notSet = false;
-                            }
+    CHECK(nParticles > 0);
 
-                            if (notSet)
-                            {
-                                count++;
-                            }
-                        });
-                    }
-                }
-            }
 
-            CHECK_EQUAL(solver->allReactions().at(choice), reaction);
-            CHECK_EQUAL(choice, count);
-            CHECK_EQUAL(count, count2);
+    const double time = 0.5;
 
-            count2++;
+    engine.advance(time);
 
-            r_pre = r_i;
-        }
+    CHECK_CLOSE(time, engine.simulatedTime(), 1E-10);
 
-        n++;
+    CHECK(engine.nRounds() >= (uint)(time/engine.horizon()));
 
-    }
+    CHECK(engine.nCommittedEvents() > 0);
+
+    CHECK(engine.nMessages() > 0);
+
+    //Every processed event is either committed or reversed.
+    CHECK_EQUAL(engine.nProcessedEvents(), engine.nCommittedEvents() + engine.nRolledBackEvents());
+
+    CHECK(engine.nAntiMessages() <= engine.nMessages());
+
+    CHECK(engine.efficiency() > 0 && engine.efficiency() <= 1);
 
+    CHECK(engine.parallelEfficiency() > 0 && engine.parallelEfficiency() <= 1);
+
+    //Once committed, the domains agree on every site they share.
+    CHECK_EQUAL(nParticles, engine.nParticles());
+
+    CHECK_EQUAL(0, engine.countGhostMismatches());
+
+    CHECK_EQUAL(solver, KMCSolver::current());
 
 }
 
@@ -1388,6 +3093,29 @@ void testBed::deactivateAllSites()
     });
 }
 
+double testBed::collectAllReactions(vector<Reaction *> &allReactions, vector<double> &accuAllRates)
+{
+
+    double kTot = 0;
+
+    allReactions.clear();
+    accuAllRates.clear();
+
+    solver->forEachSiteDo([&] (Site * site)
+    {
+        site->forEachActiveReactionDo([&] (Reaction * r)
+        {
+            kTot += r->rate();
+
+            accuAllRates.push_back(kTot);
+            allReactions.push_back(r);
+        });
+    });
+
+    return kTot;
+
+}
+
 Site *testBed::getBoxCenter()
 {
     return solver->getSite(NX()/2, NY()/2, NZ()/2);
@@ -1627,6 +3355,77 @@ void testBed::testnNeiborsLimit()
 
 
 
+}
+
+void testBed::testNeighborhoodKernels()
+{
+
+    solver->setBoxSize({12, 12, 12}, false);
+
+    Site::resetBoundariesTo(Boundary::Periodic);
+
+    DiffusionReaction::resetSeparationTo(1);
+
+    //Limits above four use the generic kernels.
+    for (uint nNlim = 1; nNlim <= 5; ++nNlim)
+    {
+
+        solver->reset();
+
+        Site::resetNNeighborsLimitTo(nNlim, false);
+
+        solver->forEachSiteDo([] (Site * site)
+        {
+            if (KMC_RNG_UNIFORM() < 0.2 && site->isLegalToSpawn())
+            {
+                site->activate();
+            }
+        });
+
+        solver->forEachSiteDo([&nNlim] (Site * site)
+        {
+
+            uvec nNeighbors;
+
+            nNeighbors.zeros(nNlim);
+
+            double energy = 0;
+
+            uint nClosest = 0;
+
+            site->forEachNeighborDo_sendIndices([&] (Site * neighbor, uint i, uint j, uint k)
+            {
+
+                uint distance = site->maxDistanceTo(neighbor);
+
+                if (distance == 1 && neighbor->particleState() == ParticleStates::solution)
+                {
+                    nClosest++;
+                }
+
+                if (neighbor->isActive())
+                {
+                    nNeighbors(distance - 1)++;
+                    energy += DiffusionReaction::potential(i, j, k);
+                }
+
+            });
+
+            for (uint level = 0; level < nNlim; ++level)
+            {
+                CHECK_EQUAL(nNeighbors(level), site->nNeighbors(level));
+            }
+
+            CHECK_CLOSE(energy, site->energy(), 1E-10);
+
+            CHECK_EQUAL(nClosest, site->countNeighboring(ParticleStates::solution, 1));
+
+            CHECK_EQUAL(nClosest != 0, site->hasNeighboring(ParticleStates::solution, 1));
+
+        });
+
+    }
+
 }
 
 void testBed::testnNeighborsToCrystallize()
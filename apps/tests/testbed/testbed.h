@@ -19,8 +19,30 @@ public:
 
     static void makeSolver();
 
+    static void testSiteIndexing();
+
     static void testTotalParticleStateCounters();
 
+    static void testActiveSiteList();
+
+    static void testBulkPlacement();
+
+    static void testConcurrentSolvers();
+
+    static void testParallelSetup();
+
+    static void testCloneSolver();
+
+    static void testOutputOrder();
+
+    static void testSublatticeEngine();
+
+#ifdef KMC_MPI
+    static void testDistributedEngine();
+#endif
+
+    static void testTimeWarpEngine();
+
     static void testDistanceTo();
 
     static void testDeactivateSurface();
@@ -37,6 +59,34 @@ public:
 
     static void testReactionChoise();
 
+    static void testRateTreeUpdates();
+
+    static void testCompositionRejection();
+
+    static void testNextReactionMethod();
+
+    static void testUpdateFlagStencil();
+
+    static void testNeighborhoodKernels();
+
+    static void testParticleReactionStorage();
+
+    static void testReactionFields();
+
+    static void testBoltzmannFactors();
+
+    static void testRateCache();
+
+    static void testBatchedRates();
+
+    static void testVectorExp();
+
+    static void testIncrementalSaddleEnergy();
+
+    static void testAllowedDirections();
+
+    static void testCrystalNeighborCounters();
+
     static void testRateCalculation();
 
     static void testEnergyAndNeighborSetup();
@@ -97,6 +147,8 @@ private:
 
     static void deactivateAllSites();
 
+    static double collectAllReactions(vector<Reaction*> & allReactions, vector<double> & accuAllRates);
+
     static Site * getBoxCenter();
 
     static string lastBoundariesName;
@@ -13,7 +13,9 @@ HEADERS += testbed/testbed.h \
     snapshot/snapshot.h \
     defines.h
 
-OTHER_FILES += infiles/knowncase.cfg
+OTHER_FILES += infiles/knowncase.cfg \
+    infiles/sublattice.cfg \
+    infiles/distributed.cfg
 
 
 
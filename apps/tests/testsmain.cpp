@@ -23,9 +23,34 @@ SUITE(Misc)
 
     TESTWRAPPER(TotalParticleStateCounters)
 
+    TESTWRAPPER(ActiveSiteList)
+
+    TESTWRAPPER(BulkPlacement)
+
+    TESTWRAPPER(ConcurrentSolvers)
+
+    TESTWRAPPER(ParallelSetup)
+
+    TESTWRAPPER(CloneSolver)
+
+    TESTWRAPPER(OutputOrder)
+
+    TESTWRAPPER(SublatticeEngine)
+
+    TESTWRAPPER(TimeWarpEngine)
+
+    TESTWRAPPER(SiteIndexing)
+
     TESTWRAPPER(PropertyCalculations)
 }
 
+#ifdef KMC_MPI
+SUITE(Distributed)
+{
+    TESTWRAPPER(DistributedEngine)
+}
+#endif
+
 SUITE(Reactions)
 {
 
@@ -33,6 +58,30 @@ SUITE(Reactions)
 
     TESTWRAPPER(ReactionChoise)
 
+    TESTWRAPPER(RateTreeUpdates)
+
+    TESTWRAPPER(CompositionRejection)
+
+    TESTWRAPPER(NextReactionMethod)
+
+    TESTWRAPPER(UpdateFlagStencil)
+
+    TESTWRAPPER(ParticleReactionStorage)
+
+    TESTWRAPPER(ReactionFields)
+
+    TESTWRAPPER(BoltzmannFactors)
+
+    TESTWRAPPER(RateCache)
+
+    TESTWRAPPER(BatchedRates)
+
+    TESTWRAPPER(VectorExp)
+
+    TESTWRAPPER(IncrementalSaddleEnergy)
+
+    TESTWRAPPER(AllowedDirections)
+
 }
 
 SUITE(StateChanges)
@@ -40,6 +89,8 @@ SUITE(StateChanges)
     TESTWRAPPER(HasCrystalNeighbor)
 
     TESTWRAPPER(DeactivateSurface)
+
+    TESTWRAPPER(CrystalNeighborCounters)
 }
 
 SUITE(Parameters)
@@ -51,6 +102,8 @@ SUITE(Parameters)
 
     TESTWRAPPER(DiffusionSeparation)
 
+    TESTWRAPPER(NeighborhoodKernels)
+
 }
 
 #define AllBoundaryTests                \
@@ -100,8 +153,16 @@ SUITE(MixedBoundaries)
     AllBoundaryTests
 }
 
-int main()
+int main(int argc, char ** argv)
 {
+
+#ifdef KMC_MPI
+    MPI_Init(&argc, &argv);
+#else
+    (void) argc;
+    (void) argv;
+#endif
+
     using namespace SuiteMixedBoundaries;
 
     KMCDebugger_SetEnabledTo(false);
@@ -127,6 +188,23 @@ int main()
 
     UnitTest::TestRunner runner(reporter);
 
+#ifdef KMC_MPI
+    //Collective, so every rank takes part; the other suites run on the first rank alone.
+    exitSuccess += RUNSUITE(runner, "Distributed");
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (rank != 0)
+    {
+        delete testBed::solver;
+
+        MPI_Finalize();
+
+        return exitSuccess;
+    }
+#endif
+
     exitSuccess += RUNSUITE(runner, "Misc");
     exitSuccess += RUNSUITE(runner, "Reactions");
     exitSuccess += RUNSUITE(runner, "StateChanges");
@@ -152,5 +230,9 @@ int main()
 
     delete testBed::solver;
 
+#ifdef KMC_MPI
+    MPI_Finalize();
+#endif
+
     return exitSuccess;
 }
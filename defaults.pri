@@ -2,10 +2,13 @@ CONFIG -= app_bundle
 CONFIG -= qt
 CONFIG += RNG_ZIG
 
+#Builds the MPI engine and the distributed app; needs mpicxx.
+#CONFIG += MPI
+
 
 QMAKE_CXX = gcc
 
-COMMON_CXXFLAGS = -std=c++11
+COMMON_CXXFLAGS = -std=c++11 -fopenmp
 
 QMAKE_CXXFLAGS += $$COMMON_CXXFLAGS
 QMAKE_CXXFLAGS_DEBUG += $$COMMON_CXXFLAGS -DKMC_VERBOSE_DEBUG
@@ -13,7 +16,7 @@ QMAKE_CXXFLAGS_RELEASE += $$COMMON_CXXFLAGS -O3 -DNDEBUG -DARMA_NO_DEBUG -DKMC_N
 
 INCLUDEPATH += $(HOME)/Dropbox/libs
 
-LIBS += -larmadillo -lconfig++
+LIBS += -larmadillo -lconfig++ -fopenmp
 
 DEFINES += ARMA_MAT_PREALLOC=3
 
@@ -21,4 +24,10 @@ CONFIG(RNG_ZIG) {
     DEFINES += KMC_RNG_ZIG
 }
 
+CONFIG(MPI) {
+    QMAKE_CXX = mpicxx
+    QMAKE_LINK = mpicxx
+    DEFINES += KMC_MPI
+}
+
 TOP_PWD = $$PWD
@@ -2,4 +2,4 @@
 
 using namespace kMC;
 
-seed_type                 Seed::initialSeed = -1;
+thread_local seed_type    Seed::initialSeed = -1;
@@ -14,6 +14,12 @@
 
 typedef int seed_type;
 
+typedef MWC8222_STATE rng_state;
+
+//! Points the uniform and normal draws of the calling thread at the state, or back at
+//! the thread's own state for NULL.
+#define KMC_SET_RNG_STATE(state) RanSetState_MWC8222(state)
+
 #define KMC_INIT_RNG(seed)                  \
     kMC::Seed::initialSeed = seed;          \
     int inseed = static_cast<int>(seed);    \
@@ -43,7 +49,8 @@ struct Seed
     };
 
 
-    static seed_type initialSeed;
+    //! The seed of the solver current on this thread, see KMCSolver::makeCurrent().
+    static thread_local seed_type initialSeed;
 
 };
 
@@ -38,7 +38,7 @@ static double DRanNormalTail(double dMin, int iNegative)
 
 /* s_adZigX holds coordinates, such that each rectangle has*/
 /* same area; s_adZigR holds s_adZigX[i + 1] / s_adZigX[i] */
-static double s_adZigX[ZIGNOR_C + 1], s_adZigR[ZIGNOR_C];
+static thread_local double s_adZigX[ZIGNOR_C + 1], s_adZigR[ZIGNOR_C];
 
 static void zigNorInit(int iC, double dR, double dV)
 {
@@ -82,10 +82,10 @@ double  DRanNormalZig(void)
 }
 
 #define ZIGNOR_STORE 64 * 4
-static unsigned int s_auiZigTmp[ZIGNOR_STORE / 4];
-static unsigned int s_auiZigBox[ZIGNOR_STORE];
-static double s_adZigRan[ZIGNOR_STORE + ZIGNOR_STORE / 4];
-static int s_cZigStored = 0;
+static thread_local unsigned int s_auiZigTmp[ZIGNOR_STORE / 4];
+static thread_local unsigned int s_auiZigBox[ZIGNOR_STORE];
+static thread_local double s_adZigRan[ZIGNOR_STORE + ZIGNOR_STORE / 4];
+static thread_local int s_cZigStored = 0;
 
 double  DRanNormalZigVec(void)
 {
@@ -145,8 +145,8 @@ void  RanNormalSetSeedZigVec(int *piSeed, int cSeed)
 /*------------------------------ Integer Ziggurat --------------------------*/
 #define ZIGNOR_INVM	M_RAN_INVM32
 
-static unsigned int s_aiZigRm[ZIGNOR_C];
-static double s_adZigXm[ZIGNOR_C + 1];
+static thread_local unsigned int s_aiZigRm[ZIGNOR_C];
+static thread_local double s_adZigXm[ZIGNOR_C + 1];
 
 static void zig32NorInit(int iC, double dR, double dV)
 {
@@ -193,9 +193,9 @@ double  DRanNormalZig32(void)
 	}
 }
 #define ZIGNOR32_STORE 64 * 4
-static unsigned int s_auiZig32Ran[ZIGNOR32_STORE];
-static unsigned int s_auiZig32Box[ZIGNOR32_STORE];
-static int s_cZig32Stored = 0;
+static thread_local unsigned int s_auiZig32Ran[ZIGNOR32_STORE];
+static thread_local unsigned int s_auiZig32Box[ZIGNOR32_STORE];
+static thread_local int s_cZig32Stored = 0;
 
 double  DRanNormalZig32Vec(void)
 {
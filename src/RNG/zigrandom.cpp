@@ -38,13 +38,21 @@ void GetInitialSeeds(unsigned int auiSeed[], int cSeed,
 
 
 /*------------------------ George Marsaglia MWC ----------------------------*/
-#define MWC_R  256
 #define MWC_A  LIT_UINT64(809430660)
 #define MWC_AI 809430660
 #define MWC_C  362436
-static unsigned int s_uiStateMWC = MWC_R - 1;
-static unsigned int s_uiCarryMWC = MWC_C;
-static unsigned int s_auiStateMWC[MWC_R];
+/* the stream of the thread, unless RanSetState_MWC8222 points it elsewhere */
+static thread_local MWC8222_STATE s_stateMWC = {MWC_R - 1, MWC_C, {0}};
+static thread_local MWC8222_STATE *s_pStateMWC = &s_stateMWC;
+
+#define s_uiStateMWC  (s_pStateMWC->uiState)
+#define s_uiCarryMWC  (s_pStateMWC->uiCarry)
+#define s_auiStateMWC (s_pStateMWC->auiState)
+
+void RanSetState_MWC8222(MWC8222_STATE *pState)
+{
+	s_pStateMWC = pState ? pState : &s_stateMWC;
+}
 
 void RanSetSeed_MWC8222(int *piSeed, int cSeed)
 {
@@ -119,13 +127,13 @@ void VecDRan_MWC8222(double *adRan, int cRan)
 
 
 /*------------------- normal random number generators ----------------------*/
-static int s_cNormalInStore = 0;		     /* > 0 if a normal is in store */
+static thread_local int s_cNormalInStore = 0;		     /* > 0 if a normal is in store */
 
-static DRANFUN s_fnDRanu = DRan_MWC8222;
-static IRANFUN s_fnIRanu = IRan_MWC8222;
-static IVECRANFUN s_fnVecIRanu = VecIRan_MWC8222;
-static DVECRANFUN s_fnVecDRanu = VecDRan_MWC8222;
-static RANSETSEEDFUN s_fnRanSetSeed = RanSetSeed_MWC8222;
+static thread_local DRANFUN s_fnDRanu = DRan_MWC8222;
+static thread_local IRANFUN s_fnIRanu = IRan_MWC8222;
+static thread_local IVECRANFUN s_fnVecIRanu = VecIRan_MWC8222;
+static thread_local DVECRANFUN s_fnVecDRanu = VecDRan_MWC8222;
+static thread_local RANSETSEEDFUN s_fnRanSetSeed = RanSetSeed_MWC8222;
 
 double  DRanU(void)
 {
@@ -208,7 +216,7 @@ void    RanSetRanExt(DRANFUN DRanFun, IRANFUN IRanFun, IVECRANFUN IVecRanFun,
 	d = sqrt( (-2.0 / d) * log(d) );       	  \
 	u1 *= d;  u2 *= d
 
-static double s_dNormalInStore;
+static thread_local double s_dNormalInStore;
 
 double  DRanNormalPolar(void)                         /* Polar Marsaglia */
 {
@@ -234,7 +242,7 @@ return u1;
 	d = sqrt( (-2.0 / d) * log(d) );       	  \
 	u1 *= d;  u2 *= d
 
-static float s_fNormalInStore;
+static thread_local float s_fNormalInStore;
 double  FRanNormalPolar(void)                         /* Polar Marsaglia */
 {
     float d, u1;
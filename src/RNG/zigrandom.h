@@ -46,6 +46,17 @@ void 	GetInitialSeeds(unsigned int auiSeed[], int cSeed,
 	unsigned int uiSeed, unsigned int uiMin);
 
 /* MWC8222 George Marsaglia */
+#define MWC_R  256
+
+typedef struct
+{
+	unsigned int uiState;
+	unsigned int uiCarry;
+	unsigned int auiState[MWC_R];
+} MWC8222_STATE;
+
+/* draws from and seeds the given state on the calling thread; NULL for its own */
+void RanSetState_MWC8222(MWC8222_STATE *pState);
 void RanSetSeed_MWC8222(int *piSeed, int cSeed);
 unsigned int IRan_MWC8222(void);
 double DRan_MWC8222(void);
@@ -99,7 +99,6 @@ void Boundary::distanceFromSite(const Site *site, int &dxi, bool abs)
 void Boundary::setMainSolver(KMCSolver *solver)
 {
     m_solver = solver;
-    m_currentBoundaries.resize(3);
 }
 
 bool Boundary::isCompatible(const int type1, const int type2, bool reverse)
@@ -162,16 +161,16 @@ void Boundary::setupCurrentBoundaries(const uint x, const uint y, const uint z)
     uvec3 loc;
     setupLocations(x, y, z, loc);
 
-    m_currentBoundaries.at(0) = Site::boundaries(0, loc(0));
-    m_currentBoundaries.at(1) = Site::boundaries(1, loc(1));
-    m_currentBoundaries.at(2) = Site::boundaries(2, loc(2));
+    m_currentBoundaries[0] = Site::boundaries(0, loc(0));
+    m_currentBoundaries[1] = Site::boundaries(1, loc(1));
+    m_currentBoundaries[2] = Site::boundaries(2, loc(2));
 
 }
 
 
 uint Boundary::BLOCKED_COORDINATE = (uint)ULLONG_MAX;
 
-KMCSolver* Boundary::m_solver;
+thread_local KMCSolver* Boundary::m_solver = NULL;
 
 
-vector<const Boundary*> Boundary::m_currentBoundaries;
+thread_local const Boundary* Boundary::m_currentBoundaries[3] = {NULL, NULL, NULL};
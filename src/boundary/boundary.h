@@ -63,7 +63,7 @@ public:
 
     static void clearAll()
     {
-        m_currentBoundaries.clear();
+        m_currentBoundaries[0] = m_currentBoundaries[1] = m_currentBoundaries[2] = NULL;
         m_solver = NULL;
     }
 
@@ -91,7 +91,7 @@ public:
 
     static const Boundary* currentBoundaries(const uint i)
     {
-        return m_currentBoundaries.at(i);
+        return m_currentBoundaries[i];
     }
 
     const uint & orientation() const
@@ -103,7 +103,7 @@ private:
 
     static uint BLOCKED_COORDINATE;
 
-    static KMCSolver * m_solver;
+    static thread_local KMCSolver * m_solver;
 
     const uint m_dimension;
 
@@ -121,7 +121,9 @@ protected:
 
     static void setupLocations(const uint x, const uint y, const uint z, uvec3 &loc);
 
-    static vector<const Boundary*> m_currentBoundaries;
+    //! Scratch for the boundaries at the location given to setupCurrentBoundaries(),
+    //! kept per thread so that lattice setup can run in parallel.
+    static thread_local const Boundary* m_currentBoundaries[3];
 
     vector<Site*> & boundarySites()
     {
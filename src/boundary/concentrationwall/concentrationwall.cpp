@@ -21,7 +21,7 @@ ConcentrationWall::~ConcentrationWall()
 void ConcentrationWall::update()
 {
 
-    KMCDebugger_Assert(m_maxEventsPrCycle, <=, boundarySites().size(), "Max events pr cycle cannot exceed the number of boundary sites.");
+    KMCDebugger_Assert(m_shared->maxEventsPrCycle, <=, boundarySites().size(), "Max events pr cycle cannot exceed the number of boundary sites.");
 
 
     Site * currentSite;
@@ -61,7 +61,7 @@ void ConcentrationWall::update()
     std::random_shuffle(boundarySites().begin(), boundarySites().end(), [] (uint n) {return KMC_RNG_UNIFORM()*n;});
 
 
-    while (Site::getCurrentSolutionDensity() > solver()->targetSaturation() && c != boundarySites().size() && ce != m_maxEventsPrCycle)
+    while (Site::getCurrentSolutionDensity() > solver()->targetSaturation() && c != boundarySites().size() && ce != m_shared->maxEventsPrCycle)
     {
         currentSite = boundarySites().at(c);
 
@@ -74,7 +74,7 @@ void ConcentrationWall::update()
         c++; //*giggle*
     }
 
-    while (Site::getCurrentSolutionDensity() < solver()->targetSaturation() && c != boundarySites().size() && ce != m_maxEventsPrCycle)
+    while (Site::getCurrentSolutionDensity() < solver()->targetSaturation() && c != boundarySites().size() && ce != m_shared->maxEventsPrCycle)
     {
         currentSite = boundarySites().at(c);
 
@@ -110,6 +110,11 @@ void ConcentrationWall::finalize()
 
 
 
-uint ConcentrationWall::m_minDistanceFromSurface;
+ConcentrationWall::Shared::Shared() :
+    minDistanceFromSurface(0),
+    maxEventsPrCycle(3)
+{
+
+}
 
-uint ConcentrationWall::m_maxEventsPrCycle = 3;
+thread_local ConcentrationWall::Shared * ConcentrationWall::m_shared = NULL;
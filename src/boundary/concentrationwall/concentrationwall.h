@@ -14,14 +14,35 @@ public:
 
     ~ConcentrationWall();
 
+    //! The settings shared by the concentration walls of one solver. Each solver owns
+    //! one, and KMCSolver::makeCurrent() points the calling thread at it.
+    struct Shared
+    {
+        Shared();
+
+        uint minDistanceFromSurface;
+
+        uint maxEventsPrCycle;
+    };
+
+    static void setShared(Shared * shared)
+    {
+        m_shared = shared;
+    }
+
     static void setMinDistanceFromSite(const uint minDistanceFromSite)
     {
-        m_minDistanceFromSurface = minDistanceFromSite;
+        m_shared->minDistanceFromSurface = minDistanceFromSite;
     }
 
     static void setMaxEventsPrCycle(uint val)
     {
-        m_maxEventsPrCycle = val;
+        m_shared->maxEventsPrCycle = val;
+    }
+
+    static const uint & maxEventsPrCycle()
+    {
+        return m_shared->maxEventsPrCycle;
     }
 
     // Boundary interface
@@ -32,9 +53,7 @@ public:
 
 private:
 
-    static uint m_minDistanceFromSurface;
-
-    static uint m_maxEventsPrCycle;
+    static thread_local Shared * m_shared;
 
 };
 
@@ -23,6 +23,8 @@ void Surface::initialize()
 
     setupBoundarySites();
 
+    solver()->beginBulkPlacement();
+
     for (Site * boundarySite : boundarySites())
     {
         if (!boundarySite->isActive())
@@ -37,6 +39,8 @@ void Surface::initialize()
 
     }
 
+    solver()->finalizeBulkPlacement();
+
 }
 
 void Surface::finalize()
@@ -4,10 +4,6 @@
 
 #include "../debugger.h"
 
-#include "debugger_class.h"
-
-#include "intrinsicmacros.h"
-
 #include <assert.h>
 #include <sstream>
 
@@ -84,4 +80,9 @@
 #define KMCDebugger_PushTraces() \
     kMC::Debugger::pushTraces()
 
+//Included last, as site.h asserts through the macros above.
+#include "debugger_class.h"
+
+#include "intrinsicmacros.h"
+
 #endif
@@ -1,4 +1,5 @@
-#include "debugger_class.h"
+//Through the API, which declares the macros before the class pulls in site.h.
+#include "debug_api.h"
 
 #ifndef KMC_NO_DEBUG
 
@@ -14,32 +15,32 @@
 using namespace kMC;
 
 
-bool Debugger::enabled = true;
-bool Debugger::prevState = true;
+thread_local bool Debugger::enabled = true;
+thread_local bool Debugger::prevState = true;
 
-std::vector<std::string> Debugger::reactionTraceBefore;
-std::vector<std::string> Debugger::reactionTraceAfter;
-std::vector<std::string> Debugger::implicationTrace;
-std::vector<double>      Debugger::timerData;
+thread_local std::vector<std::string> Debugger::reactionTraceBefore;
+thread_local std::vector<std::string> Debugger::reactionTraceAfter;
+thread_local std::vector<std::string> Debugger::implicationTrace;
+thread_local std::vector<double>      Debugger::timerData;
 
-std::set<Site*>          Debugger::affectedUnion;
+thread_local std::vector<Site*>       Debugger::affectedUnion;
 
 
-std::string Debugger::implications;
-std::string Debugger::reactionString;
-std::string Debugger::_pre = "";
+thread_local std::string Debugger::implications;
+thread_local std::string Debugger::reactionString;
+thread_local std::string Debugger::_pre = "";
 
 
-Reaction* Debugger::currentReaction;
-Reaction* Debugger::lastCurrentReaction;
+thread_local Reaction* Debugger::currentReaction;
+thread_local Reaction* Debugger::lastCurrentReaction;
 
-uint Debugger::traceCount;
-uint Debugger::implicationCount;
+thread_local uint Debugger::traceCount;
+thread_local uint Debugger::implicationCount;
 
-std::string Debugger::traceFileName = "";
-std::string Debugger::traceFilePath = "";
+thread_local std::string Debugger::traceFileName = "";
+thread_local std::string Debugger::traceFilePath = "";
 
-wall_clock Debugger::timer;
+thread_local wall_clock Debugger::timer;
 
 
 void Debugger::setFilename(const string & filename)
@@ -191,32 +192,28 @@ std::string Debugger::setupAffectedUnion()
 
     stringstream s;
 
-    vector<Site*> intersect;
+    const vector<Site*> & affectedSites = Site::affectedSites();
 
-    bool currentSiteInPrev;
-
-    for (Site * currentSite : Site::affectedSites())
+    //A longer union belongs to a list that has since been cleared.
+    if (affectedUnion.size() > affectedSites.size())
     {
+        affectedUnion.clear();
+    }
 
-        currentSiteInPrev = false;
-        for (Site * previousSite : affectedUnion)
-        {
-            if (currentSite == previousSite)
-            {
-                currentSiteInPrev = true;
-                break;
-            }
-        }
+    //Sites are affected in order, so the new ones follow those already in the union.
+    uint nNew = affectedSites.size() - affectedUnion.size();
 
-        if (!currentSiteInPrev)
-        {
-            intersect.push_back(currentSite);
-        }
+    if (nNew == 0)
+    {
+        return "";
     }
 
     int X, Y, Z;
-    for (Site * site : intersect)
+    for (uint i = affectedUnion.size(); i < affectedSites.size(); ++i)
     {
+
+        Site * site = affectedSites.at(i);
+
         s << "   -" << site->str();
 
         if (currentReaction != NULL)
@@ -227,16 +224,10 @@ std::string Debugger::setupAffectedUnion()
 
         s << "\n";
 
-        affectedUnion.insert(site);
-    }
-
-    if (intersect.size() == 0)
-    {
-        return "";
+        affectedUnion.push_back(site);
     }
 
-    s << "Total: " << intersect.size() << endl;
-    intersect.clear();
+    s << "Total: " << nNew << endl;
 
     KMCDebugger_Assert(affectedUnion.size(), ==, Site::affectedSites().size());
 
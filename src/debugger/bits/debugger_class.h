@@ -4,7 +4,6 @@
 
 #include <vector>
 #include <string>
-#include <set>
 #include <sys/types.h>
 
 #include <exception>
@@ -22,35 +21,37 @@ class Reaction;
 class Site;
 
 
+//! The trace is kept per thread, like the solver state.
 class Debugger
 {
 public:
 
-    static bool enabled;
-    static bool prevState;
+    static thread_local bool enabled;
+    static thread_local bool prevState;
 
-    static vector<string> reactionTraceBefore;
-    static vector<string> reactionTraceAfter;
-    static vector<string> implicationTrace;
-    static vector<double>      timerData;
-    static string implications;
+    static thread_local vector<string> reactionTraceBefore;
+    static thread_local vector<string> reactionTraceAfter;
+    static thread_local vector<string> implicationTrace;
+    static thread_local vector<double>      timerData;
+    static thread_local string implications;
 
-    static uint traceCount;
-    static uint implicationCount;
+    static thread_local uint traceCount;
+    static thread_local uint implicationCount;
 
-    static Reaction * currentReaction;
-    static Reaction * lastCurrentReaction;
+    static thread_local Reaction * currentReaction;
+    static thread_local Reaction * lastCurrentReaction;
 
-    static string reactionString;
+    static thread_local string reactionString;
 
-    static string _pre;
+    static thread_local string _pre;
 
-    static string traceFileName;
-    static string traceFilePath;
+    static thread_local string traceFileName;
+    static thread_local string traceFilePath;
 
-    static wall_clock timer;
+    static thread_local wall_clock timer;
 
-    static set<Site*> affectedUnion;
+    //! The affected sites already reported, in the order of Site::affectedSites().
+    static thread_local vector<Site*> affectedUnion;
 
     //CALLED FROM MACROS
     static void setFilename(const string &filename);
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <new>
 
 
 using namespace arma;
@@ -48,6 +49,12 @@ KMCSolver::KMCSolver(const Setting & root)
     setTargetSaturation(
                 getSurfaceSetting<double>(SystemSettings, "SaturationLevel"));
 
+    setSelectionEngine(
+                getSurfaceSetting<uint>(SolverSettings, "selectionEngine"));
+
+    setReactionStorage(
+                getSurfaceSetting<uint>(SolverSettings, "reactionStorage"));
+
 
     uvec3 boxSize;
 
@@ -64,10 +71,117 @@ KMCSolver::KMCSolver()
     onConstruct();
 }
 
+KMCSolver::KMCSolver(const KMCSolver & prototype)
+{
+
+    onConstruct();
+
+    m_reactionShared.beta = prototype.m_reactionShared.beta;
+    m_reactionShared.linearRateScale = prototype.m_reactionShared.linearRateScale;
+
+
+    const DiffusionReaction::Shared & diffusionReactionShared = prototype.m_diffusionReactionShared;
+
+    m_diffusionReactionShared.rPower = diffusionReactionShared.rPower;
+    m_diffusionReactionShared.scale = diffusionReactionShared.scale;
+    m_diffusionReactionShared.separation = diffusionReactionShared.separation;
+    m_diffusionReactionShared.tables = diffusionReactionShared.tables;
+    m_diffusionReactionShared.boltzmannFactors = diffusionReactionShared.boltzmannFactors;
+    m_diffusionReactionShared.rateCacheCapacity = diffusionReactionShared.rateCacheCapacity;
+    m_diffusionReactionShared.rateCacheEnabled = diffusionReactionShared.rateCacheEnabled;
+    m_diffusionReactionShared.batchedRates = diffusionReactionShared.batchedRates;
+
+    m_concentrationWallShared = prototype.m_concentrationWallShared;
+
+
+    const Site::Shared & siteShared = prototype.m_siteShared;
+
+    m_siteShared.nNeighborsLimit = siteShared.nNeighborsLimit;
+    m_siteShared.neighborhoodLength = siteShared.neighborhoodLength;
+    m_siteShared.nNeighborsToCrystallize = siteShared.nNeighborsToCrystallize;
+    m_siteShared.boundaryConfigs = siteShared.boundaryConfigs;
+    m_siteShared.tables = siteShared.tables;
+    m_siteShared.totalDistanceClassCounts.zeros(siteShared.totalDistanceClassCounts.n_elem);
+
+    if (siteShared.boundaries.n_elem != 0)
+    {
+        Site::setInitialBoundaries(siteShared.boundaryTypes);
+    }
+
+
+    m_nCycles = prototype.m_nCycles;
+    m_cyclesPerOutput = prototype.m_cyclesPerOutput;
+    m_targetSaturation = prototype.m_targetSaturation;
+    m_reactionStorage = prototype.m_reactionStorage;
+
+    setSelectionEngine(prototype.m_selectionEngine->type);
+
+    m_rngState = prototype.m_rngState;
+    m_initialSeed = prototype.m_initialSeed;
+
+    makeCurrent();
+
+
+    if (prototype.m_sites == NULL)
+    {
+        return;
+    }
+
+    m_NX = prototype.m_NX;
+    m_NY = prototype.m_NY;
+    m_NZ = prototype.m_NZ;
+
+    m_N = prototype.m_N;
+
+    constructSites();
+
+    introduceSiteNeighborhoods();
+
+    Site::initializeBoundaries();
+
+    initializeDiffusionReactions();
+
+
+    //The boundaries have placed their own particles.
+    beginBulkPlacement();
+
+    for (uint i = 0; i < nSites(); ++i)
+    {
+
+        const Site & original = prototype.m_sites[i];
+
+        if (!original.isActive() || m_sites[i].isActive())
+        {
+            continue;
+        }
+
+        if (original.isFixedCrystalSeed())
+        {
+            m_sites[i].spawnAsFixedCrystal();
+        }
+
+        else
+        {
+            m_sites[i].activate();
+        }
+
+    }
+
+    finalizeBulkPlacement();
+
+
+    totalTime = prototype.totalTime;
+    cycle = prototype.cycle;
+    outputCounter = prototype.outputCounter;
+
+}
+
 KMCSolver::~KMCSolver()
 {
 
-    checkRefCounter();
+    KMCSolver * previous = m_current;
+
+    makeCurrent();
 
     clearSites();
 
@@ -77,19 +191,59 @@ KMCSolver::~KMCSolver()
 
     KMCDebugger_Finalize();
 
-    refCounter--;
+    delete m_selectionEngine;
+
+    //Another solver which was current on this thread stays current.
+    if (previous != NULL && previous != this)
+    {
+        previous->makeCurrent();
+    }
+
+    else
+    {
+        clearCurrent();
+    }
 
 }
 
-void KMCSolver::checkRefCounter()
+void KMCSolver::makeCurrent()
 {
-    if (refCounter > 1)
-    {
-        cerr << "ERROR: "<< refCounter << " solver objects alive when freeing.\n";
-        cerr << "Static member variables of objects IN USE by living solver WILL BE FREED." << endl;
+    m_current = this;
 
-        exit();
-    }
+    KMC_SET_RNG_STATE(&m_rngState);
+
+    Seed::initialSeed = m_initialSeed;
+
+    SelectionEngine::setMainSolver(this);
+
+    Boundary::setMainSolver(this);
+
+    Reaction::setMainSolver(this, &m_reactionShared);
+
+    DiffusionReaction::setShared(&m_diffusionReactionShared);
+
+    ConcentrationWall::setShared(&m_concentrationWallShared);
+
+    Site::setMainSolver(this, &m_siteShared);
+}
+
+void KMCSolver::clearCurrent()
+{
+    m_current = NULL;
+
+    KMC_SET_RNG_STATE(NULL);
+
+    SelectionEngine::setMainSolver(NULL);
+
+    Boundary::setMainSolver(NULL);
+
+    Reaction::setMainSolver(NULL, NULL);
+
+    DiffusionReaction::setShared(NULL);
+
+    ConcentrationWall::setShared(NULL);
+
+    Site::setMainSolver(NULL, NULL);
 }
 
 void KMCSolver::onConstruct()
@@ -99,24 +253,39 @@ void KMCSolver::onConstruct()
     m_NY = UNSET_UINT;
     m_NZ = UNSET_UINT;
 
+    m_sites = NULL;
+
+    m_nReactionBlocks = 0;
+
+    m_reactionStorage = AllSites;
+
+    m_bulkPlacementDepth = 0;
+
     outputCounter = 0;
 
-    Boundary::setMainSolver(this);
+    m_kTot = 0;
 
-    Reaction::setMainSolver(this);
+    totalTime = 0;
+
+    cycle = 1;
 
-    Site::setMainSolver(this);
+    //Until a seed is set, the stream starts as a thread seeded with the last seed would.
+    m_initialSeed = Seed::initialSeed;
 
-    refCounter++;
+    makeCurrent();
+
+    KMC_INIT_RNG(m_initialSeed);
+
+    m_selectionEngine = NULL;
+
+    setSelectionEngine(SelectionEngine::RateTree);
 
 }
 
 void KMCSolver::mainloop()
 {
 
-    Reaction * selectedReaction;
-    uint choice;
-    double R;
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
 
     dumpXYZ();
 
@@ -128,40 +297,75 @@ void KMCSolver::mainloop()
     while(cycle <= m_nCycles)
     {
 
-        getRateVariables();
-
-        R = m_kTot*KMC_RNG_UNIFORM();
-
-        choice = getReactionChoice(R);
-
-        selectedReaction = m_allReactions.at(choice);
-        KMCDebugger_SetActiveReaction(selectedReaction);
-
-        selectedReaction->execute();
-        KMCDebugger_PushTraces();
-
+        executeNextReaction();
 
         if (cycle%m_cyclesPerOutput == 0)
         {
             dumpOutput();
             dumpXYZ();
+
+            if (m_outputHook)
+            {
+                m_outputHook();
+            }
         }
 
+        advanceClock();
 
-        totalTime += Reaction::linearRateScale()/m_kTot;
-        cycle++;
+    }
 
+}
 
-        Site::updateBoundaries();
+void KMCSolver::advance(const uint nCycles)
+{
+
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
 
+    for (uint i = 0; i < nCycles; ++i)
+    {
+        step();
     }
 
 }
 
-void KMCSolver::reset()
+void KMCSolver::step()
 {
+    executeNextReaction();
+
+    advanceClock();
+}
+
+void KMCSolver::executeNextReaction()
+{
+
+    Reaction * selectedReaction;
+    double R;
+
+    getRateVariables();
+
+    R = m_kTot*KMC_RNG_UNIFORM();
+
+    selectedReaction = getReactionChoice(R);
+    KMCDebugger_SetActiveReaction(selectedReaction);
+
+    selectedReaction->execute();
+    KMCDebugger_PushTraces();
+
+}
+
+void KMCSolver::advanceClock()
+{
+
+    totalTime += Reaction::linearRateScale()*m_selectionEngine->getTimeStep(m_kTot);
+    cycle++;
+
 
-    checkRefCounter();
+    Site::updateBoundaries();
+
+}
+
+void KMCSolver::reset()
+{
 
     KMCDebugger_Finalize();
 
@@ -178,6 +382,12 @@ void KMCSolver::reset()
         site->reset();
     });
 
+    Site::initializeCrystalNeighborCounts();
+
+    Site::initializeAllowedDirections();
+
+    m_selectionEngine->invalidate();
+
     KMCDebugger_Assert(accu(Site::totalActiveParticlesVector()), ==, 0);
 
     KMCDebugger_Assert(Site::totalDeactiveParticles(ParticleStates::solution), ==, m_NX*m_NY*m_NZ);
@@ -186,8 +396,6 @@ void KMCSolver::reset()
 
     KMCDebugger_Assert(Site::totalActiveSites(), ==, 0);
 
-    Site::setZeroTotalEnergy();
-
     Site::finalizeBoundaries();
 
     setRNGSeed(Seed::specific, Seed::initialSeed);
@@ -227,13 +435,13 @@ void KMCSolver::dumpXYZ()
             for (uint k = 0; k < m_NZ; ++k)
             {
 
-                currentSite = sites[i][j][k];
+                currentSite = getSite(i, j, k);
 
                 bool isSurface = currentSite->isSurface();
 
                 if (currentSite->isActive() || isSurface)
                 {
-                    s << "\n" << ParticleStates::shortNames.at(sites[i][j][k]->particleState()) << " " << i << " " << j << " " << k << " " << sites[i][j][k]->nNeighbors();
+                    s << "\n" << ParticleStates::shortNames.at(currentSite->particleState()) << " " << i << " " << j << " " << k << " " << currentSite->nNeighbors();
 
                     if (isSurface)
                     {
@@ -275,90 +483,55 @@ void KMCSolver::dumpOutput()
 
 void KMCSolver::forEachSiteDo(function<void (Site *)> applyFunction) const
 {
-    for (uint x = 0; x < m_NX; ++x)
-    {
-        for (uint y = 0; y < m_NY; ++y)
-        {
-            for (uint z = 0; z < m_NZ; ++z)
-            {
-                applyFunction(sites[x][y][z]);
-            }
-        }
-    }
+    forEachSiteDo<function<void (Site *)> &>(applyFunction);
 }
 
 void KMCSolver::forEachSiteDo_sendIndices(function<void (Site *, uint, uint, uint)> applyFunction) const
 {
-    for (uint x = 0; x < m_NX; ++x)
-    {
-        for (uint y = 0; y < m_NY; ++y)
-        {
-            for (uint z = 0; z < m_NZ; ++z)
-            {
-                applyFunction(sites[x][y][z], x, y, z);
-            }
-        }
-    }
+    forEachSiteDo_sendIndices<function<void (Site *, uint, uint, uint)> &>(applyFunction);
 }
 
 void KMCSolver::forEachActiveSiteDo(function<void (Site *)> applyFunction) const
 {
-    for (uint x = 0; x < m_NX; ++x)
-    {
-        for (uint y = 0; y < m_NY; ++y)
-        {
-            for (uint z = 0; z < m_NZ; ++z)
-            {
-                if (sites[x][y][z]->isActive())
-                {
-                    applyFunction(sites[x][y][z]);
-                }
-            }
-        }
-    }
+    forEachActiveSiteDo<function<void (Site *)> &>(applyFunction);
 }
 
 void KMCSolver::forEachActiveSiteDo_sendIndices(function<void (Site *, uint, uint, uint)> applyFunction) const
 {
-    for (uint x = 0; x < m_NX; ++x)
-    {
-        for (uint y = 0; y < m_NY; ++y)
-        {
-            for (uint z = 0; z < m_NZ; ++z)
-            {
-                if (sites[x][y][z]->isActive())
-                {
-                    applyFunction(sites[x][y][z], x, y, z);
-                }
-            }
-        }
-    }
+    forEachActiveSiteDo_sendIndices<function<void (Site *, uint, uint, uint)> &>(applyFunction);
 }
 
 
+
 void KMCSolver::initializeSites()
 {
 
-    sites = new Site***[m_NX];
+    constructSites();
+
+    initializeSiteNeighborhoods();
+
+}
+
+void KMCSolver::constructSites()
+{
+
+    //Sites are constructed in place in a single allocation, which keeps neighboring
+    //sites close in memory and replaces one allocation per site.
+    m_sites = static_cast<Site*>(::operator new(nSites()*sizeof(Site)));
+
+    Site * site = m_sites;
 
     for (uint x = 0; x < m_NX; ++x)
     {
-        sites[x] = new Site**[m_NY];
-
         for (uint y = 0; y < m_NY; ++y)
         {
-            sites[x][y] = new Site*[m_NZ];
-
             for (uint z = 0; z < m_NZ; ++z)
             {
-                sites[x][y][z] = new Site(x, y, z);
+                new (site++) Site(x, y, z);
             }
         }
     }
 
-
-    initializeSiteNeighborhoods();
-
 }
 
 
@@ -367,22 +540,34 @@ void KMCSolver::clearSites()
 
     KMCDebugger_SetEnabledTo(false);
 
-    for (uint i = 0; i < m_NX; ++i)
+    for (uint i = 0; i < nSites(); ++i)
     {
-        for (uint j = 0; j < m_NY; ++j)
-        {
-            for (uint k = 0; k < m_NZ; ++k)
-            {
-                delete sites[i][j][k];
-            }
+        m_sites[i].~Site();
+    }
 
-            delete [] sites[i][j];
-        }
+    ::operator delete(m_sites);
 
-        delete [] sites[i];
+    m_sites = NULL;
+
+    for (DiffusionReaction * chunk : m_reactionTable)
+    {
+        ::operator delete(chunk);
     }
 
-    delete [] sites;
+    m_reactionTable.clear();
+
+    for (ReactionFields * chunk : m_reactionFieldTable)
+    {
+        delete [] chunk;
+    }
+
+    m_reactionFieldTable.clear();
+
+    m_freeReactionBlocks.clear();
+
+    m_activeSites.clear();
+
+    m_nReactionBlocks = 0;
 
 
     KMCDebugger_Assert(accu(Site::totalActiveParticlesVector()), ==, 0);
@@ -394,11 +579,10 @@ void KMCSolver::clearSites()
     KMCDebugger_Assert(Site::totalActiveSites(), ==, 0);
 
     Site::clearAffectedSites();
-    Site::setZeroTotalEnergy();
 
     Reaction::clearAll();
 
-    m_allReactions.clear();
+    m_selectionEngine->invalidate();
 
 
     KMCDebugger_ResetEnabled();
@@ -417,6 +601,8 @@ void KMCSolver::setBoxSize_KeepSites(const uvec3 &boxSizes)
 void KMCSolver::initializeCrystal(const double relativeSeedSize)
 {
 
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
+
     if (relativeSeedSize > 1.0)
     {
         cerr << "The seed size cannot exceed the box size." << endl;
@@ -432,9 +618,11 @@ void KMCSolver::initializeCrystal(const double relativeSeedSize)
     bool noSeed = false;
     KMCDebugger_SetEnabledTo(false);
 
+    beginBulkPlacement();
+
     if (!noSeed)
     {
-        sites[m_NX/2][m_NY/2][m_NZ/2]->spawnAsFixedCrystal();
+        getSite(m_NX/2, m_NY/2, m_NZ/2)->spawnAsFixedCrystal();
         KMCDebugger_PushTraces();
     }
 
@@ -478,7 +666,7 @@ void KMCSolver::initializeCrystal(const double relativeSeedSize)
                             {
                                 if (!((i == m_NX/2 && j == m_NY/2 && k == m_NZ/2)))
                                 {
-                                    sites[i][j][k]->activate();
+                                    getSite(i, j, k)->activate();
                                     KMCDebugger_PushTraces();
                                 }
 
@@ -494,9 +682,9 @@ void KMCSolver::initializeCrystal(const double relativeSeedSize)
                 {
                     if (KMC_RNG_UNIFORM() < m_targetSaturation)
                     {
-                        if(sites[i][j][k]->isLegalToSpawn())
+                        if(getSite(i, j, k)->isLegalToSpawn())
                         {
-                            sites[i][j][k]->activate();
+                            getSite(i, j, k)->activate();
                             KMCDebugger_PushTraces();
                         }
                     }
@@ -505,6 +693,8 @@ void KMCSolver::initializeCrystal(const double relativeSeedSize)
         }
     }
 
+    finalizeBulkPlacement();
+
     KMCDebugger_ResetEnabled();
 
 }
@@ -512,6 +702,10 @@ void KMCSolver::initializeCrystal(const double relativeSeedSize)
 void KMCSolver::initializeSolutionBath()
 {
 
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
+
+    beginBulkPlacement();
+
     forEachSiteDo([this] (Site * site)
     {
         if (site->isLegalToSpawn())
@@ -522,106 +716,156 @@ void KMCSolver::initializeSolutionBath()
             }
         }
     });
-}
-
 
+    finalizeBulkPlacement();
 
+}
 
-void KMCSolver::getRateVariables()
+void KMCSolver::initializeSurfaceTeeth(const uint toothWidth, const uint toothSpacing)
 {
 
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
 
-    m_kTot = 0;
+    uint toothHeight           =   toothWidth + 1;
+    uint fullToothSize         = 2*toothWidth + 1;
+    uint toothCenterSeparation = 2*toothWidth + toothSpacing;
 
-    m_accuAllRates.clear();
+    uint toothCenterX = 0;
+    uint toothCenterY;
 
-    m_allReactions.clear();
+    uint X, Y;
 
+    beginBulkPlacement();
 
-    Site::updateAffectedSites();
+    while (toothCenterX < m_NX)
+    {
 
+        toothCenterY = 0;
 
-    forEachSiteDo([this] (Site * site)
-    {
-        site->forEachActiveReactionDo([this] (Reaction * reaction)
+        while (toothCenterY < m_NY)
         {
 
-            KMCDebugger_Assert(reaction->rate(), !=, Reaction::UNSET_RATE, "Reaction rate should not be unset at this point.", reaction->getFinalizingDebugMessage());
+            for (uint Z = 0; Z < toothHeight; ++Z)
+            {
+
+                //i, j = tooth coordinates relative to corners
+                for (uint i = Z; i < fullToothSize - Z; ++i)
+                {
 
-            m_kTot += reaction->rate();
+                    //if relative coordinates are outside of the box, we continue.
+                    if (toothCenterX + i < toothWidth)
+                    {
+                        continue;
+                    }
 
-            m_accuAllRates.push_back(m_kTot);
+                    X = toothCenterX + i - toothWidth;
 
-            m_allReactions.push_back(reaction);
+                    if (X >= m_NX)
+                    {
+                        continue;
+                    }
 
-        });
-    });
+                    for(uint j = Z; j < fullToothSize - Z; ++j)
+                    {
 
-}
+                        if (toothCenterY + j < toothWidth)
+                        {
+                            continue;
+                        }
 
+                        Y = toothCenterY + j - toothWidth;
 
-uint KMCSolver::getReactionChoice(double R)
+                        if (Y >= m_NY)
+                        {
+                            continue;
+                        }
+
+                        //Z + 1 because Z = 0 boundary is already populated with fixed crystals
+                        //from the surface boundary condition.
+                        getSite(X, Y, Z + 1)->activate();
+
+                    }
+                }
+
+            }
+
+            toothCenterY += toothCenterSeparation;
+
+        }
+
+        toothCenterX += toothCenterSeparation;
+
+    }
+
+    finalizeBulkPlacement();
+
+}
+
+void KMCSolver::finalizeBulkPlacement()
 {
 
-    KMCDebugger_Assert(m_accuAllRates.size(), !=, 0, "No active reactions.");
+    KMCDebugger_Assert(m_bulkPlacementDepth, !=, 0, "No bulk placement to finalize.");
 
-    uint imax = m_accuAllRates.size() - 1;
-    uint MAX = imax;
-    uint imin = 0;
-    uint imid = 1;
+    m_bulkPlacementDepth--;
 
-    // continue searching while imax != imin + 1
-    while (imid != imin)
+    if (isPlacingInBulk())
     {
+        return;
+    }
 
-        // calculate the midpoint for roughly equal partition
-        imid = imin + (imax - imin)/2;
+    forEachActiveSiteDo([] (Site * site)
+    {
+        site->registerFullUpdate();
+    });
 
-        //Is the upper limit above mid?
-        if (R > m_accuAllRates.at(imid))
-        {
+    m_selectionEngine->invalidate();
 
-            if (imid == MAX)
-            {
-                return MAX;
-            }
+}
 
-            //Are we just infront of the limit?
-            else if (R < m_accuAllRates.at(imid + 1))
-            {
-                //yes we were! Returning current mid + 1.
-                //If item i in accuAllrates > R, then reaction i is selected.
-                //This because there is no zero at the start of accuAllrates.
 
-                return imid + 1;
-            }
 
-            //No we're not there yet, so we search above us.
-            else
-            {
-                imin = imid + 1;
-            }
-        }
 
-        //No it's not. Starting new search below mid!
-        else
-        {
+void KMCSolver::getRateVariables()
+{
 
-            if (imid == 0)
-            {
-                return 0;
-            }
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
 
-            imax = imid;
-        }
+    Site::updateAffectedSites();
+
+    m_selectionEngine->validate();
 
+    m_kTot = m_selectionEngine->totalRate();
 
+}
+
+void KMCSolver::invalidateRates()
+{
+
+    if (m_sites == NULL)
+    {
+        return;
     }
 
-    return imid + 1;
+    forEachSiteDo([] (Site * site)
+    {
+        site->markEnergyStale();
+    });
+
+    forEachActiveSiteDo([] (Site * site)
+    {
+        site->registerFullUpdate();
+    });
+
+    m_selectionEngine->invalidate();
 
 }
 
+
+Reaction * KMCSolver::getReactionChoice(double R)
+{
+    return m_selectionEngine->getReactionChoice(R);
+}
+
 void KMCSolver::setBoxSize(const uvec3 boxSize, bool check, bool keepSystem)
 {
 
@@ -661,9 +905,86 @@ void KMCSolver::setBoxSize(const uvec3 boxSize, bool check, bool keepSystem)
 
 }
 
+void KMCSolver::setSelectionEngine(const uint type)
+{
+
+    if (m_selectionEngine != NULL)
+    {
+        if (m_selectionEngine->type == type)
+        {
+            return;
+        }
+
+        delete m_selectionEngine;
+    }
+
+    m_selectionEngine = SelectionEngine::create(type);
+
+}
+
+void KMCSolver::setReactionStorage(const uint type)
+{
+
+    if (type == m_reactionStorage)
+    {
+        return;
+    }
+
+    if (type != AllSites && type != OccupiedSites)
+    {
+        cerr << "Unknown reaction storage " << type << "." << endl;
+        KMCSolver::exit();
+    }
+
+    if (m_sites == NULL)
+    {
+        m_reactionStorage = type;
+        return;
+    }
+
+    //Active sites would be left without rates.
+    if (Site::totalActiveSites() != 0)
+    {
+        cerr << "The reaction storage can only be changed for an empty system." << endl;
+        KMCSolver::exit();
+    }
+
+    clearAllReactions();
+
+    m_reactionStorage = type;
+
+    initializeDiffusionReactions();
+
+}
+
+uint KMCSolver::allocateReactionBlock()
+{
+
+    if (!m_freeReactionBlocks.empty())
+    {
+        uint index = m_freeReactionBlocks.back();
+
+        m_freeReactionBlocks.pop_back();
+
+        return index;
+    }
+
+    if (m_nReactionBlocks%reactionBlocksPerChunk == 0)
+    {
+        m_reactionTable.push_back(static_cast<DiffusionReaction*>(::operator new(reactionBlocksPerChunk*Site::nReactionSlots*sizeof(DiffusionReaction))));
+
+        m_reactionFieldTable.push_back(new ReactionFields[reactionBlocksPerChunk]);
+    }
+
+    return m_nReactionBlocks++;
+
+}
+
 void KMCSolver::setRNGSeed(uint seedState, int defaultSeed)
 {
 
+    KMCDebugger_Assert(current(), ==, this, "The solver is not current on this thread.");
+
     seed_type prevSeed = Seed::initialSeed;
 
     seed_type seed = -1;
@@ -683,6 +1004,8 @@ void KMCSolver::setRNGSeed(uint seedState, int defaultSeed)
 
     KMC_INIT_RNG(seed);
 
+    m_initialSeed = seed;
+
 
     if (prevSeed != Seed::initialSeed)
     {
@@ -692,4 +1015,6 @@ void KMCSolver::setRNGSeed(uint seedState, int defaultSeed)
 }
 
 
-uint KMCSolver::refCounter = 0;
+thread_local KMCSolver * KMCSolver::m_current = NULL;
+
+const uint KMCSolver::reactionBlocksPerChunk;
@@ -4,10 +4,16 @@
 
 #include "site.h"
 
+#include "reactions/diffusion/diffusionreaction.h"
+
+#include "boundary/concentrationwall/concentrationwall.h"
+
 #include "debugger/debugger.h"
 
 #include "RNG/kMCRNG.h"
 
+#include "selection/selectionengine.h"
+
 #include <sys/types.h>
 #include <armadillo>
 
@@ -33,34 +39,180 @@ public:
 
     KMCSolver();
 
+    //! A solver with the settings, the box size and the occupation of the prototype. Only the
+    //! tables which follow from the settings are shared; the sites, their neighborhoods, the
+    //! boundaries and the reactions are set up anew, and the prototype's particles are then
+    //! placed on them. The prototype need not be current, but must not change meanwhile, so
+    //! several solvers can be made from it on several threads at once. The new solver
+    //! continues the prototype's random number stream from a copy, and is current on the
+    //! calling thread.
+    KMCSolver(const KMCSolver & prototype);
+
     ~KMCSolver();
 
     const static uint UNSET_UINT = (uint)ULLONG_MAX;
 
+    //! Sites, reactions, boundaries, the selection engine and the random number stream
+    //! reach the state of their solver through the calling thread. A solver is made
+    //! current on the thread that constructs it; a thread which uses it afterwards, or
+    //! which switches between solvers, must call this first. Each solver draws from a
+    //! stream of its own, so solvers sharing a thread do not disturb each other's
+    //! sequence. Solvers on separate threads run independently, but one solver must not
+    //! draw random numbers on two threads at once.
+    void makeCurrent();
+
+    static KMCSolver * current()
+    {
+        return m_current;
+    }
+
+    //! Which sites hold reactions: every site, or only those occupied by a particle.
+    enum ReactionStorage
+    {
+        AllSites,
+        OccupiedSites
+    };
+
+    //! Reaction blocks are allocated in chunks of this many, so that blocks never move.
+    const static uint reactionBlocksPerChunk = 1024;
+
 
     void mainloop();
 
+    //! Runs the given number of cycles without writing any output. Successive calls
+    //! continue the cycle count and the simulated time of the previous ones.
+    void advance(const uint nCycles);
+
+    //! Executes one reaction, advances the simulated time and the cycle count, and
+    //! updates the boundaries.
+    void step();
+
     void reset();
 
     void initializeCrystal(const double relativeSeedSize);
 
     void initializeSolutionBath();
 
+    //! Grows square pyramids of crystal, toothWidth sites out from the center and
+    //! toothSpacing sites apart at the base, on top of the surface at z = 0.
+    void initializeSurfaceTeeth(const uint toothWidth, const uint toothSpacing);
+
+    //! Until the matching finalizeBulkPlacement(), activations and deactivations keep
+    //! occupancies, neighbor counts and particle states up to date, but leave the
+    //! rates of the surrounding reactions to a single pass at the end. Calls nest.
+    void beginBulkPlacement()
+    {
+        m_bulkPlacementDepth++;
+    }
+
+    //! Flags every reaction of the active sites for a full recalculation, and has
+    //! the selection engine rebuilt. The result equals that of placing one by one.
+    void finalizeBulkPlacement();
+
+    bool isPlacingInBulk() const
+    {
+        return m_bulkPlacementDepth != 0;
+    }
+
     void initializeSiteNeighborhoods()
     {
-        forEachSiteDo([] (Site * site)
-        {
-            site->introduceNeighborhood();
-        });
+        Site::setupNeighborhoodOffsets();
+
+        introduceSiteNeighborhoods();
     }
 
     void initializeDiffusionReactions()
     {
+        //Blocks are handed out in site order, so the table does not depend on the thread count.
         forEachSiteDo([] (Site * site)
+        {
+            site->reserveDiffusionReactions();
+        });
+
+        forEachSiteDo_inParallel([] (Site * site)
         {
             site->initializeDiffusionReactions();
         });
 
+        m_selectionEngine->invalidate();
+    }
+
+    //The iteration helpers take any callable, which is inlined into the loop. The
+    //std::function overloads forward to these.
+
+    template<typename Visitor>
+    void forEachSiteDo(Visitor && visit) const
+    {
+        for (uint i = 0; i < nSites(); ++i)
+        {
+            visit(m_sites + i);
+        }
+    }
+
+    //! Splits the sites over the OpenMP threads, or runs serially without OpenMP. The
+    //! visitor must only write to the visited site, which debug builds assert in the
+    //! Site functions changing a site or its neighbors.
+    template<typename Visitor>
+    void forEachSiteDo_inParallel(Visitor && visit)
+    {
+        const uint n = nSites();
+
+#pragma omp parallel
+        {
+            makeCurrent();
+
+#pragma omp for schedule(static)
+            for (uint i = 0; i < n; ++i)
+            {
+#ifndef KMC_NO_DEBUG
+                Site::setVisitedSite(m_sites + i);
+#endif
+
+                visit(m_sites + i);
+
+#ifndef KMC_NO_DEBUG
+                Site::setVisitedSite(NULL);
+#endif
+            }
+        }
+    }
+
+    template<typename Visitor>
+    void forEachSiteDo_sendIndices(Visitor && visit) const
+    {
+
+        Site * site = m_sites;
+
+        for (uint x = 0; x < m_NX; ++x)
+        {
+            for (uint y = 0; y < m_NY; ++y)
+            {
+                for (uint z = 0; z < m_NZ; ++z)
+                {
+                    visit(site++, x, y, z);
+                }
+            }
+        }
+    }
+
+    //! Visits the active sites through the dense list, in no particular order. The
+    //! visitor must not activate or deactivate sites.
+    template<typename Visitor>
+    void forEachActiveSiteDo(Visitor && visit) const
+    {
+        for (uint i = 0; i < m_activeSites.size(); ++i)
+        {
+            visit(m_activeSites[i]);
+        }
+    }
+
+    template<typename Visitor>
+    void forEachActiveSiteDo_sendIndices(Visitor && visit) const
+    {
+        forEachActiveSiteDo([&visit] (Site * site)
+        {
+            visit(site, site->x(), site->y(), site->z());
+        });
     }
 
     void forEachSiteDo(function<void(Site * site)> applyFunction) const;
@@ -75,22 +227,99 @@ public:
 
     void getRateVariables();
 
-    uint getReactionChoice(double R);
+    //! Recomputes every energy and rate on the next update, e.g. after beta changed.
+    void invalidateRates();
+
+    Reaction * getReactionChoice(double R);
 
 
     uint nNeighbors(uint & x, uint & y, uint & z)
     {
-        return sites[x][y][z]->nNeighbors(0);
+        return getSite(x, y, z)->nNeighbors(0);
     }
 
     uint nNextNeighbors(uint & x, uint & y, uint & z)
     {
-        return sites[x][y][z]->nNeighbors(1);
+        return getSite(x, y, z)->nNeighbors(1);
     }
 
     Site* getSite(const uint i, const uint j, const uint k) const
     {
-        return sites[i][j][k];
+        return m_sites + getSiteIndex(i, j, k);
+    }
+
+    Site* getSite(const uint index) const
+    {
+        return m_sites + index;
+    }
+
+    uint getSiteIndex(const uint i, const uint j, const uint k) const
+    {
+        return (i*m_NY + j)*m_NZ + k;
+    }
+
+    uint getSiteIndex(const Site * site) const
+    {
+        return site - m_sites;
+    }
+
+    uint nSites() const
+    {
+        return m_NX*m_NY*m_NZ;
+    }
+
+    //! Appends the site to the active sites, returning its position in the list.
+    uint addActiveSite(Site * site)
+    {
+        m_activeSites.push_back(site);
+
+        return m_activeSites.size() - 1;
+    }
+
+    //! Removes the active site at the given position by moving the last active site
+    //! there. The moved site is returned, so that it may update its position.
+    Site * removeActiveSite(const uint index)
+    {
+        Site * moved = m_activeSites.back();
+
+        m_activeSites[index] = moved;
+
+        m_activeSites.pop_back();
+
+        return moved;
+    }
+
+    const vector<Site*> & activeSites() const
+    {
+        return m_activeSites;
+    }
+
+    uint allocateReactionBlock();
+
+    void releaseReactionBlock(const uint index)
+    {
+        m_freeReactionBlocks.push_back(index);
+    }
+
+    DiffusionReaction * reactionBlock(const uint index) const
+    {
+        return m_reactionTable[index/reactionBlocksPerChunk] + (index%reactionBlocksPerChunk)*Site::nReactionSlots;
+    }
+
+    //! The slot fields of the reactions in the block, see ReactionFields.
+    ReactionFields * reactionFields(const uint index) const
+    {
+        return m_reactionFieldTable[index/reactionBlocksPerChunk] + index%reactionBlocksPerChunk;
+    }
+
+    uint nReactionBlocksInUse() const
+    {
+        return m_nReactionBlocks - m_freeReactionBlocks.size();
+    }
+
+    bool reactionsFollowParticles() const
+    {
+        return m_reactionStorage == OccupiedSites;
     }
 
     const uint &NX () const
@@ -118,14 +347,14 @@ public:
         return m_N;
     }
 
-    const vector<double> & accuAllRates() const
+    const SelectionEngine * selectionEngine() const
     {
-        return m_accuAllRates;
+        return m_selectionEngine;
     }
 
-    const vector<Reaction*> & allReactions() const
+    SelectionEngine * selectionEngine()
     {
-        return m_allReactions;
+        return m_selectionEngine;
     }
 
     const double & kTot() const
@@ -133,6 +362,17 @@ public:
         return m_kTot;
     }
 
+    const double & simulatedTime() const
+    {
+        return totalTime;
+    }
+
+    //! The cycle to run next, counting from one.
+    const uint & currentCycle() const
+    {
+        return cycle;
+    }
+
     const double & targetSaturation()
     {
         return m_targetSaturation;
@@ -153,6 +393,13 @@ public:
         m_cyclesPerOutput = cyclesPerOutput;
     }
 
+    //! Called at every output of the main loop, with the reaction of the cycle executed
+    //! but the clock, the cycle count and the boundaries not yet advanced.
+    void setOutputHook(function<void ()> outputHook)
+    {
+        m_outputHook = outputHook;
+    }
+
 
     void setTargetSaturation(const double saturation)
     {
@@ -161,6 +408,10 @@ public:
 
     void setRNGSeed(uint seedState = Seed::fromTime, int defaultSeed = 0);
 
+    void setSelectionEngine(const uint type);
+
+    void setReactionStorage(const uint type);
+
 
 
     void dumpXYZ();
@@ -186,6 +437,8 @@ public:
         {
             site->clearAllReactions();
         });
+
+        m_selectionEngine->invalidate();
     }
 
 
@@ -193,7 +446,40 @@ private:
 
     double m_targetSaturation = 0.01;
 
-    Site**** sites;
+    //! All sites in one contiguous block, ordered by their linear index.
+    Site* m_sites;
+
+    //! The active sites, kept dense by swap-removal, see Site::activeSiteIndex().
+    vector<Site*> m_activeSites;
+
+    //! Chunks of reaction blocks, Site::nReactionSlots reactions each. A block is
+    //! handed to a site when it gets reactions and recycled when it loses them.
+    vector<DiffusionReaction*> m_reactionTable;
+
+    //! The slot fields of each reaction block, chunked alongside m_reactionTable.
+    vector<ReactionFields*> m_reactionFieldTable;
+
+    vector<uint> m_freeReactionBlocks;
+
+    uint m_nReactionBlocks;
+
+    uint m_reactionStorage;
+
+    Site::Shared m_siteShared;
+
+    Reaction::Shared m_reactionShared;
+
+    DiffusionReaction::Shared m_diffusionReactionShared;
+
+    ConcentrationWall::Shared m_concentrationWallShared;
+
+    rng_state m_rngState;
+
+    seed_type m_initialSeed;
+
+    static thread_local KMCSolver * m_current;
+
+    uint m_bulkPlacementDepth;
 
     uint m_NX;
     uint m_NY;
@@ -203,9 +489,8 @@ private:
 
 
     double m_kTot;
-    vector<double> m_accuAllRates;
 
-    vector<Reaction*> m_allReactions;
+    SelectionEngine * m_selectionEngine;
 
     double totalTime;
 
@@ -216,10 +501,31 @@ private:
     uint m_cyclesPerOutput;
     uint outputCounter;
 
+    function<void ()> m_outputHook;
+
 
 
     void initializeSites();
 
+    void constructSites();
+
+    //! Introduces the sites to their neighbors through the neighborhood offsets in place.
+    void introduceSiteNeighborhoods()
+    {
+        forEachSiteDo_inParallel([] (Site * site)
+        {
+            site->introduceNeighborhood();
+        });
+
+        Site::initializeTotalDistanceClassCounts();
+
+        Site::initializeCrystalNeighborCounts();
+
+        Site::initializeAllowedDirections();
+
+        m_selectionEngine->invalidate();
+    }
+
     void clearSites();
 
     void setBoxSize_KeepSites(const uvec3 &boxSizes);
@@ -227,11 +533,15 @@ private:
 
     void dumpOutput();
 
-    void checkRefCounter();
+    void executeNextReaction();
+
+    //! Advances the simulated time and the cycle count past the executed reaction, and
+    //! updates the boundaries.
+    void advanceClock();
 
     void onConstruct();
 
-    static uint refCounter;
+    static void clearCurrent();
 
 
 };
@@ -0,0 +1,199 @@
+#include "brick.h"
+
+#include "../kmcsolver.h"
+#include "../site.h"
+#include "../reactions/reaction.h"
+#include "../reactions/diffusion/diffusionreaction.h"
+#include "../boundary/boundary.h"
+
+
+using namespace kMC;
+
+
+Brick::Brick(const Setting & root, const uvec3 & nBricks, const uvec3 & coordinates, const uint minWidth) :
+    m_nBricks(nBricks),
+    m_coordinates(coordinates)
+{
+
+    const Setting & SystemSettings = getSurfaceSetting(root, "System");
+    const Setting & SolverSettings = getSurfaceSetting(root, "Solver");
+
+
+    m_solver = new KMCSolver();
+
+    Reaction::loadConfig(getSurfaceSetting(root, "Reactions"));
+
+    DiffusionReaction::loadConfig(getSetting(root, {"Reactions", "Diffusion"}));
+
+    Site::setInitialNNeighborsToCrystallize(getSurfaceSetting<uint>(SystemSettings, "nNeighboursToCrystallize"));
+
+    Site::setInitialNNeighborsLimit(getSurfaceSetting<uint>(SystemSettings, "nNeighborsLimit"));
+
+
+    m_ghostDepth = max(Site::nNeighborsLimit() + 1, DiffusionReaction::separation());
+
+    umat boundaryTypes(3, 2);
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+
+        for (uint orientation = 0; orientation < 2; ++orientation)
+        {
+            boundaryTypes(XYZ, orientation) = getSetting(SystemSettings, {"Boundaries", "types"})[XYZ][orientation];
+        }
+
+        m_N(XYZ) = getSurfaceSetting(SystemSettings, "BoxSize")[XYZ];
+
+        m_start(XYZ) = blockStart(m_coordinates(XYZ), XYZ);
+        m_owned(XYZ) = blockStart(m_coordinates(XYZ) + 1, XYZ) - m_start(XYZ);
+
+        m_offset(XYZ) = 0;
+        m_boxSize(XYZ) = m_owned(XYZ);
+
+        if (m_nBricks(XYZ) == 1)
+        {
+            continue;
+        }
+
+        if (m_owned(XYZ) < minWidth)
+        {
+            cerr << "Bricks along dimension " << XYZ << " are " << m_owned(XYZ)
+                 << " sites wide. At least " << minWidth << " are needed." << endl;
+            KMCSolver::exit();
+        }
+
+        bool periodic = boundaryTypes(XYZ, 0) == Boundary::Periodic;
+
+        if (periodic || m_coordinates(XYZ) != 0)
+        {
+            m_offset(XYZ) = m_ghostDepth;
+            m_boxSize(XYZ) += m_ghostDepth;
+            boundaryTypes(XYZ, 0) = Boundary::Edge;
+        }
+
+        if (periodic || m_coordinates(XYZ) != m_nBricks(XYZ) - 1)
+        {
+            m_boxSize(XYZ) += m_ghostDepth;
+            boundaryTypes(XYZ, 1) = Boundary::Edge;
+        }
+
+    }
+
+    Site::setInitialBoundaries(boundaryTypes);
+
+
+    m_solver->setTargetSaturation(getSurfaceSetting<double>(SystemSettings, "SaturationLevel"));
+
+    m_solver->setSelectionEngine(getSurfaceSetting<uint>(SolverSettings, "selectionEngine"));
+
+    m_solver->setReactionStorage(getSurfaceSetting<uint>(SolverSettings, "reactionStorage"));
+
+    m_solver->setBoxSize(m_boxSize);
+
+}
+
+Brick::~Brick()
+{
+    delete m_solver;
+}
+
+bool Brick::isPeriodic(const Setting & root, const uint dim)
+{
+    return (uint)getSetting(root, {"System", "Boundaries", "types"})[dim][0] == Boundary::Periodic;
+}
+
+bool Brick::owns(const Site * site) const
+{
+
+    const uint r[3] = {site->x(), site->y(), site->z()};
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+        if (r[XYZ] < m_offset(XYZ) || r[XYZ] >= m_offset(XYZ) + m_owned(XYZ))
+        {
+            return false;
+        }
+    }
+
+    return true;
+
+}
+
+uint Brick::globalIndex(const Site * site) const
+{
+
+    const uint r[3] = {site->x(), site->y(), site->z()};
+
+    uint g[3];
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+        g[XYZ] = (m_start(XYZ) + m_N(XYZ) + r[XYZ] - m_offset(XYZ))%m_N(XYZ);
+    }
+
+    return g[0] + m_N(0)*(g[1] + m_N(1)*g[2]);
+
+}
+
+Site * Brick::localSite(const uint globalIndex) const
+{
+
+    const uint g[3] = {globalIndex%m_N(0),
+                       (globalIndex/m_N(0))%m_N(1),
+                       globalIndex/(m_N(0)*m_N(1))};
+
+    uint r[3];
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+
+        r[XYZ] = (g[XYZ] + m_N(XYZ) - m_start(XYZ))%m_N(XYZ) + m_offset(XYZ);
+
+        //Sites of the near ghost layer come out one period too far.
+        if (r[XYZ] >= m_boxSize(XYZ) && r[XYZ] >= m_N(XYZ))
+        {
+            r[XYZ] -= m_N(XYZ);
+        }
+
+        if (r[XYZ] >= m_boxSize(XYZ))
+        {
+            return NULL;
+        }
+
+    }
+
+    return m_solver->getSite(r[0], r[1], r[2]);
+
+}
+
+uvec3 Brick::ownerOf(const uint globalIndex) const
+{
+
+    const uint g[3] = {globalIndex%m_N(0),
+                       (globalIndex/m_N(0))%m_N(1),
+                       globalIndex/(m_N(0)*m_N(1))};
+
+    uvec3 owner;
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+
+        uint c = g[XYZ]*m_nBricks(XYZ)/m_N(XYZ);
+
+        while (blockStart(c, XYZ) > g[XYZ])
+        {
+            c--;
+        }
+
+        while (c + 1 < m_nBricks(XYZ) && blockStart(c + 1, XYZ) <= g[XYZ])
+        {
+            c++;
+        }
+
+        owner(XYZ) = c;
+
+    }
+
+    return owner;
+
+}
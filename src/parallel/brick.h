@@ -0,0 +1,122 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <armadillo>
+
+using namespace arma;
+using namespace std;
+using namespace libconfig;
+
+
+namespace kMC
+{
+
+class KMCSolver;
+class Site;
+
+//! One brick of a lattice split into a grid of bricks, held in a solver of its own. The
+//! brick is padded with ghost layers nNeighborsLimit + 1 deep (or as deep as the diffusion
+//! separation, if that is larger) on the faces it shares with other bricks; periodic
+//! boundaries of the full system wrap the grid, the other boundary types are kept on the
+//! physical faces, and faces of the padded box behave as edges. Sites are addressed across
+//! bricks by their global index x + NX*(y + NY*z).
+class Brick
+{
+public:
+
+    //! Reads the system from the same settings as KMCSolver. The new solver is made current,
+    //! and is left to the caller to seed and populate.
+    Brick(const Setting & root, const uvec3 & nBricks, const uvec3 & coordinates, const uint minWidth);
+
+    ~Brick();
+
+
+    static bool isPeriodic(const Setting & root, const uint dim);
+
+
+    bool owns(const Site * site) const;
+
+    uint globalIndex(const Site * site) const;
+
+    //! The site with the global index in this brick's padded box, or NULL.
+    Site * localSite(const uint globalIndex) const;
+
+    //! The grid position of the brick owning the site with the global index.
+    uvec3 ownerOf(const uint globalIndex) const;
+
+
+    KMCSolver * solver() const
+    {
+        return m_solver;
+    }
+
+    const uvec3 & N() const
+    {
+        return m_N;
+    }
+
+    const uvec3 & nBricks() const
+    {
+        return m_nBricks;
+    }
+
+    const uvec3 & coordinates() const
+    {
+        return m_coordinates;
+    }
+
+    //! The global coordinates of the first owned site.
+    const uvec3 & start() const
+    {
+        return m_start;
+    }
+
+    //! The number of owned sites along each dimension.
+    const uvec3 & owned() const
+    {
+        return m_owned;
+    }
+
+    //! The local coordinates of the first owned site: the depth of the near ghost layer.
+    const uvec3 & offset() const
+    {
+        return m_offset;
+    }
+
+    const uint & ghostDepth() const
+    {
+        return m_ghostDepth;
+    }
+
+private:
+
+    KMCSolver * m_solver;
+
+    uvec3 m_N;
+
+    uvec3 m_nBricks;
+
+    uvec3 m_coordinates;
+
+    uvec3 m_start;
+
+    uvec3 m_owned;
+
+    uvec3 m_offset;
+
+    uvec3 m_boxSize;
+
+    uint m_ghostDepth;
+
+
+    uint blockStart(const uint c, const uint dim) const
+    {
+        return c*m_N(dim)/m_nBricks(dim);
+    }
+
+};
+
+}
@@ -0,0 +1,557 @@
+#include "distributedengine.h"
+
+#include "../brick.h"
+
+#include "../../kmcsolver.h"
+#include "../../site.h"
+#include "../../reactions/reaction.h"
+#include "../../reactions/diffusion/diffusionreaction.h"
+#include "../../boundary/boundary.h"
+#include "../../selection/ratetree/ratetree.h"
+
+#include "../../debugger/debugger.h"
+
+#include <cmath>
+#include <ctime>
+
+
+using namespace kMC;
+
+
+DistributedEngine::DistributedEngine(const Setting & root, MPI_Comm comm) :
+    m_time(0),
+    m_nEvents(0),
+    m_work(0),
+    m_span(0)
+{
+
+    const Setting & SolverSettings = getSurfaceSetting(root, "Solver");
+    const Setting & distributedSettings = getSurfaceSetting(root, "Distributed");
+
+    m_window = getSurfaceSetting<double>(distributedSettings, "window");
+
+
+    int dims[3];
+    int periods[3];
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+        dims[XYZ] = getSurfaceSetting(distributedSettings, "ranks")[XYZ];
+
+        periods[XYZ] = Brick::isPeriodic(root, XYZ);
+    }
+
+    MPI_Comm_size(comm, &m_nProcs);
+
+    MPI_Dims_create(m_nProcs, 3, dims);
+
+    MPI_Cart_create(comm, 3, dims, periods, 0, &m_comm);
+
+    MPI_Comm_rank(m_comm, &m_rank);
+
+    int coordinates[3];
+
+    MPI_Cart_coords(m_comm, m_rank, 3, coordinates);
+
+
+    const uint separation = getSetting<uint>(root, {"Reactions", "Diffusion", "separation"});
+    const uint ghostDepth = max(getSetting<uint>(root, {"System", "nNeighborsLimit"}) + 1, separation);
+
+    //Each half is wider than the update stencil plus the separation.
+    const uint minHalfWidth = max(ghostDepth + separation + 1, 2*separation + 1);
+
+    m_brick = new Brick(root,
+                        {(uint)dims[0], (uint)dims[1], (uint)dims[2]},
+                        {(uint)coordinates[0], (uint)coordinates[1], (uint)coordinates[2]},
+                        2*minHalfWidth);
+
+
+    //Every rank draws from a stream of its own.
+    int seed;
+
+    if (getSurfaceSetting<uint>(SolverSettings, "seedType") == Seed::specific)
+    {
+        seed = getSurfaceSetting<int>(SolverSettings, "specificSeed");
+    }
+
+    else
+    {
+        seed = time(NULL);
+
+        MPI_Bcast(&seed, 1, MPI_INT, 0, m_comm);
+    }
+
+    solver()->setRNGSeed(Seed::specific, seed + m_rank);
+
+
+    const uvec3 & nRanks = m_brick->nBricks();
+
+    uint nColors = 1;
+
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+        if (nRanks(XYZ) > 1)
+        {
+            nColors *= 2;
+        }
+    }
+
+    m_halves.resize(nColors);
+
+    //Each half is a box of its own in the rate tree, so its rate and a choice within it
+    //cost O(log N), with its index as its color.
+    vector<uvec3> starts(nColors);
+    vector<uvec3> sizes(nColors);
+
+    for (uint color = 0; color < nColors; ++color)
+    {
+
+        uint bit = 1;
+
+        for (uint XYZ = 0; XYZ < 3; ++XYZ)
+        {
+
+            const uint & offset = m_brick->offset()(XYZ);
+            const uint & owned = m_brick->owned()(XYZ);
+
+            starts.at(color)(XYZ) = offset;
+            sizes.at(color)(XYZ) = owned;
+
+            if (nRanks(XYZ) > 1)
+            {
+                if (color & bit)
+                {
+                    starts.at(color)(XYZ) += owned/2;
+                    sizes.at(color)(XYZ) -= owned/2;
+                }
+
+                else
+                {
+                    sizes.at(color)(XYZ) = owned/2;
+                }
+
+                bit *= 2;
+            }
+
+        }
+
+    }
+
+    solver()->setSelectionEngine(SelectionEngine::RateTree);
+
+    rateTree()->setRegions(starts, sizes);
+
+    solver()->forEachSiteDo_sendIndices([this, &nRanks] (Site * site, uint x, uint y, uint z)
+    {
+
+        if (!m_brick->owns(site))
+        {
+            return;
+        }
+
+        const uint r[3] = {x, y, z};
+
+        uint color = 0;
+        uint bit = 1;
+
+        for (uint XYZ = 0; XYZ < 3; ++XYZ)
+        {
+            if (nRanks(XYZ) > 1)
+            {
+                if (r[XYZ] - m_brick->offset()(XYZ) >= m_brick->owned()(XYZ)/2)
+                {
+                    color += bit;
+                }
+
+                bit *= 2;
+            }
+        }
+
+        m_halves.at(color).push_back(site);
+
+    });
+
+    setupHalos();
+
+}
+
+DistributedEngine::~DistributedEngine()
+{
+
+    delete m_brick;
+
+    MPI_Comm_free(&m_comm);
+
+}
+
+void DistributedEngine::advance(const uint nWindows)
+{
+
+    vector<int> order(m_halves.size());
+
+    solver()->getRateVariables();
+
+    for (uint window = 0; window < nWindows; ++window)
+    {
+
+        //The halves must run in the same order on every rank.
+        if (m_rank == 0)
+        {
+            for (uint i = 0; i < order.size(); ++i)
+            {
+                order.at(i) = i;
+            }
+
+            for (uint i = order.size() - 1; i > 0; --i)
+            {
+                swap(order.at(i), order.at((uint)(KMC_RNG_UNIFORM()*(i + 1))));
+            }
+        }
+
+        MPI_Bcast(order.data(), order.size(), MPI_INT, 0, m_comm);
+
+        for (const int & color : order)
+        {
+            runPhase(color);
+
+            exchangeMigrations();
+
+            synchronize();
+        }
+
+        m_time += m_window;
+
+        Site::updateBoundaries();
+
+        solver()->getRateVariables();
+
+    }
+
+}
+
+void DistributedEngine::synchronize()
+{
+
+    map<int, vector<unsigned char>> received;
+
+    exchangeHalos(received);
+
+    for (const int & neighbor : m_neighbors)
+    {
+
+        const vector<Site*> & ghosts = m_ghostSites.at(neighbor);
+        const vector<unsigned char> & states = received.at(neighbor);
+
+        for (uint i = 0; i < ghosts.size(); ++i)
+        {
+
+            if (ghosts.at(i)->isActive() == (bool)states.at(i))
+            {
+                continue;
+            }
+
+            if (states.at(i))
+            {
+                ghosts.at(i)->activate();
+            }
+
+            else
+            {
+                ghosts.at(i)->deactivate();
+            }
+
+        }
+    }
+
+    solver()->getRateVariables();
+
+}
+
+uint DistributedEngine::countGhostMismatches()
+{
+
+    map<int, vector<unsigned char>> received;
+
+    exchangeHalos(received);
+
+    uint nMismatches = 0;
+
+    for (const int & neighbor : m_neighbors)
+    {
+
+        const vector<Site*> & ghosts = m_ghostSites.at(neighbor);
+
+        for (uint i = 0; i < ghosts.size(); ++i)
+        {
+            if (ghosts.at(i)->isActive() != (bool)received.at(neighbor).at(i))
+            {
+                nMismatches++;
+            }
+        }
+    }
+
+    uint nTotal;
+
+    MPI_Allreduce(&nMismatches, &nTotal, 1, MPI_UNSIGNED, MPI_SUM, m_comm);
+
+    return nTotal;
+
+}
+
+uint DistributedEngine::nParticles() const
+{
+
+    uint nOwned = 0;
+
+    for (const vector<Site*> & half : m_halves)
+    {
+        for (const Site * site : half)
+        {
+            nOwned += site->isActive();
+        }
+    }
+
+    uint nTotal;
+
+    MPI_Allreduce(&nOwned, &nTotal, 1, MPI_UNSIGNED, MPI_SUM, m_comm);
+
+    return nTotal;
+
+}
+
+double DistributedEngine::parallelEfficiency() const
+{
+
+    if (m_span == 0)
+    {
+        return 1;
+    }
+
+    return m_work/m_span;
+
+}
+
+KMCSolver * DistributedEngine::solver() const
+{
+    return m_brick->solver();
+}
+
+RateTree * DistributedEngine::rateTree() const
+{
+    return static_cast<RateTree*>(solver()->selectionEngine());
+}
+
+const uvec3 & DistributedEngine::rankGrid() const
+{
+    return m_brick->nBricks();
+}
+
+void DistributedEngine::setupHalos()
+{
+
+    map<int, vector<uint>> requests;
+
+    solver()->forEachSiteDo([&] (Site * site)
+    {
+
+        if (m_brick->owns(site))
+        {
+            return;
+        }
+
+        uint index = m_brick->globalIndex(site);
+        int owner = ownerOf(index);
+
+        m_ghostSites[owner].push_back(site);
+        requests[owner].push_back(index);
+
+    });
+
+    //A rank keeps ghosts of its neighbors exactly when they keep ghosts of it.
+    for (const auto & ghosts : m_ghostSites)
+    {
+        m_neighbors.push_back(ghosts.first);
+    }
+
+    map<int, vector<uint>> requested;
+
+    exchange(requests, requested, MPI_UNSIGNED);
+
+    for (const int & neighbor : m_neighbors)
+    {
+        for (const uint & index : requested.at(neighbor))
+        {
+            m_haloSites[neighbor].push_back(m_brick->localSite(index));
+        }
+    }
+
+}
+
+void DistributedEngine::runPhase(const uint color)
+{
+
+    uint nEvents = 0;
+
+    double t = 0;
+    double R;
+
+    DiffusionReaction * reaction;
+
+    while (true)
+    {
+
+        R = rateTree()->regionTotal(color);
+
+        if (R == 0)
+        {
+            break;
+        }
+
+        t -= Reaction::linearRateScale()*log(KMC_RNG_UNIFORM())/R;
+
+        if (t > m_window)
+        {
+            break;
+        }
+
+        reaction = static_cast<DiffusionReaction*>(rateTree()->getRegionReactionChoice(color, R*KMC_RNG_UNIFORM()));
+
+        const Site * destination = reaction->destinationSite();
+
+        if (!m_brick->owns(destination))
+        {
+            uint index = m_brick->globalIndex(destination);
+
+            m_migrations[ownerOf(index)].push_back(index);
+        }
+
+        KMCDebugger_SetActiveReaction(reaction);
+
+        reaction->execute();
+        KMCDebugger_PushTraces();
+
+        solver()->getRateVariables();
+
+        nEvents++;
+
+    }
+
+    m_nEvents += nEvents;
+
+
+    uint nEventsTotal;
+    uint nEventsMax;
+
+    MPI_Allreduce(&nEvents, &nEventsTotal, 1, MPI_UNSIGNED, MPI_SUM, m_comm);
+    MPI_Allreduce(&nEvents, &nEventsMax, 1, MPI_UNSIGNED, MPI_MAX, m_comm);
+
+    m_work += nEventsTotal;
+    m_span += (double)nEventsMax*m_nProcs;
+
+}
+
+void DistributedEngine::exchangeMigrations()
+{
+
+    map<int, vector<uint>> arrivals;
+
+    exchange(m_migrations, arrivals, MPI_UNSIGNED);
+
+    m_migrations.clear();
+
+    for (const auto & arrived : arrivals)
+    {
+        for (const uint & index : arrived.second)
+        {
+            Site * site = m_brick->localSite(index);
+
+            if (!site->isActive())
+            {
+                site->activate();
+            }
+        }
+    }
+
+}
+
+void DistributedEngine::exchangeHalos(map<int, vector<unsigned char>> & received)
+{
+
+    map<int, vector<unsigned char>> states;
+
+    for (const int & neighbor : m_neighbors)
+    {
+
+        vector<unsigned char> & out = states[neighbor];
+
+        for (const Site * site : m_haloSites.at(neighbor))
+        {
+            out.push_back(site->isActive());
+        }
+
+    }
+
+    exchange(states, received, MPI_UNSIGNED_CHAR);
+
+}
+
+template<typename T>
+void DistributedEngine::exchange(const map<int, vector<T>> & outgoing, map<int, vector<T>> & incoming, MPI_Datatype type)
+{
+
+    const uint n = m_neighbors.size();
+
+    const vector<T> none;
+
+    vector<uint> sendCounts(n);
+    vector<uint> receiveCounts(n);
+
+    vector<MPI_Request> requests(2*n);
+
+    for (uint i = 0; i < n; ++i)
+    {
+        const int & neighbor = m_neighbors.at(i);
+
+        sendCounts.at(i) = outgoing.count(neighbor) == 0 ? 0 : outgoing.at(neighbor).size();
+
+        MPI_Irecv(&receiveCounts.at(i), 1, MPI_UNSIGNED, neighbor, 0, m_comm, &requests.at(i));
+        MPI_Isend(&sendCounts.at(i), 1, MPI_UNSIGNED, neighbor, 0, m_comm, &requests.at(n + i));
+    }
+
+    MPI_Waitall(2*n, requests.data(), MPI_STATUSES_IGNORE);
+
+
+    incoming.clear();
+
+    for (uint i = 0; i < n; ++i)
+    {
+        const int & neighbor = m_neighbors.at(i);
+
+        vector<T> & in = incoming[neighbor];
+
+        in.resize(receiveCounts.at(i));
+
+        const vector<T> & out = outgoing.count(neighbor) == 0 ? none : outgoing.at(neighbor);
+
+        MPI_Irecv(in.data(), in.size(), type, neighbor, 1, m_comm, &requests.at(i));
+        MPI_Isend(const_cast<T*>(out.data()), out.size(), type, neighbor, 1, m_comm, &requests.at(n + i));
+    }
+
+    MPI_Waitall(2*n, requests.data(), MPI_STATUSES_IGNORE);
+
+}
+
+int DistributedEngine::ownerOf(const uint globalIndex) const
+{
+
+    const uvec3 owner = m_brick->ownerOf(globalIndex);
+
+    int coordinates[3] = {(int)owner(0), (int)owner(1), (int)owner(2)};
+
+    int rank;
+
+    MPI_Cart_rank(m_comm, coordinates, &rank);
+
+    return rank;
+
+}
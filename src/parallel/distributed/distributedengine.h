@@ -0,0 +1,147 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+#include <map>
+
+#include <mpi.h>
+
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <armadillo>
+
+using namespace arma;
+using namespace std;
+using namespace libconfig;
+
+
+namespace kMC
+{
+
+class KMCSolver;
+class Site;
+class Brick;
+class RateTree;
+
+//! Synchronous sublattice kMC across MPI ranks. The lattice is split into a Cartesian grid
+//! of bricks, one per rank, with periodic boundaries of the full system wrapping the rank
+//! grid. Each rank holds its brick with ghost layers in a solver of its own, see Brick.
+//!
+//! Each brick is split in two along every decomposed dimension, and a window runs these
+//! halves in the same order on every rank for the window time each, selecting within the
+//! active half from its own box of a rate tree over the owned sites. The halves are wider
+//! than the update stencil plus the diffusion separation, so ranks running the same half
+//! cannot influence each other within a phase. After a phase, particles which moved into a
+//! ghost layer are handed to the rank owning the site, and the ghost layers are refreshed
+//! from their owners.
+class DistributedEngine
+{
+public:
+
+    //! Reads the system from the same settings as KMCSolver, and the rank grid and the
+    //! window time from the "Distributed" group. Zero ranks along a dimension lets MPI choose.
+    DistributedEngine(const Setting & root, MPI_Comm comm = MPI_COMM_WORLD);
+
+    ~DistributedEngine();
+
+
+    void advance(const uint nWindows);
+
+    //! Refreshes the ghost layers from their owners, e.g. after every rank initialized its
+    //! own solver.
+    void synchronize();
+
+    //! Ghost sites, summed over all ranks, whose occupation differs from their owner's.
+    uint countGhostMismatches();
+
+
+    //! Particles on owned sites, summed over all ranks.
+    uint nParticles() const;
+
+    //! Events over the events the slowest rank of each phase would allow.
+    double parallelEfficiency() const;
+
+
+    KMCSolver * solver() const;
+
+    //! This rank's brick of the lattice.
+    Brick * brick() const
+    {
+        return m_brick;
+    }
+
+    const double & simulatedTime() const
+    {
+        return m_time;
+    }
+
+    const uint & nEvents() const
+    {
+        return m_nEvents;
+    }
+
+    const int & rank() const
+    {
+        return m_rank;
+    }
+
+    const uvec3 & rankGrid() const;
+
+private:
+
+    MPI_Comm m_comm;
+
+    int m_rank;
+
+    int m_nProcs;
+
+
+    Brick * m_brick;
+
+    double m_window;
+
+    double m_time;
+
+
+    //! The owned sites of each half, indexed by the halves' binary color.
+    vector<vector<Site*>> m_halves;
+
+    vector<int> m_neighbors;
+
+    //! The ghost sites owned by each neighbor, and the owned sites each neighbor keeps
+    //! ghosts of, in the order the two ranks agree on.
+    map<int, vector<Site*>> m_ghostSites;
+
+    map<int, vector<Site*>> m_haloSites;
+
+    //! Global indices of ghost sites particles moved to during the current phase.
+    map<int, vector<uint>> m_migrations;
+
+
+    uint m_nEvents;
+
+    double m_work;
+
+    double m_span;
+
+
+    RateTree * rateTree() const;
+
+    void setupHalos();
+
+    void runPhase(const uint color);
+
+    void exchangeMigrations();
+
+    void exchangeHalos(map<int, vector<unsigned char>> & received);
+
+    template<typename T>
+    void exchange(const map<int, vector<T>> & outgoing, map<int, vector<T>> & incoming, MPI_Datatype type);
+
+
+    int ownerOf(const uint globalIndex) const;
+
+};
+
+}
@@ -0,0 +1,722 @@
+#include "sublatticeengine.h"
+
+#include "../brick.h"
+
+#include "../../kmcsolver.h"
+#include "../../site.h"
+#include "../../reactions/diffusion/diffusionreaction.h"
+#include "../../selection/ratetree/ratetree.h"
+
+#include "../../debugger/debugger.h"
+
+#include <cmath>
+#include <climits>
+#include <limits>
+#include <algorithm>
+
+
+using namespace kMC;
+
+
+SublatticeEngine::SublatticeEngine(const Setting & root, const double window) :
+    m_window(window),
+    m_time(0),
+    m_nEvents(0),
+    m_nBoundaryEvents(0),
+    m_nRejectedEvents(0),
+    m_work(0),
+    m_span(0)
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+
+    const uint nNeighborsLimit = getSetting<uint>(root, {"System", "nNeighborsLimit"});
+    const uint separation = getSetting<uint>(root, {"Reactions", "Diffusion", "separation"});
+
+    const uint ghostDepth = max(nNeighborsLimit + 1, separation);
+    const uint minWidth = nNeighborsLimit + separation + 1;
+
+    m_stencilRange = nNeighborsLimit + 1;
+
+    for (uint dim = 0; dim < 3; ++dim)
+    {
+
+        m_N(dim) = getSetting(root, {"System", "BoxSize"})[dim];
+        m_periodic[dim] = Brick::isPeriodic(root, dim);
+
+        uint n = m_N(dim)/minWidth;
+
+        //An even number of domains keeps the colors alternating across periodic boundaries.
+        if (n >= 2)
+        {
+            n -= n%2;
+        }
+
+        else
+        {
+            n = 1;
+        }
+
+        //Two domains along a periodic dimension are padded on both faces, which would wrap
+        //the padded box onto itself unless each of them is at least two ghost layers wide.
+        if (n == 2 && m_periodic[dim] && m_N(dim)/2 < 2*ghostDepth)
+        {
+            n = 1;
+        }
+
+        m_nDomains(dim) = n;
+        m_domainWidths(dim) = m_N(dim)/n;
+
+    }
+
+    m_domains.resize(m_nDomains(0)*m_nDomains(1)*m_nDomains(2));
+
+    //Each domain solver draws from a stream of its own, seeded from the caller's stream, so
+    //the outcome does not depend on which thread runs which domain.
+    vector<int> seeds(m_domains.size());
+
+    for (int & seed : seeds)
+    {
+        seed = 1 + (int)(KMC_RNG_UNIFORM()*(INT_MAX - 1));
+    }
+
+    for (uint i = 0; i < m_domains.size(); ++i)
+    {
+
+        Domain & domain = m_domains.at(i);
+
+        domain.brick = new Brick(root,
+                                 m_nDomains,
+                                 {i%m_nDomains(0), (i/m_nDomains(0))%m_nDomains(1), i/(m_nDomains(0)*m_nDomains(1))},
+                                 minWidth);
+
+        KMCSolver * solver = domain.brick->solver();
+
+        solver->makeCurrent();
+        solver->setRNGSeed(Seed::specific, seeds.at(i));
+
+        //Reactions are only selected on owned sites.
+        solver->setSelectionEngine(SelectionEngine::RateTree);
+
+        static_cast<RateTree*>(solver->selectionEngine())->setRegions({domain.brick->offset()},
+                                                                      {domain.brick->owned()});
+
+        domain.clock = 0;
+        domain.nProcessed = 0;
+
+    }
+
+
+    vector<vector<uint>> colors(8);
+
+    for (uint dz = 0; dz < m_nDomains(2); ++dz)
+    {
+        for (uint dy = 0; dy < m_nDomains(1); ++dy)
+        {
+            for (uint dx = 0; dx < m_nDomains(0); ++dx)
+            {
+                colors.at(dx%2 + 2*(dy%2) + 4*(dz%2)).push_back(dx + m_nDomains(0)*(dy + m_nDomains(1)*dz));
+            }
+        }
+    }
+
+    for (vector<uint> & color : colors)
+    {
+        if (!color.empty())
+        {
+            m_colors.push_back(color);
+        }
+    }
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+SublatticeEngine::~SublatticeEngine()
+{
+
+    for (Domain & domain : m_domains)
+    {
+        delete domain.brick;
+    }
+
+}
+
+void SublatticeEngine::initializeSolutionBath()
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+    for (Domain & domain : m_domains)
+    {
+        domain.brick->solver()->makeCurrent();
+
+        domain.brick->solver()->initializeSolutionBath();
+    }
+
+    synchronize();
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+void SublatticeEngine::synchronize()
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+    for (uint i = 0; i < m_domains.size(); ++i)
+    {
+
+        const Brick * brick = m_domains.at(i).brick;
+
+        brick->solver()->makeCurrent();
+
+        brick->solver()->forEachSiteDo([&] (Site * site)
+        {
+
+            if (brick->owns(site))
+            {
+                return;
+            }
+
+            const Brick * owner = m_domains.at(ownerOf(i, site)).brick;
+
+            setState(site, owner->localSite(brick->globalIndex(site))->isActive());
+
+        });
+
+        brick->solver()->getRateVariables();
+
+    }
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+void SublatticeEngine::advance(const uint nWindows)
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+    vector<uint> order(m_colors.size());
+
+    for (uint window = 0; window < nWindows; ++window)
+    {
+
+        if (caller != NULL)
+        {
+            caller->makeCurrent();
+        }
+
+        for (uint i = 0; i < order.size(); ++i)
+        {
+            order.at(i) = i;
+        }
+
+        for (uint i = order.size() - 1; i > 0; --i)
+        {
+            swap(order.at(i), order.at((uint)(KMC_RNG_UNIFORM()*(i + 1))));
+        }
+
+        for (const uint & color : order)
+        {
+            runPhase(color);
+        }
+
+        m_time += m_window;
+
+    }
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+uint SublatticeEngine::countGhostMismatches() const
+{
+
+    uint nMismatches = 0;
+
+    for (uint i = 0; i < m_domains.size(); ++i)
+    {
+
+        const Brick * brick = m_domains.at(i).brick;
+
+        brick->solver()->forEachSiteDo([&] (Site * site)
+        {
+
+            if (brick->owns(site))
+            {
+                return;
+            }
+
+            const Brick * owner = m_domains.at(ownerOf(i, site)).brick;
+
+            if (owner->localSite(brick->globalIndex(site))->isActive() != site->isActive())
+            {
+                nMismatches++;
+            }
+
+        });
+
+    }
+
+    return nMismatches;
+
+}
+
+uint SublatticeEngine::nParticles() const
+{
+
+    uint nOwned = 0;
+
+    for (const Domain & domain : m_domains)
+    {
+        domain.brick->solver()->forEachSiteDo([&] (Site * site)
+        {
+            if (domain.brick->owns(site) && site->isActive())
+            {
+                nOwned++;
+            }
+        });
+    }
+
+    return nOwned;
+
+}
+
+double SublatticeEngine::parallelEfficiency() const
+{
+
+    if (m_span == 0)
+    {
+        return 1;
+    }
+
+    return m_work/m_span;
+
+}
+
+double SublatticeEngine::rejectionRate() const
+{
+
+    if (m_nBoundaryEvents == 0)
+    {
+        return 0;
+    }
+
+    return m_nRejectedEvents/(double)m_nBoundaryEvents;
+
+}
+
+KMCSolver * SublatticeEngine::solver(const uint domain) const
+{
+    return m_domains.at(domain).brick->solver();
+}
+
+Brick * SublatticeEngine::brick(const uint domain) const
+{
+    return m_domains.at(domain).brick;
+}
+
+uint SublatticeEngine::domainOf(const uint x, const uint y, const uint z) const
+{
+
+    const uvec3 owner = m_domains.front().brick->ownerOf(x + m_N(0)*(y + m_N(1)*z));
+
+    return owner(0) + m_nDomains(0)*(owner(1) + m_nDomains(1)*owner(2));
+
+}
+
+void SublatticeEngine::runPhase(const uint color)
+{
+
+    const vector<uint> & domains = m_colors.at(color);
+
+    for (const uint & domain : domains)
+    {
+        Domain & d = m_domains.at(domain);
+
+        d.clock = 0;
+        d.history.clear();
+        d.nProcessed = 0;
+    }
+
+    vector<uint> pending = domains;
+
+    while (!pending.empty())
+    {
+
+        const uint n = pending.size();
+
+#pragma omp parallel for schedule(static)
+        for (uint i = 0; i < n; ++i)
+        {
+            runDomain(pending.at(i));
+        }
+
+        vector<uint> rolledBack;
+
+        resolveConflicts(domains, rolledBack);
+
+        pending.swap(rolledBack);
+
+    }
+
+
+    uint nCommitted = 0;
+    uint nProcessedMax = 0;
+
+    for (const uint & domain : domains)
+    {
+
+        const Domain & d = m_domains.at(domain);
+
+        nCommitted += d.history.size();
+        nProcessedMax = max(nProcessedMax, d.nProcessed);
+
+        for (const Event & event : d.history)
+        {
+            if (event.boundary)
+            {
+                m_nBoundaryEvents++;
+            }
+        }
+
+    }
+
+    m_nEvents += nCommitted;
+
+    m_work += nCommitted;
+    m_span += (double)nProcessedMax*domains.size();
+
+    propagate(domains);
+
+}
+
+void SublatticeEngine::runDomain(const uint domain)
+{
+
+    Domain & d = m_domains.at(domain);
+
+    KMCSolver * solver = d.brick->solver();
+
+    solver->makeCurrent();
+
+    solver->getRateVariables();
+
+    DiffusionReaction * reaction;
+
+    while (true)
+    {
+
+        if (solver->kTot() == 0)
+        {
+            d.clock = m_window;
+            break;
+        }
+
+        const double t = d.clock - Reaction::linearRateScale()*log(KMC_RNG_UNIFORM())/solver->kTot();
+
+        if (t > m_window)
+        {
+            d.clock = m_window;
+            break;
+        }
+
+        d.clock = t;
+
+        reaction = static_cast<DiffusionReaction*>(solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM()));
+
+        const Site * origin = reaction->getReactionSite();
+        const Site * destination = reaction->destinationSite();
+
+        Event event;
+
+        event.time = t;
+        event.origin = solver->getSite(origin->x(), origin->y(), origin->z());
+        event.destination = solver->getSite(destination->x(), destination->y(), destination->z());
+        event.boundary = isBoundaryEvent(domain, origin, destination);
+
+        KMCDebugger_SetActiveReaction(reaction);
+
+        reaction->execute();
+        KMCDebugger_PushTraces();
+
+        d.history.push_back(event);
+
+        solver->getRateVariables();
+
+        d.nProcessed++;
+
+    }
+
+}
+
+void SublatticeEngine::resolveConflicts(const vector<uint> & domains, vector<uint> & rolledBack)
+{
+
+    vector<pair<double, pair<uint, uint>>> boundaryEvents;
+
+    for (const uint & domain : domains)
+    {
+
+        const vector<Event> & history = m_domains.at(domain).history;
+
+        for (uint i = 0; i < history.size(); ++i)
+        {
+            if (history.at(i).boundary)
+            {
+                boundaryEvents.push_back(make_pair(history.at(i).time, make_pair(domain, i)));
+            }
+        }
+
+    }
+
+    //Ties in time are broken by domain, so the order does not depend on the threads.
+    sort(boundaryEvents.begin(), boundaryEvents.end());
+
+
+    const double never = numeric_limits<double>::infinity();
+
+    vector<double> cut(m_domains.size(), never);
+
+    vector<pair<uint, uint>> accepted;
+
+    for (const pair<double, pair<uint, uint>> & next : boundaryEvents)
+    {
+
+        const uint & domain = next.second.first;
+
+        //Later events of a domain with a rejected event are rolled back with it.
+        if (next.first >= cut.at(domain))
+        {
+            continue;
+        }
+
+        const Event & event = m_domains.at(domain).history.at(next.second.second);
+
+        bool rejected = false;
+
+        for (const pair<uint, uint> & earlier : accepted)
+        {
+            if (earlier.first != domain &&
+                conflicts(domain, event, earlier.first, m_domains.at(earlier.first).history.at(earlier.second)))
+            {
+                rejected = true;
+                break;
+            }
+        }
+
+        if (rejected)
+        {
+            cut.at(domain) = next.first;
+
+            m_nRejectedEvents++;
+            m_nBoundaryEvents++;
+        }
+
+        else
+        {
+            accepted.push_back(next.second);
+        }
+
+    }
+
+    for (const uint & domain : domains)
+    {
+        if (cut.at(domain) != never)
+        {
+            rollback(domain, cut.at(domain));
+
+            rolledBack.push_back(domain);
+        }
+    }
+
+}
+
+void SublatticeEngine::rollback(const uint domain, const double time)
+{
+
+    Domain & d = m_domains.at(domain);
+
+    d.brick->solver()->makeCurrent();
+
+    while (!d.history.empty() && d.history.back().time >= time)
+    {
+
+        const Event & event = d.history.back();
+
+        //Reverse execution of DiffusionReaction::execute().
+        event.destination->deactivate();
+        event.origin->activate();
+
+        d.history.pop_back();
+
+    }
+
+    //The dynamics is memoryless, so the domain simply redraws its next event from here.
+    d.clock = time;
+
+}
+
+void SublatticeEngine::propagate(const vector<uint> & domains)
+{
+
+    vector<pair<uint, bool>> changes;
+
+    for (const uint & domain : domains)
+    {
+        for (const Event & event : m_domains.at(domain).history)
+        {
+            changes.push_back(make_pair(globalIndex(domain, event.origin), event.origin->isActive()));
+            changes.push_back(make_pair(globalIndex(domain, event.destination), event.destination->isActive()));
+        }
+    }
+
+    const uint n = m_domains.size();
+
+#pragma omp parallel for schedule(static)
+    for (uint i = 0; i < n; ++i)
+    {
+
+        const Brick * brick = m_domains.at(i).brick;
+
+        brick->solver()->makeCurrent();
+
+        for (const pair<uint, bool> & change : changes)
+        {
+
+            Site * site = brick->localSite(change.first);
+
+            if (site != NULL)
+            {
+                setState(site, change.second);
+            }
+
+        }
+
+        brick->solver()->getRateVariables();
+
+    }
+
+}
+
+bool SublatticeEngine::isBoundaryEvent(const uint domain, const Site * origin, const Site * destination) const
+{
+    return !m_domains.at(domain).brick->owns(destination)
+            || isNearPaddedFace(domain, origin)
+            || isNearPaddedFace(domain, destination);
+}
+
+bool SublatticeEngine::isNearPaddedFace(const uint domain, const Site * site) const
+{
+
+    const Brick * brick = m_domains.at(domain).brick;
+
+    const uint r[3] = {site->x(), site->y(), site->z()};
+
+    for (uint dim = 0; dim < 3; ++dim)
+    {
+
+        const uint & start = brick->offset()(dim);
+        const uint end = start + brick->owned()(dim);
+
+        if (start != 0 && r[dim] - start < m_stencilRange)
+        {
+            return true;
+        }
+
+        if (end != brick->solver()->N(dim) && end - 1 - r[dim] < m_stencilRange)
+        {
+            return true;
+        }
+
+    }
+
+    return false;
+
+}
+
+bool SublatticeEngine::conflicts(const uint a, const Event & x, const uint b, const Event & y) const
+{
+    return isWithinStencil(a, x.origin, b, y.origin)
+            || isWithinStencil(a, x.origin, b, y.destination)
+            || isWithinStencil(a, x.destination, b, y.origin)
+            || isWithinStencil(a, x.destination, b, y.destination);
+}
+
+bool SublatticeEngine::isWithinStencil(const uint a, const Site * site, const uint b, const Site * other) const
+{
+
+    const uint i = globalIndex(a, site);
+    const uint j = globalIndex(b, other);
+
+    return distance(i%m_N(0), j%m_N(0), 0) <= m_stencilRange &&
+           distance((i/m_N(0))%m_N(1), (j/m_N(0))%m_N(1), 1) <= m_stencilRange &&
+           distance(i/(m_N(0)*m_N(1)), j/(m_N(0)*m_N(1)), 2) <= m_stencilRange;
+
+}
+
+uint SublatticeEngine::distance(const uint a, const uint b, const uint dim) const
+{
+
+    uint d = a > b ? a - b : b - a;
+
+    if (m_periodic[dim])
+    {
+        d = min(d, m_N(dim) - d);
+    }
+
+    return d;
+
+}
+
+uint SublatticeEngine::globalIndex(const uint domain, const Site * site) const
+{
+    return m_domains.at(domain).brick->globalIndex(site);
+}
+
+uint SublatticeEngine::ownerOf(const uint domain, const Site * site) const
+{
+
+    const Brick * brick = m_domains.at(domain).brick;
+
+    const uvec3 owner = brick->ownerOf(brick->globalIndex(site));
+
+    return owner(0) + m_nDomains(0)*(owner(1) + m_nDomains(1)*owner(2));
+
+}
+
+void SublatticeEngine::setState(Site * site, const bool active)
+{
+
+    if (site->isActive() == active)
+    {
+        return;
+    }
+
+    if (active)
+    {
+        site->activate();
+    }
+
+    else
+    {
+        site->deactivate();
+    }
+
+}
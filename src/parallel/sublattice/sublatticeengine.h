@@ -0,0 +1,207 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <armadillo>
+
+using namespace arma;
+using namespace std;
+using namespace libconfig;
+
+
+namespace kMC
+{
+
+class KMCSolver;
+class Site;
+class Brick;
+
+//! Synchronous sublattice kMC (Shim and Amar). The lattice is split into a grid of domains
+//! wider than nNeighborsLimit + separation, each held as a Brick with ghost layers in a
+//! solver of its own, and colored by the parity of their grid position so that domains of
+//! one color never border each other. A window runs the colors in random order; the domains
+//! of the active color advance concurrently for the window time, each selecting among the
+//! reactions of its owned sites from a rate tree of its own.
+//!
+//! Events within the update stencil of a padded face are boundary events. After a phase,
+//! the boundary events of all its domains are taken in order of time, and one whose stencil
+//! reaches that of an earlier event of another domain is rejected: its domain is rolled back
+//! to the rejected event and runs on from there. The rule does not depend on the order the
+//! domains are run in, and as each domain draws from a stream of its own, neither does the
+//! outcome. The changes of the phase are then copied to the ghost layers of the other
+//! domains. Concentration walls are not updated.
+class SublatticeEngine
+{
+public:
+
+    //! Reads the system from the same settings as KMCSolver. The solver which was current on
+    //! the calling thread is current again when the engine returns.
+    SublatticeEngine(const Setting & root, const double window);
+
+    ~SublatticeEngine();
+
+
+    //! Fills every domain with a solution and sets the ghost layers from their owners.
+    void initializeSolutionBath();
+
+    //! Sets the ghost layers from their owners.
+    void synchronize();
+
+    void advance(const uint nWindows);
+
+
+    //! Ghost sites whose occupation differs from their owner's.
+    uint countGhostMismatches() const;
+
+    //! Particles on owned sites.
+    uint nParticles() const;
+
+    //! Committed events over the events the busiest domain of each phase would allow.
+    double parallelEfficiency() const;
+
+    //! Rejected over attempted boundary events.
+    double rejectionRate() const;
+
+
+    const double & simulatedTime() const
+    {
+        return m_time;
+    }
+
+    const double & window() const
+    {
+        return m_window;
+    }
+
+    const uvec3 & nDomains() const
+    {
+        return m_nDomains;
+    }
+
+    //! The width of the narrowest domain along each dimension.
+    const uvec3 & domainWidths() const
+    {
+        return m_domainWidths;
+    }
+
+    uint nColors() const
+    {
+        return m_colors.size();
+    }
+
+    KMCSolver * solver(const uint domain) const;
+
+    Brick * brick(const uint domain) const;
+
+    const uint & nEvents() const
+    {
+        return m_nEvents;
+    }
+
+    const uint & nBoundaryEvents() const
+    {
+        return m_nBoundaryEvents;
+    }
+
+    const uint & nRejectedEvents() const
+    {
+        return m_nRejectedEvents;
+    }
+
+    uint domainOf(const uint x, const uint y, const uint z) const;
+
+private:
+
+    //! An executed event, on the sites of its domain's solver.
+    struct Event
+    {
+        double time;
+
+        Site * origin;
+
+        Site * destination;
+
+        bool boundary;
+    };
+
+    struct Domain
+    {
+        Brick * brick;
+
+        double clock;
+
+        vector<Event> history;
+
+        uint nProcessed;
+    };
+
+
+    const double m_window;
+
+    double m_time;
+
+
+    uvec3 m_N;
+
+    bool m_periodic[3];
+
+    uvec3 m_nDomains;
+
+    uvec3 m_domainWidths;
+
+    //! Half the width of the update stencil: sites this close to a changed site get new rates.
+    uint m_stencilRange;
+
+    vector<Domain> m_domains;
+
+    //! The domains of each color.
+    vector<vector<uint>> m_colors;
+
+
+    uint m_nEvents;
+
+    uint m_nBoundaryEvents;
+
+    uint m_nRejectedEvents;
+
+    double m_work;
+
+    double m_span;
+
+
+    void runPhase(const uint color);
+
+    void runDomain(const uint domain);
+
+    //! Rejects the boundary events which conflict with earlier ones of other domains, and
+    //! rolls their domains back to them.
+    void resolveConflicts(const vector<uint> & domains, vector<uint> & rolledBack);
+
+    void rollback(const uint domain, const double time);
+
+    void propagate(const vector<uint> & domains);
+
+
+    bool isBoundaryEvent(const uint domain, const Site * origin, const Site * destination) const;
+
+    bool isNearPaddedFace(const uint domain, const Site * site) const;
+
+    bool conflicts(const uint a, const Event & x, const uint b, const Event & y) const;
+
+    bool isWithinStencil(const uint a, const Site * site, const uint b, const Site * other) const;
+
+    uint distance(const uint a, const uint b, const uint dim) const;
+
+    uint globalIndex(const uint domain, const Site * site) const;
+
+    uint ownerOf(const uint domain, const Site * site) const;
+
+    static void setState(Site * site, const bool active);
+
+};
+
+}
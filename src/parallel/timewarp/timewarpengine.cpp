@@ -0,0 +1,740 @@
+#include "timewarpengine.h"
+
+#include "../brick.h"
+
+#include "../../kmcsolver.h"
+#include "../../site.h"
+#include "../../reactions/reaction.h"
+#include "../../reactions/diffusion/diffusionreaction.h"
+#include "../../selection/selectionengine.h"
+
+#include "../../debugger/debugger.h"
+
+#include <cmath>
+#include <climits>
+#include <limits>
+
+
+using namespace kMC;
+
+
+TimeWarpEngine::TimeWarpEngine(const Setting & root, const uvec3 & nDomains, const double horizon) :
+    m_horizon(horizon),
+    m_gvt(0),
+    m_nRounds(0),
+    m_nProcessedEvents(0),
+    m_nCommittedEvents(0),
+    m_work(0),
+    m_span(0)
+{
+
+    if (getSetting<uint>(root, {"Solver", "selectionEngine"}) == SelectionEngine::NextReactionMethod)
+    {
+        cerr << "The next reaction method keeps absolute firing times, which can not be rolled back." << endl;
+        KMCSolver::exit();
+    }
+
+    KMCSolver * caller = KMCSolver::current();
+
+
+    const uint separation = getSetting<uint>(root, {"Reactions", "Diffusion", "separation"});
+    const uint ghostDepth = max(getSetting<uint>(root, {"System", "nNeighborsLimit"}) + 1, separation);
+
+    //Two domains along a periodic dimension are padded on both faces, which would wrap the
+    //padded box onto itself unless each of them is at least two ghost layers wide. With more
+    //domains, the others are wide enough as long as each is one ghost layer wide.
+    for (uint XYZ = 0; XYZ < 3; ++XYZ)
+    {
+
+        const uint N = getSetting(root, {"System", "BoxSize"})[XYZ];
+
+        if (nDomains(XYZ) == 2 && Brick::isPeriodic(root, XYZ) && N/2 < 2*ghostDepth)
+        {
+            cerr << "Two periodic domains along dimension " << XYZ << " need at least "
+                 << 4*ghostDepth << " sites." << endl;
+            KMCSolver::exit();
+        }
+
+    }
+
+    m_domains.resize(nDomains(0)*nDomains(1)*nDomains(2));
+
+    vector<mutex> inboxLocks(m_domains.size());
+
+    m_inboxLocks.swap(inboxLocks);
+
+    //Each domain solver draws from a stream of its own, seeded from the caller's stream.
+    vector<int> seeds(m_domains.size());
+
+    for (int & seed : seeds)
+    {
+        seed = 1 + (int)(KMC_RNG_UNIFORM()*(INT_MAX - 1));
+    }
+
+    for (uint i = 0; i < m_domains.size(); ++i)
+    {
+
+        Domain & domain = m_domains.at(i);
+
+        //Narrower domains would take their ghost layers from beyond their neighbors.
+        domain.brick = new Brick(root,
+                                 nDomains,
+                                 {i%nDomains(0), (i/nDomains(0))%nDomains(1), i/(nDomains(0)*nDomains(1))},
+                                 ghostDepth);
+
+        domain.brick->solver()->makeCurrent();
+        domain.brick->solver()->setRNGSeed(Seed::specific, seeds.at(i));
+
+        domain.clock = 0;
+        domain.nextId = 0;
+        domain.nProcessed = 0;
+        domain.nRolledBack = 0;
+        domain.nRollbacks = 0;
+        domain.nMessages = 0;
+        domain.nAntiMessages = 0;
+
+    }
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+TimeWarpEngine::~TimeWarpEngine()
+{
+
+    for (Domain & domain : m_domains)
+    {
+        delete domain.brick;
+    }
+
+}
+
+void TimeWarpEngine::initializeSolutionBath()
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+    for (Domain & domain : m_domains)
+    {
+        domain.brick->solver()->makeCurrent();
+
+        domain.brick->solver()->initializeSolutionBath();
+    }
+
+    synchronize();
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+void TimeWarpEngine::synchronize()
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+    for (uint i = 0; i < m_domains.size(); ++i)
+    {
+
+        const Brick * brick = m_domains.at(i).brick;
+
+        brick->solver()->makeCurrent();
+
+        brick->solver()->forEachSiteDo([&] (Site * site)
+        {
+
+            if (brick->owns(site))
+            {
+                return;
+            }
+
+            const Brick * owner = m_domains.at(ownerOf(i, site)).brick;
+
+            setState(site, owner->localSite(brick->globalIndex(site))->isActive());
+
+        });
+
+        brick->solver()->getRateVariables();
+
+    }
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+void TimeWarpEngine::advance(const double time)
+{
+
+    KMCSolver * caller = KMCSolver::current();
+
+    const uint n = m_domains.size();
+
+    const double end = m_gvt + time;
+
+    while (m_gvt < end)
+    {
+
+        const double limit = min(m_gvt + m_horizon, end);
+
+#pragma omp parallel for schedule(static)
+        for (uint i = 0; i < n; ++i)
+        {
+            runDomain(i, limit);
+        }
+
+
+        uint nProcessed = 0;
+        uint nProcessedMax = 0;
+
+        for (const Domain & domain : m_domains)
+        {
+            nProcessed += domain.nProcessed;
+            nProcessedMax = max(nProcessedMax, domain.nProcessed);
+        }
+
+        m_nProcessedEvents += nProcessed;
+
+        m_work += nProcessed;
+        m_span += (double)nProcessedMax*n;
+
+
+        deliver();
+
+        updateGVT();
+
+        collectFossils(m_gvt);
+
+        m_nRounds++;
+
+    }
+
+    if (caller != NULL)
+    {
+        caller->makeCurrent();
+    }
+
+}
+
+uint TimeWarpEngine::countGhostMismatches() const
+{
+
+    uint nMismatches = 0;
+
+    for (uint i = 0; i < m_domains.size(); ++i)
+    {
+
+        const Brick * brick = m_domains.at(i).brick;
+
+        brick->solver()->forEachSiteDo([&] (Site * site)
+        {
+
+            if (brick->owns(site))
+            {
+                return;
+            }
+
+            const Brick * owner = m_domains.at(ownerOf(i, site)).brick;
+
+            if (owner->localSite(brick->globalIndex(site))->isActive() != site->isActive())
+            {
+                nMismatches++;
+            }
+
+        });
+
+    }
+
+    return nMismatches;
+
+}
+
+uint TimeWarpEngine::nParticles() const
+{
+
+    uint nOwned = 0;
+
+    for (const Domain & domain : m_domains)
+    {
+        domain.brick->solver()->forEachSiteDo([&] (Site * site)
+        {
+            if (domain.brick->owns(site) && site->isActive())
+            {
+                nOwned++;
+            }
+        });
+    }
+
+    return nOwned;
+
+}
+
+double TimeWarpEngine::efficiency() const
+{
+
+    if (m_nProcessedEvents == 0)
+    {
+        return 1;
+    }
+
+    return m_nCommittedEvents/(double)m_nProcessedEvents;
+
+}
+
+double TimeWarpEngine::parallelEfficiency() const
+{
+
+    if (m_span == 0)
+    {
+        return 1;
+    }
+
+    return m_work/m_span;
+
+}
+
+uint TimeWarpEngine::nRolledBackEvents() const
+{
+
+    uint n = 0;
+
+    for (const Domain & domain : m_domains)
+    {
+        n += domain.nRolledBack;
+    }
+
+    return n;
+
+}
+
+uint TimeWarpEngine::nRollbacks() const
+{
+
+    uint n = 0;
+
+    for (const Domain & domain : m_domains)
+    {
+        n += domain.nRollbacks;
+    }
+
+    return n;
+
+}
+
+uint TimeWarpEngine::nMessages() const
+{
+
+    uint n = 0;
+
+    for (const Domain & domain : m_domains)
+    {
+        n += domain.nMessages;
+    }
+
+    return n;
+
+}
+
+uint TimeWarpEngine::nAntiMessages() const
+{
+
+    uint n = 0;
+
+    for (const Domain & domain : m_domains)
+    {
+        n += domain.nAntiMessages;
+    }
+
+    return n;
+
+}
+
+KMCSolver * TimeWarpEngine::solver(const uint domain) const
+{
+    return m_domains.at(domain).brick->solver();
+}
+
+void TimeWarpEngine::runDomain(const uint domain, const double limit)
+{
+
+    Domain & d = m_domains.at(domain);
+
+    KMCSolver * solver = d.brick->solver();
+
+    solver->makeCurrent();
+
+    d.nProcessed = 0;
+
+    solver->getRateVariables();
+
+    const double never = numeric_limits<double>::infinity();
+
+    DiffusionReaction * reaction;
+
+    while (true)
+    {
+
+        //Messages from domains running behind this one arrive before they are needed.
+        if (poll(domain))
+        {
+            solver->getRateVariables();
+        }
+
+        //Both draws are memoryless, so the later one is simply discarded.
+        double nextEvent = never;
+
+        if (solver->kTot() != 0)
+        {
+            nextEvent = d.clock - Reaction::linearRateScale()*log(KMC_RNG_UNIFORM())/solver->kTot();
+        }
+
+        const double nextMessage = d.pending.empty() ? never : d.pending.begin()->first;
+
+        if (min(nextEvent, nextMessage) > limit)
+        {
+            d.clock = limit;
+            break;
+        }
+
+
+        Record record;
+
+        record.origin = NULL;
+        record.destination = NULL;
+
+        if (nextMessage <= nextEvent)
+        {
+
+            record.time = nextMessage;
+            record.message = d.pending.begin()->second;
+
+            d.pending.erase(d.pending.begin());
+
+            d.clock = record.time;
+
+            apply(domain, record);
+
+            d.history.push_back(record);
+
+            solver->getRateVariables();
+
+            continue;
+
+        }
+
+        d.clock = nextEvent;
+
+        reaction = static_cast<DiffusionReaction*>(solver->getReactionChoice(solver->kTot()*KMC_RNG_UNIFORM()));
+
+        const Site * origin = reaction->getReactionSite();
+        const Site * destination = reaction->destinationSite();
+
+        if (!d.brick->owns(origin))
+        {
+            continue;
+        }
+
+        record.time = d.clock;
+        record.origin = solver->getSite(origin->x(), origin->y(), origin->z());
+        record.destination = solver->getSite(destination->x(), destination->y(), destination->z());
+        record.applied = true;
+
+        KMCDebugger_SetActiveReaction(reaction);
+
+        reaction->execute();
+        KMCDebugger_PushTraces();
+
+        send(domain, origin, d.clock, record.sent);
+        send(domain, destination, d.clock, record.sent);
+
+        d.history.push_back(record);
+
+        solver->getRateVariables();
+
+        d.nProcessed++;
+
+    }
+
+}
+
+void TimeWarpEngine::send(const uint domain, const Site * site, const double time, vector<pair<uint, Message>> & sent)
+{
+
+    Domain & d = m_domains.at(domain);
+
+    const uint index = d.brick->globalIndex(site);
+
+    for (uint other = 0; other < m_domains.size(); ++other)
+    {
+
+        if (other == domain || m_domains.at(other).brick->localSite(index) == NULL)
+        {
+            continue;
+        }
+
+        Message message;
+
+        message.time = time;
+        message.globalIndex = index;
+        message.active = site->isActive();
+        message.sender = domain;
+        message.id = d.nextId++;
+        message.anti = false;
+
+        sent.push_back(make_pair(other, message));
+
+        post(other, message);
+
+    }
+
+}
+
+void TimeWarpEngine::post(const uint domain, const Message & message)
+{
+
+    lock_guard<mutex> lock(m_inboxLocks.at(domain));
+
+    m_domains.at(domain).inbox.push_back(message);
+
+}
+
+bool TimeWarpEngine::poll(const uint domain)
+{
+
+    vector<Message> messages;
+
+    {
+        lock_guard<mutex> lock(m_inboxLocks.at(domain));
+
+        messages.swap(m_domains.at(domain).inbox);
+    }
+
+    //A sender posts the anti-message after the message it cancels.
+    for (const Message & message : messages)
+    {
+        receive(domain, message);
+    }
+
+    return !messages.empty();
+
+}
+
+void TimeWarpEngine::deliver()
+{
+
+    bool delivered = true;
+
+    //Receiving can roll a domain back, which posts anti-messages in turn.
+    while (delivered)
+    {
+
+        delivered = false;
+
+        for (uint i = 0; i < m_domains.size(); ++i)
+        {
+            if (poll(i))
+            {
+                delivered = true;
+            }
+        }
+
+    }
+
+}
+
+void TimeWarpEngine::receive(const uint domain, const Message & message)
+{
+
+    Domain & d = m_domains.at(domain);
+
+    d.brick->solver()->makeCurrent();
+
+    if (!message.anti)
+    {
+
+        d.nMessages++;
+
+        if (message.time < d.clock)
+        {
+            rollback(domain, message.time);
+        }
+
+        d.pending.insert(make_pair(message.time, message));
+
+        return;
+
+    }
+
+    d.nAntiMessages++;
+
+    //A processed message is first rolled back into the pending ones.
+    if (message.time <= d.clock)
+    {
+        rollback(domain, message.time);
+    }
+
+    auto range = d.pending.equal_range(message.time);
+
+    for (auto match = range.first; match != range.second; ++match)
+    {
+        if (match->second.sender == message.sender && match->second.id == message.id)
+        {
+            d.pending.erase(match);
+            return;
+        }
+    }
+
+    cerr << "Anti-message " << message.id << " from domain " << message.sender
+         << " matches no message of domain " << domain << "." << endl;
+    KMCSolver::exit();
+
+}
+
+void TimeWarpEngine::apply(const uint domain, Record & record)
+{
+
+    Site * site = m_domains.at(domain).brick->localSite(record.message.globalIndex);
+
+    record.applied = site->isActive() != record.message.active;
+
+    if (record.applied)
+    {
+        setState(site, record.message.active);
+    }
+
+}
+
+void TimeWarpEngine::rollback(const uint domain, const double time)
+{
+
+    Domain & d = m_domains.at(domain);
+
+    bool reversed = false;
+
+    while (!d.history.empty() && d.history.back().time >= time)
+    {
+
+        const Record & record = d.history.back();
+
+        //Reverse execution of DiffusionReaction::execute().
+        if (record.origin != NULL)
+        {
+
+            record.destination->deactivate();
+            record.origin->activate();
+
+            for (const pair<uint, Message> & sent : record.sent)
+            {
+                Message anti = sent.second;
+                anti.anti = true;
+
+                post(sent.first, anti);
+            }
+
+            d.nRolledBack++;
+
+        }
+
+        else
+        {
+
+            if (record.applied)
+            {
+                setState(d.brick->localSite(record.message.globalIndex), !record.message.active);
+            }
+
+            d.pending.insert(make_pair(record.time, record.message));
+
+        }
+
+        d.history.pop_back();
+
+        reversed = true;
+
+    }
+
+    d.clock = time;
+
+    if (reversed)
+    {
+        d.nRollbacks++;
+    }
+
+}
+
+void TimeWarpEngine::updateGVT()
+{
+
+    double gvt = numeric_limits<double>::infinity();
+
+    for (const Domain & domain : m_domains)
+    {
+
+        gvt = min(gvt, domain.clock);
+
+        if (!domain.pending.empty())
+        {
+            gvt = min(gvt, domain.pending.begin()->first);
+        }
+
+    }
+
+    m_gvt = gvt;
+
+}
+
+void TimeWarpEngine::collectFossils(const double time)
+{
+
+    for (Domain & domain : m_domains)
+    {
+        while (!domain.history.empty() && domain.history.front().time < time)
+        {
+            if (domain.history.front().origin != NULL)
+            {
+                m_nCommittedEvents++;
+            }
+
+            domain.history.pop_front();
+        }
+    }
+
+}
+
+uint TimeWarpEngine::ownerOf(const uint domain, const Site * site) const
+{
+
+    const Brick * brick = m_domains.at(domain).brick;
+
+    const uvec3 owner = brick->ownerOf(brick->globalIndex(site));
+
+    return owner(0) + brick->nBricks()(0)*(owner(1) + brick->nBricks()(1)*owner(2));
+
+}
+
+void TimeWarpEngine::setState(Site * site, const bool active)
+{
+
+    if (site->isActive() == active)
+    {
+        return;
+    }
+
+    if (active)
+    {
+        site->activate();
+    }
+
+    else
+    {
+        site->deactivate();
+    }
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include <libconfig_utils/libconfig_utils.h>
+
+#include <armadillo>
+
+using namespace arma;
+using namespace std;
+using namespace libconfig;
+
+
+namespace kMC
+{
+
+class KMCSolver;
+class Site;
+class Brick;
+
+//! Optimistic (Time Warp) kMC. The lattice is split into a grid of domains, each held as a
+//! Brick with ghost layers in a solver of its own. Domains run ahead on their own clocks
+//! without waiting for each other, with a rate catalog covering their whole padded box; a
+//! reaction picked on a ghost site is a null event which only advances the clock.
+//!
+//! Every site change is sent with its time stamp to the other domains whose padded box
+//! holds the site. A message older than the receiver's clock is a straggler: the receiver
+//! reverses its events and applied messages back to the straggler's time, and cancels the
+//! messages of the reversed events with anti-messages, which may roll back their receivers
+//! in turn. As the dynamics is memoryless, a domain simply redraws its next event from the
+//! time it rolled back to.
+//!
+//! Domains run in rounds, in parallel over the OpenMP threads, each up to a horizon past the
+//! global virtual time (GVT): the earliest clock or pending message of any domain. Messages
+//! are posted to the inbox of their receiver, which polls it between its events, so a
+//! message from a domain running behind the receiver arrives before the receiver needs it.
+//! Which messages arrive in time depends on how far the threads have come, so only runs on
+//! one thread are reproducible. Messages still in an inbox when its domain has reached the
+//! horizon are delivered between rounds, where the GVT is updated and the history no
+//! rollback can reach any more is committed (fossil collection). Concentration walls are
+//! not updated.
+class TimeWarpEngine
+{
+public:
+
+    //! Reads the system from the same settings as KMCSolver. The solver which was current on
+    //! the calling thread is current again when the engine returns. A horizon longer than
+    //! the time between boundary events gives each round more work, but most of it is then
+    //! rolled back.
+    TimeWarpEngine(const Setting & root, const uvec3 & nDomains, const double horizon);
+
+    ~TimeWarpEngine();
+
+
+    //! Fills every domain with a solution and sets the ghost layers from their owners.
+    void initializeSolutionBath();
+
+    //! Sets the ghost layers from their owners.
+    void synchronize();
+
+    //! Runs the domains until the GVT has advanced by the time.
+    void advance(const double time);
+
+
+    //! Ghost sites whose occupation differs from their owner's.
+    uint countGhostMismatches() const;
+
+    //! Particles on owned sites.
+    uint nParticles() const;
+
+    //! Committed events over processed events, the share not lost to rollbacks.
+    double efficiency() const;
+
+    //! Processed events over the events the busiest domain of each round would allow.
+    double parallelEfficiency() const;
+
+
+    const double & simulatedTime() const
+    {
+        return m_gvt;
+    }
+
+    const double & horizon() const
+    {
+        return m_horizon;
+    }
+
+    uint nDomains() const
+    {
+        return m_domains.size();
+    }
+
+    KMCSolver * solver(const uint domain) const;
+
+    const uint & nRounds() const
+    {
+        return m_nRounds;
+    }
+
+    const uint & nProcessedEvents() const
+    {
+        return m_nProcessedEvents;
+    }
+
+    const uint & nCommittedEvents() const
+    {
+        return m_nCommittedEvents;
+    }
+
+    uint nRolledBackEvents() const;
+
+    uint nRollbacks() const;
+
+    uint nMessages() const;
+
+    uint nAntiMessages() const;
+
+private:
+
+    //! A site change sent from one domain to another. An anti-message cancels the message
+    //! from the same sender with the same id.
+    struct Message
+    {
+        double time;
+
+        uint globalIndex;
+
+        bool active;
+
+        uint sender;
+
+        uint id;
+
+        bool anti;
+    };
+
+    //! A processed local event, with the messages it sent, or a processed message. A message
+    //! which does not match the receiver's view, as its sender has yet to see a straggler, is
+    //! kept unapplied until its anti-message arrives.
+    struct Record
+    {
+        double time;
+
+        Site * origin;
+
+        Site * destination;
+
+        vector<pair<uint, Message>> sent;
+
+        Message message;
+
+        bool applied;
+    };
+
+    struct Domain
+    {
+        Brick * brick;
+
+        double clock;
+
+        uint nextId;
+
+        deque<Record> history;
+
+        multimap<double, Message> pending;
+
+        //! Messages posted by other domains, guarded by the domain's inbox lock.
+        vector<Message> inbox;
+
+        uint nProcessed;
+
+        uint nRolledBack;
+
+        uint nRollbacks;
+
+        uint nMessages;
+
+        uint nAntiMessages;
+    };
+
+
+    const double m_horizon;
+
+    double m_gvt;
+
+    vector<Domain> m_domains;
+
+    vector<mutex> m_inboxLocks;
+
+
+    uint m_nRounds;
+
+    uint m_nProcessedEvents;
+
+    uint m_nCommittedEvents;
+
+    double m_work;
+
+    double m_span;
+
+
+    void runDomain(const uint domain, const double limit);
+
+    void send(const uint domain, const Site * site, const double time, vector<pair<uint, Message>> & sent);
+
+    void post(const uint domain, const Message & message);
+
+    //! Receives the messages posted to the domain so far. Returns false if there were none.
+    bool poll(const uint domain);
+
+    void deliver();
+
+    void receive(const uint domain, const Message & message);
+
+    void apply(const uint domain, Record & record);
+
+    void rollback(const uint domain, const double time);
+
+    void updateGVT();
+
+    void collectFossils(const double time);
+
+
+    uint ownerOf(const uint domain, const Site * site) const;
+
+    static void setState(Site * site, const bool active);
+
+};
+
+}
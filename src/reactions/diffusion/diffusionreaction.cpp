@@ -4,12 +4,16 @@
 
 #include "../../debugger/debugger.h"
 
+#include "../vectorexp.h"
+
 
 using namespace kMC;
 
-DiffusionReaction::DiffusionReaction(Site * currentSite, Site *destinationSite) :
-    Reaction(currentSite),
+DiffusionReaction::DiffusionReaction(Site * currentSite, Site *destinationSite, ReactionFields *fields, const uint slot) :
+    Reaction(currentSite, fields, slot),
     m_lastUsedEsp(UNSET_ENERGY),
+    m_saddleEnergySum(UNSET_ENERGY),
+    m_nSaddleEnergyUpdates(0),
     m_destinationSite(destinationSite)
 {
 
@@ -19,6 +23,10 @@ DiffusionReaction::DiffusionReaction(Site * currentSite, Site *destinationSite)
     saddleFieldIndices[1] = path(1) + 1;
     saddleFieldIndices[2] = path(2) + 1;
 
+    fields->direction[slot] = Site::directionIndex(path(0), path(1), path(2));
+
+    fields->saddleBoltzmannFactor[slot] = 0;
+
 }
 
 DiffusionReaction::~DiffusionReaction()
@@ -30,11 +38,17 @@ DiffusionReaction::~DiffusionReaction()
 void DiffusionReaction::loadConfig(const Setting &setting)
 {
 
-    m_rPower = getSurfaceSetting<double>(setting, "rPower");
-    m_scale  = getSurfaceSetting<double>(setting, "scale");
+    m_shared->rPower = getSurfaceSetting<double>(setting, "rPower");
+    m_shared->scale  = getSurfaceSetting<double>(setting, "scale");
 
     setSeparation(getSurfaceSetting<uint>(setting, "separation"), false);
 
+    setRateCacheEnabled(getSurfaceSetting<uint>(setting, "rateCache") == 1);
+
+    setRateCacheCapacity(getSurfaceSetting<uint>(setting, "rateCacheCapacity"));
+
+    setBatchedRates(getSurfaceSetting<uint>(setting, "batchedRates") == 1);
+
 }
 
 const uint &DiffusionReaction::xD() const
@@ -93,7 +107,7 @@ void DiffusionReaction::setSeparation(const uint separation, bool check)
         KMCSolver::exit();
     }
 
-    m_separation = separation;
+    m_shared->separation = separation;
 
 }
 
@@ -106,6 +120,10 @@ void DiffusionReaction::resetSeparationTo(const uint separation)
 
     setSeparation(separation);
 
+    Site::initializeCrystalNeighborCounts();
+
+    Site::initializeAllowedDirections();
+
     Site::initializeBoundaries();
 
 }
@@ -113,10 +131,12 @@ void DiffusionReaction::resetSeparationTo(const uint separation)
 void DiffusionReaction::setupPotential()
 {
 
-    KMCDebugger_Assert(m_scale, !=, 0, "Potential parameters not set.");
+    KMCDebugger_Assert(m_shared->scale, !=, 0, "Potential parameters not set.");
 
-    m_potential.reset();
-    m_potential.set_size(Site::neighborhoodLength(),
+    unshareTables();
+
+    m_shared->tables->potential.reset();
+    m_shared->tables->potential.set_size(Site::neighborhoodLength(),
                          Site::neighborhoodLength(),
                          Site::neighborhoodLength());
 
@@ -129,25 +149,25 @@ void DiffusionReaction::setupPotential()
 
                 if (i == Site::nNeighborsLimit() && j == Site::nNeighborsLimit() && k == Site::nNeighborsLimit())
                 {
-                    m_potential(i, j, k) = 0;
+                    m_shared->tables->potential(i, j, k) = 0;
                     continue;
                 }
 
-                m_potential(i, j, k) = 1.0/std::pow(Site::originTransformVector(i)*Site::originTransformVector(i)
+                m_shared->tables->potential(i, j, k) = 1.0/std::pow(Site::originTransformVector(i)*Site::originTransformVector(i)
                                                     + Site::originTransformVector(j)*Site::originTransformVector(j)
                                                     + Site::originTransformVector(k)*Site::originTransformVector(k)
-                                                    , m_rPower/2);
+                                                    , m_shared->rPower/2);
             }
         }
     }
 
-    m_saddlePotential.reset_objects();
-    m_saddlePotential.reset();
-    m_saddlePotential.set_size(3, 3, 3);
+    m_shared->tables->saddlePotential.reset_objects();
+    m_shared->tables->saddlePotential.reset();
+    m_shared->tables->saddlePotential.set_size(3, 3, 3);
 
-    neighborSetIntersectionPoints.reset_objects();
-    neighborSetIntersectionPoints.reset();
-    neighborSetIntersectionPoints.set_size(3, 3, 3);
+    m_shared->tables->neighborSetIntersectionPoints.reset_objects();
+    m_shared->tables->neighborSetIntersectionPoints.reset();
+    m_shared->tables->neighborSetIntersectionPoints.set_size(3, 3, 3);
 
     umat::fixed<3, 2> overlapBox;
     ivec _path;
@@ -172,14 +192,14 @@ void DiffusionReaction::setupPotential()
                 _path = {x, y, z};
                 overlapBox = makeSaddleOverlapMatrix(_path);
 
-                neighborSetIntersectionPoints(i, j, k) = overlapBox;
+                m_shared->tables->neighborSetIntersectionPoints(i, j, k) = overlapBox;
 
-                m_saddlePotential(i, j, k).set_size(overlapBox(0, 1) - overlapBox(0, 0),
+                m_shared->tables->saddlePotential(i, j, k).set_size(overlapBox(0, 1) - overlapBox(0, 0),
                                                     overlapBox(1, 1) - overlapBox(1, 0),
                                                     overlapBox(2, 1) - overlapBox(2, 0));
 
-                KMCDebugger_Assert(m_saddlePotential.n_elem, !=, 0, "illegal box size.");
-                KMCDebugger_Assert(m_saddlePotential.n_elem, !=, arma::prod(overlapBox.col(1)-overlapBox.col(0)), "saddle mat fail.");
+                KMCDebugger_Assert(m_shared->tables->saddlePotential.n_elem, !=, 0, "illegal box size.");
+                KMCDebugger_Assert(m_shared->tables->saddlePotential.n_elem, !=, arma::prod(overlapBox.col(1)-overlapBox.col(0)), "saddle mat fail.");
 
                 for (uint xn = overlapBox(0, 0); xn < overlapBox(0, 1); ++xn)
                 {
@@ -204,32 +224,172 @@ void DiffusionReaction::setupPotential()
                             r2 = dx*dx + dy*dy + dz*dz;
 
 
-                            m_saddlePotential(i, j, k)(xn - overlapBox(0, 0),
+                            m_shared->tables->saddlePotential(i, j, k)(xn - overlapBox(0, 0),
                                                        yn - overlapBox(1, 0),
-                                                       zn - overlapBox(2, 0)) = 1.0/pow(r2, m_rPower/2);
+                                                       zn - overlapBox(2, 0)) = 1.0/pow(r2, m_shared->rPower/2);
 
                         }
                     }
                 }
 
-                m_saddlePotential(i, j, k) *= m_scale;
+                m_shared->tables->saddlePotential(i, j, k) *= m_shared->scale;
 
             }
         }
     }
 
 
-    m_potential *= m_scale;
+    m_shared->tables->potential *= m_shared->scale;
+
+
+    m_shared->tables->distanceClassPotential.set_size(Site::nDistanceClasses());
+
+    for (uint i = 0; i < Site::neighborhoodLength(); ++i)
+    {
+        for (uint j = 0; j < Site::neighborhoodLength(); ++j)
+        {
+            for (uint k = 0; k < Site::neighborhoodLength(); ++k)
+            {
+
+                if (i == Site::nNeighborsLimit() && j == Site::nNeighborsLimit() && k == Site::nNeighborsLimit())
+                {
+                    continue;
+                }
+
+                m_shared->tables->distanceClassPotential(Site::distanceClassMatrix(i, j, k)) = m_shared->tables->potential(i, j, k);
+
+            }
+        }
+    }
+
+    setupBoltzmannFactors();
+
+    clearRateCache();
 
 }
 
-bool DiffusionReaction::allowedGivenNotBlocked() const
+void DiffusionReaction::setupBoltzmannFactors()
 {
 
-    if (m_separation != 0)
+    //Set up along with the potential.
+    if (m_shared->tables->distanceClassPotential.n_elem == 0)
+    {
+        return;
+    }
+
+    const uvec & multiplicities = Site::distanceClassMultiplicities();
+
+    uint maxCount = 0;
+
+    for (uint distanceClass = 0; distanceClass < multiplicities.n_elem; ++distanceClass)
+    {
+        maxCount = std::max(maxCount, (uint)multiplicities(distanceClass));
+    }
+
+    m_shared->boltzmannFactors.set_size(maxCount + 1, multiplicities.n_elem);
+
+    for (uint distanceClass = 0; distanceClass < multiplicities.n_elem; ++distanceClass)
+    {
+        for (uint count = 0; count <= maxCount; ++count)
+        {
+            m_shared->boltzmannFactors(count, distanceClass) = std::exp(-beta()*count*m_shared->tables->distanceClassPotential(distanceClass));
+        }
+    }
+
+    //The cached saddle factors depend on beta.
+    clearRateCache();
+
+}
+
+void DiffusionReaction::unshareTables()
+{
+    //Solvers copied from this one keep reading the old tables.
+    if (m_shared->tables.use_count() > 1)
+    {
+        m_shared->tables = make_shared<Tables>(*m_shared->tables);
+    }
+}
+
+void DiffusionReaction::setupUpdateFlagStencil()
+{
+
+    unshareTables();
+
+    m_shared->tables->updateFlagStencil.reset_objects();
+    m_shared->tables->updateFlagStencil.reset();
+    m_shared->tables->updateFlagStencil.set_size(3, 3, 3);
+
+    uint stencilLength = Site::updateStencilLength();
+
+    int center = Site::nNeighborsLimit() + 1;
+
+    int dx, dy, dz;
+    uint r_maxDistance, d_maxDistance;
+
+    for (int x = -1; x <= 1; ++x)
+    {
+        for (int y = -1; y <= 1; ++y)
+        {
+            for (int z = -1; z <= 1; ++z)
+            {
+
+                if ((x == 0) && (y == 0) && (z == 0))
+                {
+                    continue;
+                }
+
+                ucube & flags = m_shared->tables->updateFlagStencil(x + 1, y + 1, z + 1);
+
+                flags.set_size(stencilLength, stencilLength, stencilLength);
+
+                for (uint i = 0; i < stencilLength; ++i)
+                {
+
+                    dx = (int)i - center;
+
+                    for (uint j = 0; j < stencilLength; ++j)
+                    {
+
+                        dy = (int)j - center;
+
+                        for (uint k = 0; k < stencilLength; ++k)
+                        {
+
+                            dz = (int)k - center;
+
+                            r_maxDistance = max(abs(dx), max(abs(dy), abs(dz)));
+                            d_maxDistance = max(abs(dx + x), max(abs(dy + y), abs(dz + z)));
+
+                            //The energy of the reaction site changes within the neighborhood, but the
+                            //saddle energy only changes when the closest neighbors or the destination's
+                            //neighborhood is changed.
+                            if (r_maxDistance <= 1 || d_maxDistance <= Site::nNeighborsLimit())
+                            {
+                                flags(i, j, k) = defaultUpdateFlag;
+                            }
+
+                            else
+                            {
+                                flags(i, j, k) = updateKeepSaddle;
+                            }
+
+                        }
+                    }
+                }
+
+            }
+        }
+    }
+
+}
+
+bool DiffusionReaction::allowedGivenNotBlocked(const Site *reactionSite, const Site *destinationSite)
+{
+
+    if (m_shared->separation != 0)
     {
         uint lim;
-        if (reactionSite()->isActive())
+        if (reactionSite->isActive())
         {
             lim = 1;
         }
@@ -239,16 +399,16 @@ bool DiffusionReaction::allowedGivenNotBlocked() const
             lim = 0;
         }
 
-        if (destinationSite()->nNeighbors() != lim)
+        if (destinationSite->nNeighbors() != lim)
         {
-            return destinationSite()->isSurface();
+            return destinationSite->isSurface();
         }
 
-        for (uint i = 1; i < m_separation; ++i)
+        for (uint i = 1; i < m_shared->separation; ++i)
         {
-            if (destinationSite()->nNeighbors(i) != 0)
+            if (destinationSite->nNeighbors(i) != 0)
             {
-                return destinationSite()->isSurface();
+                return destinationSite->isSurface();
             }
         }
 
@@ -259,87 +419,131 @@ bool DiffusionReaction::allowedGivenNotBlocked() const
 }
 
 
-void DiffusionReaction::setDirectUpdateFlags(const Site *changedSite)
+void DiffusionReaction::setDirectUpdateFlags(const uint i, const uint j, const uint k)
 {
 
-    uint d_maxDistance, r_maxDistance;
-
-
-    if (rate() == UNSET_RATE || changedSite == reactionSite())
+    if (rate() == UNSET_RATE)
     {
-        addUpdateFlag(defaultUpdateFlag);
+        registerUpdateFlag(defaultUpdateFlag);
     }
 
     else
     {
+        registerUpdateFlag(m_shared->tables->updateFlagStencil(saddleFieldIndices[0],
+                                               saddleFieldIndices[1],
+                                               saddleFieldIndices[2])(i, j, k));
+    }
 
-        r_maxDistance = reactionSite()->maxDistanceTo(changedSite);
-
-        KMCDebugger_Assert(r_maxDistance, !=, 0, "This should be handled by other test.", getFinalizingDebugMessage());
-
-        if (r_maxDistance == 1)
-        {
-            addUpdateFlag(defaultUpdateFlag);
-        }
-
-        else
-        {
-            d_maxDistance = m_destinationSite->maxDistanceTo(changedSite);
+}
 
-            //if the destination is outsite the interaction cutoff, we can keep the old saddle energy.
-            if (d_maxDistance > Site::nNeighborsLimit())
-            {
-                KMCDebugger_Assert(Site::nNeighborsLimit() + 1, ==,  d_maxDistance);
-                addUpdateFlag(updateKeepSaddle);
-            }
+void DiffusionReaction::updateSaddleEnergy(const uint i, const uint j, const uint k, const int change)
+{
 
-            else
-            {
-                addUpdateFlag(defaultUpdateFlag);
-            }
-        }
+    if (m_saddleEnergySum == UNSET_ENERGY)
+    {
+        return;
+    }
 
+    const umat::fixed<3, 2> & overlap = m_shared->tables->neighborSetIntersectionPoints(saddleFieldIndices[0],
+                                                                      saddleFieldIndices[1],
+                                                                      saddleFieldIndices[2]);
 
-//        KMCDebugger_AssertBool(!updateFlags().empty(), "Updateflag should not be empty!", info());
+    if (i < overlap(0, 0) || i >= overlap(0, 1) ||
+        j < overlap(1, 0) || j >= overlap(1, 1) ||
+        k < overlap(2, 0) || k >= overlap(2, 1))
+    {
+        return;
     }
 
+    m_saddleEnergySum += change*getSaddleEnergyContributionFromNeighborAt(i, j, k);
+
+    m_nSaddleEnergyUpdates++;
 
 }
 
-double DiffusionReaction::getSaddleEnergy()
+double DiffusionReaction::getUpdatedSaddleEnergy()
 {
 
-    if (reactionSite()->nNeighborsSum() == 0 || m_destinationSite->nNeighborsSum() == 1)
+    if (saddleEnergyIsZero())
     {
         return 0;
     }
 
+    if (m_saddleEnergySum == UNSET_ENERGY || m_nSaddleEnergyUpdates >= saddleEnergyUpdatesPerRecompute)
+    {
+        m_saddleEnergySum = sumSaddleEnergy();
+
+        m_nSaddleEnergyUpdates = 0;
+    }
+
+    KMCDebugger_AssertClose(m_saddleEnergySum, sumSaddleEnergy(), 1E-10, "Incremental saddle energy has drifted.", getFinalizingDebugMessage());
+
+    return m_saddleEnergySum;
+
+}
+
+bool DiffusionReaction::saddleEnergyIsZero() const
+{
+    return reactionSite()->nNeighborsSum() == 0 || m_destinationSite->nNeighborsSum() == 1;
+}
+
+template<uint L>
+double DiffusionReaction::getSaddleEnergyKernel()
+{
+
+    const uint length = L == 0 ? Site::neighborhoodLength() : 2*L + 1;
+
+    //The overlap of the two neighborhoods, see makeSaddleOverlapMatrix().
+    const uint x0 = saddleFieldIndices[0] == 2 ? 1 : 0;
+    const uint y0 = saddleFieldIndices[1] == 2 ? 1 : 0;
+    const uint z0 = saddleFieldIndices[2] == 2 ? 1 : 0;
+
+    const uint x1 = saddleFieldIndices[0] == 0 ? length - 1 : length;
+    const uint y1 = saddleFieldIndices[1] == 0 ? length - 1 : length;
+    const uint z1 = saddleFieldIndices[2] == 0 ? length - 1 : length;
+
+    const uint nx = x1 - x0;
+    const uint ny = y1 - y0;
+
+    const double * saddlePot = m_shared->tables->saddlePotential(saddleFieldIndices[0],
+                                                 saddleFieldIndices[1],
+                                                 saddleFieldIndices[2]).memptr();
+
+    const int * dx = reactionSite()->neighborhoodOffsets(0);
+    const int * dy = reactionSite()->neighborhoodOffsets(1);
+    const int * dz = reactionSite()->neighborhoodOffsets(2);
+
     Site * targetSite;
 
     double Esp = 0;
 
-    const cube & saddlePot = m_saddlePotential(saddleFieldIndices[0],
-                                               saddleFieldIndices[1],
-                                               saddleFieldIndices[2]);
+    for (uint xn = x0; xn < x1; ++xn)
+    {
 
-    const umat::fixed<3, 2> & myIntersectionPoints = neighborSetIntersectionPoints(saddleFieldIndices[0],
-                                                                                   saddleFieldIndices[1],
-                                                                                   saddleFieldIndices[2]);
+        if (dx[xn] == Site::BLOCKED_NEIGHBOR)
+        {
+            continue;
+        }
 
-    for (uint xn = myIntersectionPoints(0, 0); xn < myIntersectionPoints(0, 1); ++xn)
-    {
-        for (uint yn = myIntersectionPoints(1, 0); yn < myIntersectionPoints(1, 1); ++yn)
+        for (uint yn = y0; yn < y1; ++yn)
         {
-            for (uint zn = myIntersectionPoints(2, 0); zn < myIntersectionPoints(2, 1); ++zn)
+
+            if (dy[yn] == Site::BLOCKED_NEIGHBOR)
             {
-                targetSite = reactionSite()->neighborhood(xn, yn, zn);
+                continue;
+            }
 
-                if (targetSite == NULL)
+            for (uint zn = z0; zn < z1; ++zn)
+            {
+
+                if (dz[zn] == Site::BLOCKED_NEIGHBOR)
                 {
                     continue;
                 }
 
-                else if (!targetSite->isActive())
+                targetSite = reactionSite() + dx[xn] + dy[yn] + dz[zn];
+
+                if (!targetSite->isActive())
                 {
                     continue;
                 }
@@ -349,13 +553,9 @@ double DiffusionReaction::getSaddleEnergy()
                     continue;
                 }
 
-                Esp += saddlePot(xn - myIntersectionPoints(0, 0),
-                                 yn - myIntersectionPoints(1, 0),
-                                 zn - myIntersectionPoints(2, 0));
+                Esp += saddlePot[(xn - x0) + nx*((yn - y0) + ny*(zn - z0))];
 
-                KMCDebugger_Assert(saddlePot(xn - myIntersectionPoints(0, 0),
-                                             yn - myIntersectionPoints(1, 0),
-                                             zn - myIntersectionPoints(2, 0)),
+                KMCDebugger_Assert(saddlePot[(xn - x0) + nx*((yn - y0) + ny*(zn - z0))],
                                    ==,
                                    getSaddleEnergyContributionFrom(targetSite),
                                    "Mismatch in saddle energy contribution.",
@@ -369,6 +569,175 @@ double DiffusionReaction::getSaddleEnergy()
 
 }
 
+double DiffusionReaction::sumSaddleEnergy()
+{
+
+    switch (Site::nNeighborsLimit())
+    {
+    case 1:
+        return getSaddleEnergyKernel<1>();
+    case 2:
+        return getSaddleEnergyKernel<2>();
+    case 3:
+        return getSaddleEnergyKernel<3>();
+    case 4:
+        return getSaddleEnergyKernel<4>();
+    default:
+        return getSaddleEnergyKernel<0>();
+    }
+
+}
+
+void DiffusionReaction::makeRateCacheKey(RateCacheKey &key) const
+{
+
+    const uint length = Site::neighborhoodLength();
+
+    //Same bounds as in the saddle energy kernel.
+    const uint x0 = saddleFieldIndices[0] == 2 ? 1 : 0;
+    const uint y0 = saddleFieldIndices[1] == 2 ? 1 : 0;
+    const uint z0 = saddleFieldIndices[2] == 2 ? 1 : 0;
+
+    const uint x1 = saddleFieldIndices[0] == 0 ? length - 1 : length;
+    const uint y1 = saddleFieldIndices[1] == 0 ? length - 1 : length;
+    const uint z1 = saddleFieldIndices[2] == 0 ? length - 1 : length;
+
+    const uint nx = x1 - x0;
+    const uint ny = y1 - y0;
+    const uint nz = z1 - z0;
+
+    //The first word holds the direction, the rest one bit per site in the overlap.
+    key.fill(0);
+
+    key[0] = saddleFieldIndices[0] + 3*(saddleFieldIndices[1] + 3*saddleFieldIndices[2]);
+
+    const int * dx = reactionSite()->neighborhoodOffsets(0);
+    const int * dy = reactionSite()->neighborhoodOffsets(1);
+    const int * dz = reactionSite()->neighborhoodOffsets(2);
+
+    const Site * targetSite;
+
+    uint n;
+
+    for (uint xn = x0; xn < x1; ++xn)
+    {
+
+        if (dx[xn] == Site::BLOCKED_NEIGHBOR)
+        {
+            continue;
+        }
+
+        for (uint yn = y0; yn < y1; ++yn)
+        {
+
+            if (dy[yn] == Site::BLOCKED_NEIGHBOR)
+            {
+                continue;
+            }
+
+            for (uint zn = z0; zn < z1; ++zn)
+            {
+
+                if (dz[zn] == Site::BLOCKED_NEIGHBOR)
+                {
+                    continue;
+                }
+
+                targetSite = reactionSite() + dx[xn] + dy[yn] + dz[zn];
+
+                if (!targetSite->isActive() || targetSite == reactionSite())
+                {
+                    continue;
+                }
+
+                n = (xn - x0) + nx*((yn - y0) + ny*(zn - z0));
+
+                key[1 + n/64] |= uint64_t(1) << (n%64);
+
+            }
+        }
+    }
+
+}
+
+void DiffusionReaction::loadSaddleFromRateCache()
+{
+
+    //Zero regardless of the surroundings.
+    if (saddleEnergyIsZero())
+    {
+        m_lastUsedEsp = 0;
+
+        saddleBoltzmannFactor() = 1;
+
+        return;
+    }
+
+    const bool cacheable = Site::nNeighborsLimit() <= rateCacheNeighborsLimit;
+
+    RateCacheKey key;
+
+    if (cacheable)
+    {
+
+        makeRateCacheKey(key);
+
+        auto cached = m_shared->rateCache.find(key);
+
+        if (cached != m_shared->rateCache.end())
+        {
+
+            m_shared->rateCacheHits++;
+
+            m_lastUsedEsp = cached->second.first;
+
+            saddleBoltzmannFactor() = cached->second.second;
+
+            KMCDebugger_AssertClose(getSaddleEnergy(), m_lastUsedEsp, 1E-10, "Cached saddle energy does not match.", getFinalizingDebugMessage());
+
+            return;
+
+        }
+
+    }
+
+    m_shared->rateCacheMisses++;
+
+    double Esp = getSaddleEnergy();
+
+    saddleBoltzmannFactor() = std::exp(beta()*Esp);
+
+    m_lastUsedEsp = Esp;
+
+    if (!cacheable)
+    {
+        return;
+    }
+
+    //Emptied rather than evicted from, as the occupations seen recently are refilled quickly.
+    if (m_shared->rateCache.size() >= m_shared->rateCacheCapacity)
+    {
+        m_shared->rateCache.clear();
+    }
+
+    m_shared->rateCache.emplace(key, make_pair(Esp, saddleBoltzmannFactor()));
+
+}
+
+size_t DiffusionReaction::RateCacheHash::operator()(const RateCacheKey &key) const
+{
+
+    uint64_t hash = key.size();
+
+    for (const uint64_t & word : key)
+    {
+        hash ^= word + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+
+    return hash;
+
+}
+
 double DiffusionReaction::getSaddleEnergyContributionFrom(const Site *site)
 {
     int X, Y, Z;
@@ -383,16 +752,16 @@ double DiffusionReaction::getSaddleEnergyContributionFrom(const Site *site)
 
 double DiffusionReaction::getSaddleEnergyContributionFromNeighborAt(const uint &i, const uint &j, const uint &k)
 {
-    return m_saddlePotential(saddleFieldIndices[0],
+    return m_shared->tables->saddlePotential(saddleFieldIndices[0],
                              saddleFieldIndices[1],
                              saddleFieldIndices[2])
-            (i - neighborSetIntersectionPoints(saddleFieldIndices[0],
+            (i - m_shared->tables->neighborSetIntersectionPoints(saddleFieldIndices[0],
                                                saddleFieldIndices[1],
                                                saddleFieldIndices[2])(0, 0),
-             j - neighborSetIntersectionPoints(saddleFieldIndices[0],
+             j - m_shared->tables->neighborSetIntersectionPoints(saddleFieldIndices[0],
                                                saddleFieldIndices[1],
                                                saddleFieldIndices[2])(1, 0),
-             k - neighborSetIntersectionPoints(saddleFieldIndices[0],
+             k - m_shared->tables->neighborSetIntersectionPoints(saddleFieldIndices[0],
                                                saddleFieldIndices[1],
                                                saddleFieldIndices[2])(2, 0));
 }
@@ -441,21 +810,29 @@ umat::fixed<3, 2> DiffusionReaction::makeSaddleOverlapMatrix(const ivec & relCoo
     return overlap;
 }
 
-void DiffusionReaction::calcRate()
+void DiffusionReaction::updateSaddleBoltzmannFactor()
 {
 
-    double newRate = 0;
-
     KMCDebugger_Assert(updateFlag(), !=, UNSET_UPDATE_FLAG);
 
     if (updateFlag() == defaultUpdateFlag)
     {
 
-        double Esp = getSaddleEnergy();
+        if (m_shared->rateCacheEnabled)
+        {
+            loadSaddleFromRateCache();
+        }
+
+        else
+        {
+
+            double Esp = getUpdatedSaddleEnergy();
+
+            saddleBoltzmannFactor() = std::exp(beta()*Esp);
 
-        newRate = linearRateScale()*std::exp(-beta()*(reactionSite()->energy()- Esp));
+            m_lastUsedEsp = Esp;
 
-        m_lastUsedEsp = Esp;
+        }
     }
 
     else //m_udateFlag = updateKeepSaddle
@@ -465,13 +842,81 @@ void DiffusionReaction::calcRate()
         KMCDebugger_Assert(updateFlag(), ==, updateKeepSaddle, "Errorous updateFlag.", getFinalizingDebugMessage());
         KMCDebugger_Assert(lastUsedEnergy(), !=, UNSET_ENERGY, "energy never calculated before.", getFinalizingDebugMessage());
 
-        newRate = rate()*std::exp(-beta()*(reactionSite()->energy() - lastUsedEnergy()));
-
         KMCDebugger_AssertClose(getSaddleEnergy(), m_lastUsedEsp, 1E-10, "Saddle energy was not conserved as assumed by flag. ", getFinalizingDebugMessage());
 
     }
 
-    setRate(newRate);
+}
+
+void DiffusionReaction::calcRate()
+{
+
+    updateSaddleBoltzmannFactor();
+
+    //The site's Boltzmann factor is tabulated, so only a changed saddle calls exp.
+    setRate(linearRateScale()*reactionSite()->boltzmannFactor()*saddleBoltzmannFactor());
+
+}
+
+void DiffusionReaction::calcRates(const vector<DiffusionReaction *> &reactions)
+{
+
+    m_shared->saddleBatch.clear();
+    m_shared->saddleBatchExponents.clear();
+
+    for (DiffusionReaction * reaction : reactions)
+    {
+
+        KMCDebugger_Assert(reaction->updateFlag(), !=, UNSET_UPDATE_FLAG);
+
+        if (reaction->updateFlag() != defaultUpdateFlag)
+        {
+            KMCDebugger_AssertClose(reaction->getSaddleEnergy(), reaction->m_lastUsedEsp, 1E-10, "Saddle energy was not conserved as assumed by flag. ", reaction->getFinalizingDebugMessage());
+
+            continue;
+        }
+
+        //Cache hits need no exp, and misses are stored as they are computed.
+        if (m_shared->rateCacheEnabled)
+        {
+            reaction->loadSaddleFromRateCache();
+
+            continue;
+        }
+
+        double Esp = reaction->getUpdatedSaddleEnergy();
+
+        reaction->m_lastUsedEsp = Esp;
+
+        m_shared->saddleBatch.push_back(reaction);
+
+        m_shared->saddleBatchExponents.push_back(beta()*Esp);
+
+    }
+
+    const uint n = m_shared->saddleBatch.size();
+
+    m_shared->saddleBatchFactors.resize(n);
+
+    vectorExp(m_shared->saddleBatchExponents.data(), m_shared->saddleBatchFactors.data(), n);
+
+    for (uint i = 0; i < n; ++i)
+    {
+        m_shared->saddleBatch[i]->saddleBoltzmannFactor() = m_shared->saddleBatchFactors[i];
+    }
+
+    for (DiffusionReaction * reaction : reactions)
+    {
+        reaction->setRate(linearRateScale()*reaction->reactionSite()->boltzmannFactor()*reaction->saddleBoltzmannFactor());
+
+        reaction->resetUpdateFlag();
+    }
+
+    m_shared->nRateBatches++;
+
+    m_shared->nBatchedSaddles += n;
+
+    m_shared->lastRateBatchSize = n;
 
 }
 
@@ -513,7 +958,16 @@ const string DiffusionReaction::info(int xr, int yr, int zr, string desc) const
 
 bool DiffusionReaction::isAllowed() const
 {
-    return !m_destinationSite->isActive() && allowedGivenNotBlocked();
+
+    KMCDebugger_Assert(reactionSite()->isAllowedDirection(fields().direction[slot()]), ==, isAllowed(reactionSite(), m_destinationSite), "Allowed direction mask is out of date.", getFinalizingDebugMessage());
+
+    return reactionSite()->isAllowedDirection(fields().direction[slot()]);
+
+}
+
+bool DiffusionReaction::isAllowed(const Site *reactionSite, const Site *destinationSite)
+{
+    return !destinationSite->isActive() && allowedGivenNotBlocked(reactionSite, destinationSite);
 }
 
 void DiffusionReaction::reset()
@@ -523,17 +977,28 @@ void DiffusionReaction::reset()
 
     m_lastUsedEsp = UNSET_ENERGY;
 
+    invalidateSaddleEnergy();
+
 }
 
 
 const string  DiffusionReaction::name = "DiffusionReaction";
 
-double        DiffusionReaction::m_rPower = 1.0;
-double        DiffusionReaction::m_scale  = 1.0;
+DiffusionReaction::Shared::Shared() :
+    rPower(1.0),
+    scale(1.0),
+    separation(1),
+    tables(make_shared<Tables>()),
+    rateCacheCapacity(1000000),
+    rateCacheEnabled(false),
+    rateCacheHits(0),
+    rateCacheMisses(0),
+    batchedRates(false),
+    nRateBatches(0),
+    nBatchedSaddles(0),
+    lastRateBatchSize(0)
+{
 
-uint          DiffusionReaction::m_separation = 1;
+}
 
-cube          DiffusionReaction::m_potential;
-field<cube>   DiffusionReaction::m_saddlePotential;
-field<umat::fixed<3, 2> >
-              DiffusionReaction::neighborSetIntersectionPoints;
+thread_local DiffusionReaction::Shared* DiffusionReaction::m_shared = NULL;
@@ -7,6 +7,12 @@
 
 #include <libconfig_utils/libconfig_utils.h>
 
+#include <unordered_map>
+#include <memory>
+#include <array>
+
+#include <stdint.h>
+
 using namespace arma;
 
 
@@ -14,19 +20,139 @@ namespace kMC
 {
 
 
-class DiffusionReaction : public Reaction
+//! Final, so calls through a DiffusionReaction pointer are dispatched statically.
+class DiffusionReaction final : public Reaction
 {
 public:
 
 
-    DiffusionReaction(Site *currentSite, Site *destinationSite);
+    DiffusionReaction(Site *currentSite, Site *destinationSite, ReactionFields *fields, const uint slot);
 
     ~DiffusionReaction();
 
     static const string name;
 
 
-    double getSaddleEnergy();
+    //! Incremental updates between full recomputes of the saddle energy sum.
+    const static uint saddleEnergyUpdatesPerRecompute = 1000;
+
+
+    //! The largest nNeighborsLimit whose paths are cached; the saddle energies of longer
+    //! ranged systems are always computed.
+    const static uint rateCacheNeighborsLimit = 4;
+
+    //! The direction of a path, followed by one bit per site in the largest overlap of
+    //! its neighborhoods.
+    typedef array<uint64_t, 1 + ((2*rateCacheNeighborsLimit + 1)*
+                                 (2*rateCacheNeighborsLimit + 1)*
+                                 (2*rateCacheNeighborsLimit + 1) + 63)/64> RateCacheKey;
+
+    struct RateCacheHash
+    {
+        size_t operator()(const RateCacheKey & key) const;
+    };
+
+    //! The potential and saddle tables, which follow from the settings alone. They are
+    //! read-only once set up, and shared by the solvers copied from one another; a solver
+    //! which sets them up again first takes a copy of its own.
+    struct Tables
+    {
+        cube potential;
+
+        //! The potential of a neighbor in each distance class, see Site::distanceClassMatrix().
+        vec distanceClassPotential;
+
+        field<cube>  saddlePotential;
+        field<umat::fixed<3, 2> > neighborSetIntersectionPoints;
+
+        //! The update flag for a reaction along each path, given the position of its
+        //! reaction site in the update stencil of a changed site.
+        field<ucube> updateFlagStencil;
+    };
+
+    //! The state shared by all diffusion reactions of one solver. Each solver owns
+    //! one, and KMCSolver::makeCurrent() points the calling thread at it.
+    struct Shared
+    {
+        Shared();
+
+        double rPower;
+
+        double scale;
+
+
+        uint separation;
+
+        shared_ptr<Tables> tables;
+
+        //! exp(-beta*n*V) for n neighbors in a distance class of potential V, at (n, class).
+        mat boltzmannFactors;
+
+
+        //! The saddle energy and exp(beta*Esp) for a path, keyed by its direction and
+        //! the occupation of the overlapping neighborhoods, see makeRateCacheKey().
+        unordered_map<RateCacheKey, pair<double, double>, RateCacheHash> rateCache;
+
+        //! The number of entries at which the cache is emptied.
+        uint rateCacheCapacity;
+
+        bool rateCacheEnabled;
+
+        uint64_t rateCacheHits;
+
+        uint64_t rateCacheMisses;
+
+
+        bool batchedRates;
+
+        //! The reactions with a changed saddle in the current batch, and beta*Esp and
+        //! exp(beta*Esp) for each.
+        vector<DiffusionReaction*> saddleBatch;
+
+        vector<double> saddleBatchExponents;
+
+        vector<double> saddleBatchFactors;
+
+        uint64_t nRateBatches;
+
+        uint64_t nBatchedSaddles;
+
+        uint lastRateBatchSize;
+    };
+
+    static void setShared(Shared * shared)
+    {
+        m_shared = shared;
+    }
+
+
+    double getSaddleEnergy()
+    {
+        if (saddleEnergyIsZero())
+        {
+            return 0;
+        }
+
+        return sumSaddleEnergy();
+    }
+
+    //! The saddle energy from the incrementally kept sum, recomputed in full when
+    //! unknown or after saddleEnergyUpdatesPerRecompute updates.
+    double getUpdatedSaddleEnergy();
+
+    //! Adds the contribution of a site at (i, j, k) in the neighborhood of the reaction
+    //! site which was activated (change = 1) or deactivated (change = -1).
+    void updateSaddleEnergy(const uint i, const uint j, const uint k, const int change);
+
+    //! The sum is not kept while the reaction site is deactive.
+    void invalidateSaddleEnergy()
+    {
+        m_saddleEnergySum = UNSET_ENERGY;
+    }
+
+    //! Brings exp(beta*Esp) up to date for a reaction flagged for a full update. The
+    //! rate itself follows from it, see Site::calculateRates().
+    void updateSaddleBoltzmannFactor();
 
     double getSaddleEnergyContributionFrom(const Site* site);
 
@@ -40,29 +166,109 @@ public:
 
     static void setupPotential();
 
+    static void setupUpdateFlagStencil();
+
+    static void setupBoltzmannFactors();
+
+    //! Drops all cached saddle energies along with the hit and miss counts.
+    static void clearRateCache()
+    {
+        m_shared->rateCache.clear();
+
+        m_shared->rateCacheHits = 0;
+        m_shared->rateCacheMisses = 0;
+    }
+
+    //! Calculates the rates of all reactions at once, exponentiating the changed
+    //! saddle energies in one vectorized pass. Equivalent to calcRate() on each.
+    static void calcRates(const vector<DiffusionReaction*> & reactions);
+
+    //! Whether a particle at reactionSite could diffuse to destinationSite, without
+    //! requiring the reaction object to exist.
+    static bool isAllowed(const Site * reactionSite, const Site * destinationSite);
+
     static void clearAll()
     {
-        m_potential.reset();
-        m_saddlePotential.reset_objects();
-        m_saddlePotential.reset();
-        neighborSetIntersectionPoints.reset_objects();
-        neighborSetIntersectionPoints.reset();
+        m_shared->tables = make_shared<Tables>();
+        m_shared->boltzmannFactors.reset();
+
+        clearRateCache();
+
+        m_shared->nRateBatches = 0;
+        m_shared->nBatchedSaddles = 0;
+        m_shared->lastRateBatchSize = 0;
     }
 
 
     static uint separation()
     {
-        return m_separation;
+        return m_shared->separation;
     }
 
     static const double & potential(const uint & x, const uint & y, const uint & z)
     {
-        return m_potential(x, y, z);
+        return m_shared->tables->potential(x, y, z);
     }
 
     static const cube & potentialBox()
     {
-        return m_potential;
+        return m_shared->tables->potential;
+    }
+
+    static const vec & distanceClassPotential()
+    {
+        return m_shared->tables->distanceClassPotential;
+    }
+
+    static const mat & boltzmannFactors()
+    {
+        return m_shared->boltzmannFactors;
+    }
+
+    static bool rateCacheEnabled()
+    {
+        return m_shared->rateCacheEnabled;
+    }
+
+    static uint64_t rateCacheHits()
+    {
+        return m_shared->rateCacheHits;
+    }
+
+    static uint64_t rateCacheMisses()
+    {
+        return m_shared->rateCacheMisses;
+    }
+
+    static uint rateCacheSize()
+    {
+        return m_shared->rateCache.size();
+    }
+
+    static const uint & rateCacheCapacity()
+    {
+        return m_shared->rateCacheCapacity;
+    }
+
+    static bool batchedRates()
+    {
+        return m_shared->batchedRates;
+    }
+
+    static uint64_t nRateBatches()
+    {
+        return m_shared->nRateBatches;
+    }
+
+    static uint64_t nBatchedSaddles()
+    {
+        return m_shared->nBatchedSaddles;
+    }
+
+    //! The number of saddle energies exponentiated together in the last batch.
+    static uint lastRateBatchSize()
+    {
+        return m_shared->lastRateBatchSize;
     }
 
     const Site* destinationSite() const
@@ -87,12 +293,27 @@ public:
 
     static void resetSeparationTo(const uint separation);
 
+    static void setRateCacheEnabled(const bool enabled)
+    {
+        m_shared->rateCacheEnabled = enabled;
+    }
+
+    static void setRateCacheCapacity(const uint capacity)
+    {
+        m_shared->rateCacheCapacity = capacity;
+    }
+
+    static void setBatchedRates(const bool batched)
+    {
+        m_shared->batchedRates = batched;
+    }
+
     static void setPotentialParameters(const double rPower, const double scale, bool setup = true)
     {
 
-        m_rPower = rPower;
+        m_shared->rPower = rPower;
 
-        m_scale = scale;
+        m_shared->scale = scale;
 
         if (setup)
         {
@@ -106,19 +327,17 @@ public:
 
 private:
 
-    static double m_rPower;
-
-    static double m_scale;
+    //! The shared state of the current solver on this thread.
+    static thread_local Shared * m_shared;
 
 
-    static uint m_separation;
+    double m_lastUsedEsp;
 
-    static cube m_potential;
-    static field<cube>  m_saddlePotential;
-    static field<umat::fixed<3, 2> > neighborSetIntersectionPoints;
+    //! The saddle energy summed over the occupied overlap, before the zero rules
+    //! of saddleEnergyIsZero() are applied.
+    double m_saddleEnergySum;
 
-
-    double m_lastUsedEsp;
+    uint m_nSaddleEnergyUpdates;
 
     Site* m_destinationSite = NULL;
 
@@ -129,12 +348,33 @@ private:
 
     uint saddleFieldIndices[3];
 
-    bool allowedGivenNotBlocked() const;
+    double & saddleBoltzmannFactor()
+    {
+        return fields().saddleBoltzmannFactor[slot()];
+    }
+
+    //! Switches to getSaddleEnergyKernel() on the neighbor limit.
+    double sumSaddleEnergy();
+
+    //! L is the neighbor limit, or zero for a limit only known at run time.
+    template<uint L>
+    double getSaddleEnergyKernel();
+
+    void makeRateCacheKey(RateCacheKey & key) const;
+
+    void loadSaddleFromRateCache();
+
+    bool saddleEnergyIsZero() const;
+
+    static bool allowedGivenNotBlocked(const Site * reactionSite, const Site * destinationSite);
+
+    //! Gives the current solver tables of its own before they are set up again.
+    static void unshareTables();
 
     // Reaction interface
 public:
 
-    void setDirectUpdateFlags(const Site * changedSite);
+    void setDirectUpdateFlags(const uint i, const uint j, const uint k);
 
     void calcRate();
 
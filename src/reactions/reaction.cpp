@@ -7,13 +7,18 @@
 
 using namespace kMC;
 
-Reaction::Reaction(Site *currentSite):
+Reaction::Reaction(Site *currentSite, ReactionFields *fields, const uint slot):
     m_reactionSite(currentSite),
-    m_lastUsedEnergy(UNSET_ENERGY),
-    m_rate(UNSET_RATE),
-    m_updateFlag(UNSET_UPDATE_FLAG)
+    m_fields(fields),
+    m_slot(slot)
 {
 
+    KMCDebugger_Assert(slot, <, ReactionFields::nSlots, "Reaction slot out of range.");
+
+    m_fields->lastUsedEnergy[m_slot] = UNSET_ENERGY;
+    m_fields->rate[m_slot] = UNSET_RATE;
+    m_fields->updateFlag[m_slot] = UNSET_UPDATE_FLAG;
+
 }
 
 Reaction::~Reaction()
@@ -25,8 +30,8 @@ const string Reaction::info(int xr, int yr, int zr, string desc) const
 {
     stringstream s;
     s << "[" << name << "]:" << "\n";
-    s << "   rate: " << m_rate << "  ";
-    s << "Selected flag: " << m_updateFlag << "  ";
+    s << "   rate: " << rate() << "  ";
+    s << "Selected flag: " << updateFlag() << "  ";
     s << "Blocked? " << !isAllowed() << "\n";
     s << "@";
     s << m_reactionSite->info(xr, yr, zr, desc);
@@ -81,10 +86,24 @@ string Reaction::getFinalizingDebugMessage() const
 #endif
 }
 
+void Reaction::setBeta(const double beta)
+{
+
+    m_shared->beta = beta;
+
+    DiffusionReaction::setupBoltzmannFactors();
+
+    //Cached saddle factors and the factors held by sites and reactions carry the old beta.
+    DiffusionReaction::clearRateCache();
+
+    m_solver->invalidateRates();
+
+}
+
 void Reaction::setRate(const double rate)
 {
-    m_lastUsedEnergy = m_reactionSite->energy();
-    m_rate = rate;
+    m_fields->lastUsedEnergy[m_slot] = m_reactionSite->energy();
+    m_fields->rate[m_slot] = rate;
 }
 
 const uint &Reaction::NX()
@@ -103,38 +122,36 @@ const uint &Reaction::NZ()
 }
 
 
-void Reaction::setMainSolver(KMCSolver *solver)
+void Reaction::setMainSolver(KMCSolver *solver, Shared *shared)
 {
     m_solver = solver;
+    m_shared = shared;
 }
 
 void Reaction::loadConfig(const Setting &setting)
 {
 
-    m_beta            = getSurfaceSetting<double>(setting, "beta");
-    m_linearRateScale = getSurfaceSetting<double>(setting, "scale");
+    m_shared->beta            = getSurfaceSetting<double>(setting, "beta");
+    m_shared->linearRateScale = getSurfaceSetting<double>(setting, "scale");
 
 }
 
 void Reaction::reset()
 {
 
-    m_lastUsedEnergy = UNSET_ENERGY;
+    m_fields->lastUsedEnergy[m_slot] = UNSET_ENERGY;
 
-    m_rate = UNSET_RATE;
+    m_fields->rate[m_slot] = UNSET_RATE;
 
-    m_updateFlag = UNSET_UPDATE_FLAG;
+    m_fields->updateFlag[m_slot] = UNSET_UPDATE_FLAG;
 
 }
 
 const string Reaction::name = "Reaction";
 
-KMCSolver*   Reaction::m_solver;
-
-double       Reaction::m_beta = 1.0;
-double       Reaction::m_linearRateScale = 1.0;
+thread_local KMCSolver*        Reaction::m_solver = NULL;
 
-uint         Reaction::m_IDCount = 0;
+thread_local Reaction::Shared* Reaction::m_shared = NULL;
 
 
 ostream & operator << (ostream& os, const Reaction& ss)
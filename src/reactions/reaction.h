@@ -15,11 +15,35 @@ namespace kMC
 class Site;
 class KMCSolver;
 
+
+//! The fields of a site's reactions which the rate loops read and write, kept apart
+//! from the reaction objects in one array per field, indexed by the reaction's slot.
+//! See Site::reactionFields().
+struct ReactionFields
+{
+    //! One slot for each closest neighbor.
+    const static uint nSlots = 26;
+
+    double rate[nSlots];
+
+    //! exp(beta*Esp) for the last used saddle energy.
+    double saddleBoltzmannFactor[nSlots];
+
+    //! The energy of the reaction site when the rate was calculated.
+    double lastUsedEnergy[nSlots];
+
+    int updateFlag[nSlots];
+
+    //! The bit of the slot's path in the site's allowed direction masks.
+    unsigned char direction[nSlots];
+};
+
+
 class Reaction
 {
 public:
 
-    Reaction(Site * currentSite);
+    Reaction(Site * currentSite, ReactionFields * fields, const uint slot);
 
     virtual ~Reaction();
 
@@ -27,34 +51,43 @@ public:
 
     void registerUpdateFlag(int flag)
     {
-        if (flag < m_updateFlag)
+        if (flag < m_fields->updateFlag[m_slot])
         {
-            m_updateFlag = flag;
+            m_fields->updateFlag[m_slot] = flag;
         }
     }
 
     void selectTriumphingUpdateFlag();
 
-    static void setMainSolver(KMCSolver * m_solver);
+    //! The state shared by all reactions of one solver. Each solver owns one, and
+    //! KMCSolver::makeCurrent() points the calling thread at it.
+    struct Shared
+    {
+        double beta = 1.0;
+        double linearRateScale = 1.0;
+
+        uint IDCount = 0;
+    };
+
+    static void setMainSolver(KMCSolver * solver, Shared * shared);
 
     static void loadConfig(const Setting & setting);
 
-    static void setBeta(const double beta)
-    {
-        m_beta = beta;
-    }
+    static void setBeta(const double beta);
 
     static void setLinearRateScale(const double linearRateScale)
     {
-        m_linearRateScale = linearRateScale;
+        m_shared->linearRateScale = linearRateScale;
     }
 
     static void clearAll()
     {
-        m_IDCount = 0;
+        m_shared->IDCount = 0;
     }
 
-    virtual void setDirectUpdateFlags(const Site * changedSite) = 0;
+    //! (i, j, k) is the position of the reaction site in the update stencil centered at
+    //! the changed site, see Site::updateStencilLength().
+    virtual void setDirectUpdateFlags(const uint i, const uint j, const uint k) = 0;
 
     virtual bool isAllowed() const = 0;
 
@@ -71,42 +104,48 @@ public:
 
     const static uint & IDCount()
     {
-        return m_IDCount;
+        return m_shared->IDCount;
     }
 
     const static double & linearRateScale()
     {
-        return m_linearRateScale;
+        return m_shared->linearRateScale;
     }
 
     const double & lastUsedEnergy() const
     {
-        return m_lastUsedEnergy;
+        return m_fields->lastUsedEnergy[m_slot];
     }
 
     const int & updateFlag() const
     {
-        return m_updateFlag;
+        return m_fields->updateFlag[m_slot];
     }
 
     void resetUpdateFlag()
     {
-        m_updateFlag = UNSET_UPDATE_FLAG;
+        m_fields->updateFlag[m_slot] = UNSET_UPDATE_FLAG;
     }
 
     void forceUpdateFlag(int flag)
     {
-        m_updateFlag = flag;
+        m_fields->updateFlag[m_slot] = flag;
     }
 
     const double &  rate() const
     {
-        return m_rate;
+        return m_fields->rate[m_slot];
+    }
+
+    //! The position of the reaction among its site's reactions.
+    const uint & slot() const
+    {
+        return m_slot;
     }
 
-    const double & beta() const
+    const static double & beta()
     {
-        return m_beta;
+        return m_shared->beta;
     }
 
     const uint & x() const;
@@ -165,20 +204,16 @@ public:
 
 private:
 
-    static KMCSolver* m_solver;
-
-    static double m_beta;
-    static double m_linearRateScale;
+    static thread_local KMCSolver* m_solver;
 
-    static uint m_IDCount;
+    //! The shared state of the current solver on this thread.
+    static thread_local Shared * m_shared;
 
     Site* m_reactionSite = NULL;
 
-    double m_lastUsedEnergy;
-
-    double m_rate;
+    ReactionFields * m_fields;
 
-    int m_updateFlag;
+    uint m_slot;
 
 protected:
 
@@ -194,6 +229,11 @@ protected:
         return m_reactionSite;
     }
 
+    ReactionFields & fields() const
+    {
+        return *m_fields;
+    }
+
 
 
 };
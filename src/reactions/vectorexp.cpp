@@ -0,0 +1,223 @@
+#include "vectorexp.h"
+
+#include <cstring>
+#include <stdint.h>
+
+//The SIMD paths are compiled for their targets function by function and picked by
+//what the CPU supports.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KMC_VECTOREXP_DISPATCH
+#include <immintrin.h>
+#endif
+
+
+namespace kMC
+{
+
+//exp(x) = 2^k*exp(r), with k = round(x/ln2) and |r| <= ln2/2.
+static const double expLimit   = 708.0;
+static const double log2e      = 1.4426950408889634;
+static const double ln2hi      = 6.93147180369123816490e-01;
+static const double ln2lo      = 1.90821492927058770002e-10;
+
+//Adding 1.5*2^52 rounds to an integer, left in the low bits of the mantissa.
+static const double roundShift = 6755399441055744.0;
+
+static const int64_t exponentBias = 1023;
+
+//Taylor coefficients of exp(r) from the highest order, 1/13! down to 1/0!.
+static const uint nCoefficients = 14;
+
+static const double coefficients[nCoefficients] =
+{
+    1.0/6227020800.0,
+    1.0/479001600.0,
+    1.0/39916800.0,
+    1.0/3628800.0,
+    1.0/362880.0,
+    1.0/40320.0,
+    1.0/5040.0,
+    1.0/720.0,
+    1.0/120.0,
+    1.0/24.0,
+    1.0/6.0,
+    1.0/2.0,
+    1.0,
+    1.0
+};
+
+static double scalarExp(double x)
+{
+
+    x = x < -expLimit ? -expLimit : x;
+    x = x >  expLimit ?  expLimit : x;
+
+    double kd = x*log2e + roundShift;
+    double k  = kd - roundShift;
+
+    double r = (x - k*ln2hi) - k*ln2lo;
+
+    double p = coefficients[0];
+
+    for (uint i = 1; i < nCoefficients; ++i)
+    {
+        p = p*r + coefficients[i];
+    }
+
+    int64_t bits;
+    std::memcpy(&bits, &kd, sizeof(bits));
+
+    bits = (bits + exponentBias) << 52;
+
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+
+    return p*scale;
+
+}
+
+static void scalarExpLoop(const double *x, double *y, const uint n, uint i)
+{
+    for (; i < n; ++i)
+    {
+        y[i] = scalarExp(x[i]);
+    }
+}
+
+#ifdef KMC_VECTOREXP_DISPATCH
+
+__attribute__((target("avx512f")))
+static void avx512Exp(const double *x, double *y, const uint n)
+{
+
+    uint i = 0;
+
+    const __m512d lower = _mm512_set1_pd(-expLimit);
+    const __m512d upper = _mm512_set1_pd(expLimit);
+    const __m512d shift = _mm512_set1_pd(roundShift);
+    const __m512i bias  = _mm512_set1_epi64(exponentBias);
+
+    //The unmasked min, max and shift are built on an undefined pass-through vector which
+    //GCC warns may be uninitialized. Their zero-masked forms over all lanes are the same
+    //instructions on a zeroed one.
+    const __mmask8 all = 0xFF;
+
+    for (; i + 8 <= n; i += 8)
+    {
+
+        __m512d xi = _mm512_maskz_min_pd(all, _mm512_maskz_max_pd(all, _mm512_loadu_pd(x + i), lower), upper);
+
+        __m512d kd = _mm512_fmadd_pd(xi, _mm512_set1_pd(log2e), shift);
+        __m512d k  = _mm512_sub_pd(kd, shift);
+
+        __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(ln2lo), _mm512_fnmadd_pd(k, _mm512_set1_pd(ln2hi), xi));
+
+        __m512d p = _mm512_set1_pd(coefficients[0]);
+
+        for (uint c = 1; c < nCoefficients; ++c)
+        {
+            p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(coefficients[c]));
+        }
+
+        __m512i bits = _mm512_maskz_slli_epi64(all, _mm512_add_epi64(_mm512_castpd_si512(kd), bias), 52);
+
+        _mm512_storeu_pd(y + i, _mm512_mul_pd(p, _mm512_castsi512_pd(bits)));
+
+    }
+
+    scalarExpLoop(x, y, n, i);
+
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Exp(const double *x, double *y, const uint n)
+{
+
+    uint i = 0;
+
+    const __m256d lower = _mm256_set1_pd(-expLimit);
+    const __m256d upper = _mm256_set1_pd(expLimit);
+    const __m256d shift = _mm256_set1_pd(roundShift);
+    const __m256i bias  = _mm256_set1_epi64x(exponentBias);
+
+    for (; i + 4 <= n; i += 4)
+    {
+
+        __m256d xi = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(x + i), lower), upper);
+
+        __m256d kd = _mm256_fmadd_pd(xi, _mm256_set1_pd(log2e), shift);
+        __m256d k  = _mm256_sub_pd(kd, shift);
+
+        __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(ln2lo), _mm256_fnmadd_pd(k, _mm256_set1_pd(ln2hi), xi));
+
+        __m256d p = _mm256_set1_pd(coefficients[0]);
+
+        for (uint c = 1; c < nCoefficients; ++c)
+        {
+            p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(coefficients[c]));
+        }
+
+        __m256i bits = _mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(kd), bias), 52);
+
+        _mm256_storeu_pd(y + i, _mm256_mul_pd(p, _mm256_castsi256_pd(bits)));
+
+    }
+
+    scalarExpLoop(x, y, n, i);
+
+}
+
+#endif
+
+uint vectorExpWidth()
+{
+
+#ifdef KMC_VECTOREXP_DISPATCH
+
+    static const uint width = __builtin_cpu_supports("avx512f") ? 8
+                            : __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? 4
+                            : 1;
+
+    return width;
+
+#else
+
+    return 1;
+
+#endif
+
+}
+
+void vectorExp(const double *x, double *y, const uint n)
+{
+    vectorExp(x, y, n, vectorExpWidth());
+}
+
+void vectorExp(const double *x, double *y, const uint n, const uint width)
+{
+
+#ifdef KMC_VECTOREXP_DISPATCH
+
+    if (width == 8)
+    {
+        avx512Exp(x, y, n);
+        return;
+    }
+
+    else if (width == 4)
+    {
+        avx2Exp(x, y, n);
+        return;
+    }
+
+#else
+
+    (void) width;
+
+#endif
+
+    scalarExpLoop(x, y, n, 0);
+
+}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sys/types.h>
+
+namespace kMC
+{
+
+//! Computes y[i] = exp(x[i]) for n arguments, eight or four at a time when the
+//! CPU supports AVX-512 or AVX2 with FMA, and one at a time otherwise. The path is
+//! chosen at run time, so no -march flags are needed. Accurate to about one ulp for
+//! |x| < 708. Arguments outside are clamped to +-708 on every path: x > 708 gives the
+//! finite exp(708) ~ 3.0e307 rather than inf, and x < -708 gives exp(-708) rather than
+//! zero or a subnormal.
+void vectorExp(const double * x, double * y, const uint n);
+
+//! As vectorExp(), on the path taking the given number of arguments at a time. The
+//! CPU must support it.
+void vectorExp(const double * x, double * y, const uint n, const uint width);
+
+//! The widest path the CPU supports: 8, 4 or 1.
+uint vectorExpWidth();
+
+}
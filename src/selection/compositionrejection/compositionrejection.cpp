@@ -0,0 +1,309 @@
+#include "compositionrejection.h"
+
+#include "../../kmcsolver.h"
+#include "../../reactions/reaction.h"
+
+#include "../../debugger/debugger.h"
+
+#include <cmath>
+
+
+using namespace kMC;
+
+
+CompositionRejection::CompositionRejection() :
+    SelectionEngine(SelectionEngine::CompositionRejection),
+    m_minExponent(0),
+    m_nSelectionsSinceResum(0),
+    m_nSelections(0),
+    m_nRejections(0)
+{
+
+}
+
+CompositionRejection::~CompositionRejection()
+{
+
+    m_groupSlots.clear();
+    m_groupRates.clear();
+    m_groupTotals.clear();
+
+    m_slotExponents.clear();
+    m_slotPositions.clear();
+
+}
+
+void CompositionRejection::initialize()
+{
+
+    m_groupSlots.clear();
+    m_groupRates.clear();
+    m_groupTotals.clear();
+
+    uint nSlots = solver()->NX()*solver()->NY()*solver()->NZ()*nSlotsPerSite;
+
+    m_slotExponents.assign(nSlots, NO_GROUP);
+    m_slotPositions.assign(nSlots, 0);
+
+    m_nSelectionsSinceResum = 0;
+
+    //Only active sites have rates.
+    solver()->forEachActiveSiteDo([this] (Site * site)
+    {
+        updateSite(site);
+    });
+
+}
+
+void CompositionRejection::updateSite(const Site *site)
+{
+
+    uint firstSlot = solver()->getSiteIndex(site)*nSlotsPerSite;
+
+    for (uint i = 0; i < nSlotsPerSite; ++i)
+    {
+        setSlotRate(firstSlot + i, getSlotRate(site, i));
+    }
+
+}
+
+void CompositionRejection::setSlotRate(const uint slot, const double rate)
+{
+
+    const int & oldExponent = m_slotExponents.at(slot);
+
+    if (rate == 0)
+    {
+        if (oldExponent != NO_GROUP)
+        {
+            removeSlot(slot);
+        }
+
+        return;
+    }
+
+    int exponent = getExponent(rate);
+
+    //Same rate class: the rate is updated in place.
+    if (exponent == oldExponent)
+    {
+        uint group = oldExponent - m_minExponent;
+
+        double & oldRate = m_groupRates.at(group).at(m_slotPositions.at(slot));
+
+        m_groupTotals.at(group) += rate - oldRate;
+
+        oldRate = rate;
+
+        return;
+    }
+
+    if (oldExponent != NO_GROUP)
+    {
+        removeSlot(slot);
+    }
+
+    insertSlot(slot, exponent, rate);
+
+}
+
+void CompositionRejection::insertSlot(const uint slot, const int exponent, const double rate)
+{
+
+    uint group = getGroupIndex(exponent);
+
+    m_slotExponents.at(slot) = exponent;
+    m_slotPositions.at(slot) = m_groupSlots.at(group).size();
+
+    m_groupSlots.at(group).push_back(slot);
+    m_groupRates.at(group).push_back(rate);
+
+    m_groupTotals.at(group) += rate;
+
+}
+
+void CompositionRejection::removeSlot(const uint slot)
+{
+
+    uint group = m_slotExponents.at(slot) - m_minExponent;
+    uint position = m_slotPositions.at(slot);
+
+    vector<uint> & slots = m_groupSlots.at(group);
+    vector<double> & rates = m_groupRates.at(group);
+
+    m_groupTotals.at(group) -= rates.at(position);
+
+    //The last member of the group takes the place of the removed slot.
+    uint lastSlot = slots.back();
+
+    slots.at(position) = lastSlot;
+    rates.at(position) = rates.back();
+
+    m_slotPositions.at(lastSlot) = position;
+
+    slots.pop_back();
+    rates.pop_back();
+
+    if (slots.empty())
+    {
+        m_groupTotals.at(group) = 0;
+    }
+
+    m_slotExponents.at(slot) = NO_GROUP;
+
+}
+
+uint CompositionRejection::getGroupIndex(const int exponent)
+{
+
+    if (m_groupTotals.empty())
+    {
+        m_minExponent = exponent;
+    }
+
+    else if (exponent < m_minExponent)
+    {
+        uint nNew = m_minExponent - exponent;
+
+        m_groupSlots.insert(m_groupSlots.begin(), nNew, vector<uint>());
+        m_groupRates.insert(m_groupRates.begin(), nNew, vector<double>());
+        m_groupTotals.insert(m_groupTotals.begin(), nNew, 0);
+
+        m_minExponent = exponent;
+    }
+
+    uint group = exponent - m_minExponent;
+
+    if (group >= m_groupTotals.size())
+    {
+        m_groupSlots.resize(group + 1);
+        m_groupRates.resize(group + 1);
+        m_groupTotals.resize(group + 1, 0);
+    }
+
+    return group;
+
+}
+
+int CompositionRejection::getExponent(const double rate)
+{
+    int exponent;
+
+    std::frexp(rate, &exponent);
+
+    return exponent;
+}
+
+void CompositionRejection::resumGroups()
+{
+
+    for (uint group = 0; group < nGroups(); ++group)
+    {
+
+        double groupTotal = 0;
+
+        for (const double & rate : m_groupRates.at(group))
+        {
+            groupTotal += rate;
+        }
+
+        m_groupTotals.at(group) = groupTotal;
+
+    }
+
+    m_nSelectionsSinceResum = 0;
+
+}
+
+Reaction *CompositionRejection::getReactionChoice(double R)
+{
+
+    KMCDebugger_Assert(totalRate(), !=, 0, "No active reactions.");
+
+    uint group;
+    uint lastNonEmptyGroup = 0;
+
+    //Composition step: linear in the number of rate classes, not in the number of reactions.
+    for (group = 0; group < nGroups(); ++group)
+    {
+
+        if (m_groupSlots.at(group).empty())
+        {
+            continue;
+        }
+
+        if (R < m_groupTotals.at(group))
+        {
+            break;
+        }
+
+        R -= m_groupTotals.at(group);
+
+        lastNonEmptyGroup = group;
+
+    }
+
+    //Round-off in the group sums can leave R marginally above the total.
+    if (group == nGroups())
+    {
+        group = lastNonEmptyGroup;
+    }
+
+    const vector<uint> & slots = m_groupSlots.at(group);
+    const vector<double> & rates = m_groupRates.at(group);
+
+    const double groupBound = std::ldexp(1.0, int(group) + m_minExponent);
+
+    const uint nMembers = slots.size();
+
+    uint member;
+
+    //Rejection step: all members are above groupBound/2, so at most two trials are expected.
+    while (true)
+    {
+
+        member = KMC_RNG_UNIFORM()*nMembers;
+
+        if (member == nMembers)
+        {
+            member--;
+        }
+
+        if (KMC_RNG_UNIFORM()*groupBound < rates.at(member))
+        {
+            break;
+        }
+
+        m_nRejections++;
+
+    }
+
+    m_nSelections++;
+
+    if (++m_nSelectionsSinceResum == m_resumInterval)
+    {
+        resumGroups();
+    }
+
+    return getSlotReaction(slots.at(member));
+
+}
+
+double CompositionRejection::totalRate() const
+{
+
+    double kTot = 0;
+
+    for (const double & groupTotal : m_groupTotals)
+    {
+        kTot += groupTotal;
+    }
+
+    return kTot;
+
+}
+
+
+uint CompositionRejection::m_resumInterval = 1000;
+
+const int     CompositionRejection::NO_GROUP;
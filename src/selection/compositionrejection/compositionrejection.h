@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../selectionengine.h"
+
+#include <vector>
+#include <climits>
+
+using namespace std;
+
+
+namespace kMC
+{
+
+//! Composition-rejection selection. Every allowed reaction is placed in the group
+//! holding rates in [2^(e-1), 2^e) for its binary exponent e. A group is chosen by its
+//! summed rate, and a reaction within the group is found by rejection against the group
+//! bound 2^e. The acceptance probability is at least one half, so both selection and
+//! updating a single rate are O(1), independent of the number of reactions.
+class CompositionRejection : public SelectionEngine
+{
+public:
+
+    CompositionRejection();
+
+    ~CompositionRejection();
+
+    void setSlotRate(const uint slot, const double rate);
+
+    //! Recomputes all group sums from their members to remove round-off from the
+    //! incremental updates.
+    void resumGroups();
+
+
+    static int getExponent(const double rate);
+
+    static void setResumInterval(const uint resumInterval)
+    {
+        m_resumInterval = resumInterval;
+    }
+
+
+    uint nGroups() const
+    {
+        return m_groupTotals.size();
+    }
+
+    uint nReactionsInGroup(const uint group) const
+    {
+        return m_groupSlots.at(group).size();
+    }
+
+    const double & groupTotal(const uint group) const
+    {
+        return m_groupTotals.at(group);
+    }
+
+    const int & minExponent() const
+    {
+        return m_minExponent;
+    }
+
+    const uint & nRejections() const
+    {
+        return m_nRejections;
+    }
+
+    const uint & nSelections() const
+    {
+        return m_nSelections;
+    }
+
+
+    static const int NO_GROUP = INT_MIN;
+
+private:
+
+    static uint m_resumInterval;
+
+    int m_minExponent;
+
+    vector<vector<uint> > m_groupSlots;
+
+    vector<vector<double> > m_groupRates;
+
+    vector<double> m_groupTotals;
+
+
+    vector<int> m_slotExponents;
+
+    vector<uint> m_slotPositions;
+
+
+    uint m_nSelectionsSinceResum;
+
+    uint m_nSelections;
+
+    uint m_nRejections;
+
+
+    void insertSlot(const uint slot, const int exponent, const double rate);
+
+    void removeSlot(const uint slot);
+
+    uint getGroupIndex(const int exponent);
+
+
+    // SelectionEngine interface
+public:
+
+    void initialize();
+
+    void updateSite(const Site * site);
+
+    Reaction * getReactionChoice(double R);
+
+    double totalRate() const;
+
+};
+
+}
@@ -0,0 +1,313 @@
+#include "nextreactionmethod.h"
+
+#include "../../kmcsolver.h"
+#include "../../reactions/reaction.h"
+
+#include "../../debugger/debugger.h"
+
+#include <cmath>
+
+
+using namespace kMC;
+
+
+NextReactionMethod::NextReactionMethod() :
+    SelectionEngine(SelectionEngine::NextReactionMethod),
+    m_currentTime(0),
+    m_lastTimeStep(0),
+    m_totalRate(0),
+    m_nSelectionsSinceResum(0)
+{
+
+}
+
+NextReactionMethod::~NextReactionMethod()
+{
+
+    m_heap.clear();
+    m_heapPositions.clear();
+
+    m_firingTimes.clear();
+    m_slotRates.clear();
+
+}
+
+void NextReactionMethod::initialize()
+{
+
+    uint nSlots = solver()->NX()*solver()->NY()*solver()->NZ()*nSlotsPerSite;
+
+    m_heap.clear();
+    m_heap.reserve(nSlots);
+
+    m_heapPositions.assign(nSlots, NOT_SCHEDULED);
+
+    m_firingTimes.assign(nSlots, 0);
+    m_slotRates.assign(nSlots, 0);
+
+    m_totalRate = 0;
+    m_nSelectionsSinceResum = 0;
+
+    //Only active sites have rates.
+    solver()->forEachActiveSiteDo([this] (Site * site)
+    {
+        updateSite(site);
+    });
+
+}
+
+void NextReactionMethod::updateSite(const Site *site)
+{
+
+    uint firstSlot = solver()->getSiteIndex(site)*nSlotsPerSite;
+
+    for (uint i = 0; i < nSlotsPerSite; ++i)
+    {
+        setSlotRate(firstSlot + i, getSlotRate(site, i));
+    }
+
+}
+
+void NextReactionMethod::setSlotRate(const uint slot, const double rate)
+{
+
+    double & oldRate = m_slotRates.at(slot);
+
+    if (rate == oldRate)
+    {
+        return;
+    }
+
+    m_totalRate += rate - oldRate;
+
+    if (rate == 0)
+    {
+        unschedule(slot);
+    }
+
+    else if (oldRate == 0)
+    {
+        schedule(slot, m_currentTime + drawWaitingTime(rate));
+    }
+
+    else
+    {
+        //The remaining waiting time of a reaction which did not fire is rescaled.
+        reschedule(slot, m_currentTime + (oldRate/rate)*(m_firingTimes.at(slot) - m_currentTime));
+    }
+
+    oldRate = rate;
+
+}
+
+double NextReactionMethod::drawWaitingTime(const double rate) const
+{
+    return -std::log(1.0 - KMC_RNG_UNIFORM())/rate;
+}
+
+void NextReactionMethod::schedule(const uint slot, const double firingTime)
+{
+
+    KMCDebugger_Assert(m_heapPositions.at(slot), ==, NOT_SCHEDULED, "Slot is already scheduled.");
+
+    m_firingTimes.at(slot) = firingTime;
+
+    m_heapPositions.at(slot) = m_heap.size();
+    m_heap.push_back(slot);
+
+    siftUp(m_heap.size() - 1);
+
+}
+
+void NextReactionMethod::unschedule(const uint slot)
+{
+
+    uint position = m_heapPositions.at(slot);
+
+    KMCDebugger_Assert(position, !=, NOT_SCHEDULED, "Slot is not scheduled.");
+
+    uint last = m_heap.size() - 1;
+
+    if (position != last)
+    {
+        swapHeapEntries(position, last);
+    }
+
+    m_heap.pop_back();
+    m_heapPositions.at(slot) = NOT_SCHEDULED;
+
+    if (position != last)
+    {
+        siftUp(position);
+        siftDown(position);
+    }
+
+}
+
+void NextReactionMethod::reschedule(const uint slot, const double firingTime)
+{
+
+    uint position = m_heapPositions.at(slot);
+
+    KMCDebugger_Assert(position, !=, NOT_SCHEDULED, "Slot is not scheduled.");
+
+    double oldFiringTime = m_firingTimes.at(slot);
+
+    m_firingTimes.at(slot) = firingTime;
+
+    if (firingTime < oldFiringTime)
+    {
+        siftUp(position);
+    }
+
+    else
+    {
+        siftDown(position);
+    }
+
+}
+
+void NextReactionMethod::siftUp(uint position)
+{
+
+    uint parent;
+
+    while (position != 0)
+    {
+        parent = (position - 1)/2;
+
+        if (!firesBefore(position, parent))
+        {
+            break;
+        }
+
+        swapHeapEntries(position, parent);
+
+        position = parent;
+    }
+
+}
+
+void NextReactionMethod::siftDown(uint position)
+{
+
+    uint child;
+    uint nEntries = m_heap.size();
+
+    while (true)
+    {
+
+        child = 2*position + 1;
+
+        if (child >= nEntries)
+        {
+            break;
+        }
+
+        if (child + 1 < nEntries && firesBefore(child + 1, child))
+        {
+            child++;
+        }
+
+        if (!firesBefore(child, position))
+        {
+            break;
+        }
+
+        swapHeapEntries(position, child);
+
+        position = child;
+
+    }
+
+}
+
+void NextReactionMethod::swapHeapEntries(const uint first, const uint second)
+{
+
+    uint firstSlot = m_heap[first];
+    uint secondSlot = m_heap[second];
+
+    m_heap[first] = secondSlot;
+    m_heap[second] = firstSlot;
+
+    m_heapPositions[secondSlot] = first;
+    m_heapPositions[firstSlot] = second;
+
+}
+
+bool NextReactionMethod::heapIsValid() const
+{
+
+    for (uint position = 1; position < m_heap.size(); ++position)
+    {
+        if (firesBefore(position, (position - 1)/2))
+        {
+            return false;
+        }
+    }
+
+    return true;
+
+}
+
+void NextReactionMethod::resumTotalRate()
+{
+
+    m_totalRate = 0;
+
+    for (const uint & slot : m_heap)
+    {
+        m_totalRate += m_slotRates[slot];
+    }
+
+    m_nSelectionsSinceResum = 0;
+
+}
+
+Reaction *NextReactionMethod::getReactionChoice(double R)
+{
+
+    (void) R;
+
+    KMCDebugger_Assert(m_heap.size(), !=, 0, "No active reactions.");
+
+    uint slot = m_heap.front();
+
+    double firingTime = m_firingTimes.at(slot);
+
+    KMCDebugger_Assert(firingTime, >=, m_currentTime, "Reactions can not fire in the past.");
+
+    m_lastTimeStep = firingTime - m_currentTime;
+
+    m_currentTime = firingTime;
+
+    //The fired reaction starts a new waiting time. If its rate changes when the
+    //reaction is executed, this time is rescaled like any other.
+    reschedule(slot, m_currentTime + drawWaitingTime(m_slotRates.at(slot)));
+
+    if (++m_nSelectionsSinceResum == m_resumInterval)
+    {
+        resumTotalRate();
+    }
+
+    return getSlotReaction(slot);
+
+}
+
+double NextReactionMethod::totalRate() const
+{
+    return m_totalRate;
+}
+
+double NextReactionMethod::getTimeStep(const double kTot) const
+{
+    (void) kTot;
+
+    return m_lastTimeStep;
+}
+
+
+const uint NextReactionMethod::NOT_SCHEDULED;
+
+const uint NextReactionMethod::m_resumInterval;
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../selectionengine.h"
+
+#include <vector>
+#include <climits>
+
+using namespace std;
+
+
+namespace kMC
+{
+
+//! Next Reaction Method (Gibson and Bruck). Every allowed reaction holds an absolute
+//! tentative firing time in an indexed binary min-heap, and the next reaction is the one
+//! on top. When a rate changes from a to a', the remaining waiting time is rescaled by
+//! a/a' instead of drawing a new random number, so only the fired reaction and new
+//! reactions consume random numbers. Each rate change costs O(log M) in the number of
+//! allowed reactions M.
+class NextReactionMethod : public SelectionEngine
+{
+public:
+
+    NextReactionMethod();
+
+    ~NextReactionMethod();
+
+    void setSlotRate(const uint slot, const double rate);
+
+
+    uint nScheduled() const
+    {
+        return m_heap.size();
+    }
+
+    const double & currentTime() const
+    {
+        return m_currentTime;
+    }
+
+    const double & firingTime(const uint slot) const
+    {
+        return m_firingTimes.at(slot);
+    }
+
+    const double & slotRate(const uint slot) const
+    {
+        return m_slotRates.at(slot);
+    }
+
+    bool isScheduled(const uint slot) const
+    {
+        return m_heapPositions.at(slot) != NOT_SCHEDULED;
+    }
+
+    //! True if every parent fires no later than its children.
+    bool heapIsValid() const;
+
+
+    static const uint NOT_SCHEDULED = UINT_MAX;
+
+private:
+
+    double m_currentTime;
+
+    double m_lastTimeStep;
+
+    double m_totalRate;
+
+    uint m_nSelectionsSinceResum;
+
+    static const uint m_resumInterval = 1000;
+
+
+    vector<uint> m_heap;
+
+    vector<uint> m_heapPositions;
+
+    vector<double> m_firingTimes;
+
+    vector<double> m_slotRates;
+
+
+    double drawWaitingTime(const double rate) const;
+
+    void schedule(const uint slot, const double firingTime);
+
+    void unschedule(const uint slot);
+
+    void reschedule(const uint slot, const double firingTime);
+
+    void siftUp(uint position);
+
+    void siftDown(uint position);
+
+    void swapHeapEntries(const uint first, const uint second);
+
+    bool firesBefore(const uint first, const uint second) const
+    {
+        return m_firingTimes[m_heap[first]] < m_firingTimes[m_heap[second]];
+    }
+
+    void resumTotalRate();
+
+
+    // SelectionEngine interface
+public:
+
+    void initialize();
+
+    void updateSite(const Site * site);
+
+    //! R is not used; the reaction with the earliest firing time is selected.
+    Reaction * getReactionChoice(double R);
+
+    double totalRate() const;
+
+    double getTimeStep(const double kTot) const;
+
+};
+
+}
@@ -0,0 +1,238 @@
+#include "ratetree.h"
+
+#include "../../kmcsolver.h"
+#include "../../site.h"
+#include "../../reactions/reaction.h"
+
+#include "../../debugger/debugger.h"
+
+
+using namespace kMC;
+
+
+RateTree::RateTree() :
+    SelectionEngine(SelectionEngine::RateTree),
+    m_nLeaves(0),
+    m_firstLeaf(1),
+    m_wholeLattice(true),
+    m_regionCapacity(1)
+{
+    m_nodes.resize(2, 0);
+}
+
+RateTree::~RateTree()
+{
+    m_nodes.clear();
+}
+
+void RateTree::setNumberOfLeaves(const uint nLeaves)
+{
+
+    m_nLeaves = nLeaves;
+
+    m_firstLeaf = 1;
+
+    while (m_firstLeaf < m_nLeaves)
+    {
+        m_firstLeaf *= 2;
+    }
+
+    m_nodes.assign(2*m_firstLeaf, 0);
+
+}
+
+void RateTree::setLeaf(const uint leaf, const double value)
+{
+
+    KMCDebugger_Assert(leaf, <, m_nLeaves, "Leaf index out of bounds.");
+
+    uint node = m_firstLeaf + leaf;
+
+    m_nodes[node] = value;
+
+    node /= 2;
+
+    while (node != 0)
+    {
+        m_nodes[node] = m_nodes[2*node] + m_nodes[2*node + 1];
+        node /= 2;
+    }
+
+}
+
+void RateTree::setRegions(const vector<uvec3> &starts, const vector<uvec3> &sizes)
+{
+
+    KMCDebugger_Assert(starts.size(), ==, sizes.size(), "Each box needs a start and an extent.");
+
+    m_wholeLattice = sizes.empty();
+
+    m_regionStarts = starts;
+    m_regionSizes = sizes;
+
+    invalidate();
+
+}
+
+uint RateTree::search(double &R) const
+{
+    return searchFrom(1, R);
+}
+
+uint RateTree::searchFrom(uint node, double &R) const
+{
+
+    KMCDebugger_Assert(m_nodes.at(node), !=, 0, "No active leaves.");
+
+    while (node < m_firstLeaf)
+    {
+
+        const double & left = m_nodes[2*node];
+
+        //Round-off can push R past the last non-zero leaf. We never descend into empty subtrees.
+        if (R < left || m_nodes[2*node + 1] == 0)
+        {
+            node = 2*node;
+        }
+
+        else
+        {
+            R -= left;
+            node = 2*node + 1;
+        }
+
+    }
+
+    return node - m_firstLeaf;
+
+}
+
+void RateTree::clear()
+{
+    m_nodes.assign(m_nodes.size(), 0);
+}
+
+void RateTree::initialize()
+{
+
+    if (m_wholeLattice)
+    {
+        m_regionStarts.assign(1, uvec3({0, 0, 0}));
+        m_regionSizes.assign(1, uvec3({solver()->NX(), solver()->NY(), solver()->NZ()}));
+    }
+
+    uint maxVolume = 1;
+
+    for (const uvec3 & size : m_regionSizes)
+    {
+        maxVolume = max(maxVolume, (uint)(size(0)*size(1)*size(2)));
+    }
+
+    m_regionCapacity = 1;
+
+    while (m_regionCapacity < maxVolume)
+    {
+        m_regionCapacity *= 2;
+    }
+
+    //A single box is laid out as the sites, by their index.
+    if (m_regionSizes.size() == 1)
+    {
+        setNumberOfLeaves(maxVolume);
+    }
+
+    else
+    {
+        setNumberOfLeaves(m_regionSizes.size()*m_regionCapacity);
+    }
+
+    //Only active sites have rates.
+    solver()->forEachActiveSiteDo([this] (Site * site)
+    {
+        updateSite(site);
+    });
+
+}
+
+void RateTree::updateSite(const Site *site)
+{
+
+    const uint leaf = leafOf(site);
+
+    if (leaf != m_nLeaves)
+    {
+        setLeaf(leaf, getSiteRate(site));
+    }
+
+}
+
+uint RateTree::leafOf(const Site *site) const
+{
+
+    for (uint region = 0; region < m_regionSizes.size(); ++region)
+    {
+
+        const uvec3 & start = m_regionStarts[region];
+        const uvec3 & size = m_regionSizes[region];
+
+        const uint x = site->x() - start(0);
+        const uint y = site->y() - start(1);
+        const uint z = site->z() - start(2);
+
+        //Sites before the start wrap around to large values.
+        if (x < size(0) && y < size(1) && z < size(2))
+        {
+            return region*m_regionCapacity + (x*size(1) + y)*size(2) + z;
+        }
+
+    }
+
+    return m_nLeaves;
+
+}
+
+Site *RateTree::siteOf(const uint leaf) const
+{
+
+    const uint region = leaf/m_regionCapacity;
+    const uint local = leaf%m_regionCapacity;
+
+    const uvec3 & start = m_regionStarts.at(region);
+    const uvec3 & size = m_regionSizes.at(region);
+
+    return solver()->getSite(start(0) + local/(size(1)*size(2)),
+                             start(1) + (local/size(2))%size(1),
+                             start(2) + local%size(2));
+
+}
+
+Reaction *RateTree::chooseOnLeaf(const uint leaf, const double R) const
+{
+    const Site * site = siteOf(leaf);
+
+    return site->reactions().at(site->selectSlot(R));
+}
+
+Reaction *RateTree::getRegionReactionChoice(const uint region, double R)
+{
+
+    KMCDebugger_Assert(regionTotal(region), !=, 0, "No active reactions in the box.");
+
+    //R is now relative to the cumulative rate of all sites preceding the selected one.
+    const uint leaf = searchFrom(regionRoot(region), R);
+
+    return chooseOnLeaf(leaf, R);
+
+}
+
+Reaction *RateTree::getReactionChoice(double R)
+{
+
+    KMCDebugger_Assert(total(), !=, 0, "No active reactions.");
+
+    //R is now relative to the cumulative rate of all sites preceding the selected one.
+    const uint leaf = search(R);
+
+    return chooseOnLeaf(leaf, R);
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../selectionengine.h"
+
+#include <vector>
+
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+
+namespace kMC
+{
+
+//! Complete binary sum tree with one leaf per site, holding the summed rate of the
+//! site's allowed reactions. Each internal node holds the sum of its two children, so a
+//! leaf update and a search both cost O(log N). Parents are recomputed from their
+//! children, so no round-off accumulates.
+//!
+//! The leaves may be restricted to boxes of sites, each given an aligned subtree of its
+//! own, so that the rate of one box and a choice within it cost O(log N) as well.
+class RateTree : public SelectionEngine
+{
+public:
+
+    RateTree();
+
+    ~RateTree();
+
+
+    //! Only the sites of the boxes, given by their first site and extent, get leaves.
+    //! Without boxes the whole lattice is one box.
+    void setRegions(const vector<uvec3> & starts, const vector<uvec3> & sizes);
+
+    uint nRegions() const
+    {
+        return m_regionSizes.size();
+    }
+
+    //! The summed rate of the sites of a box.
+    const double & regionTotal(const uint region) const
+    {
+        return m_nodes.at(regionRoot(region));
+    }
+
+    //! R is uniformly distributed in [0, regionTotal(region)).
+    Reaction * getRegionReactionChoice(const uint region, double R);
+
+
+    void setNumberOfLeaves(const uint nLeaves);
+
+    void setLeaf(const uint leaf, const double value);
+
+    //! Returns the leaf whose cumulative interval contains R.
+    //! On return, R is relative to the start of that leaf.
+    uint search(double & R) const;
+
+    void clear();
+
+
+    const double & total() const
+    {
+        return m_nodes.at(1);
+    }
+
+    const double & leaf(const uint leaf) const
+    {
+        return m_nodes.at(m_firstLeaf + leaf);
+    }
+
+    const uint & nLeaves() const
+    {
+        return m_nLeaves;
+    }
+
+private:
+
+    uint m_nLeaves;
+
+    uint m_firstLeaf;
+
+    vector<double> m_nodes;
+
+
+    bool m_wholeLattice;
+
+    vector<uvec3> m_regionStarts;
+
+    vector<uvec3> m_regionSizes;
+
+    //! The leaves of each box, a power of two so that every box fills a subtree.
+    uint m_regionCapacity;
+
+
+    uint searchFrom(uint node, double & R) const;
+
+    uint regionRoot(const uint region) const
+    {
+        return (m_firstLeaf + region*m_regionCapacity)/m_regionCapacity;
+    }
+
+    //! The leaf of the site, or m_nLeaves if it lies in no box.
+    uint leafOf(const Site * site) const;
+
+    Site * siteOf(const uint leaf) const;
+
+    Reaction * chooseOnLeaf(const uint leaf, const double R) const;
+
+
+    // SelectionEngine interface
+public:
+
+    void initialize();
+
+    void updateSite(const Site * site);
+
+    Reaction * getReactionChoice(double R);
+
+    double totalRate() const
+    {
+        return total();
+    }
+
+};
+
+}
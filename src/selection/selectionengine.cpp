@@ -0,0 +1,103 @@
+#include "selectionengine.h"
+
+#include "ratetree/ratetree.h"
+#include "compositionrejection/compositionrejection.h"
+#include "nextreactionmethod/nextreactionmethod.h"
+
+#include "../kmcsolver.h"
+#include "../reactions/reaction.h"
+
+#include "../debugger/debugger.h"
+
+
+using namespace kMC;
+
+
+SelectionEngine::SelectionEngine(const uint type) :
+    type(type),
+    m_isValid(false)
+{
+
+}
+
+SelectionEngine::~SelectionEngine()
+{
+
+}
+
+void SelectionEngine::setMainSolver(KMCSolver *solver)
+{
+    m_solver = solver;
+}
+
+SelectionEngine *SelectionEngine::create(const uint type)
+{
+
+    switch (type)
+    {
+    case SelectionEngine::RateTree:
+        return new kMC::RateTree();
+
+        break;
+
+    case SelectionEngine::CompositionRejection:
+        return new kMC::CompositionRejection();
+
+        break;
+
+    case SelectionEngine::NextReactionMethod:
+        return new kMC::NextReactionMethod();
+
+        break;
+
+    default:
+
+        cerr << "Unknown selection engine type " << type << endl;
+        KMCSolver::exit();
+
+        break;
+    }
+
+    return NULL;
+
+}
+
+double SelectionEngine::getSiteRate(const Site *site)
+{
+
+    return site->rateSum();
+
+}
+
+double SelectionEngine::getSlotRate(const Site *site, const uint i)
+{
+
+    KMCDebugger_Assert(site->reactions().size(), <=, nSlotsPerSite, "Too many reactions for the slot layout.", site->info());
+
+    if (!site->isActive() || i >= site->reactions().size())
+    {
+        return 0;
+    }
+
+    const ReactionFields & fields = site->reactionFields();
+
+    if (!site->isAllowedDirection(fields.direction[i]))
+    {
+        return 0;
+    }
+
+    KMCDebugger_Assert(fields.rate[i], !=, Reaction::UNSET_RATE, "Reaction rate should not be unset at this point.", site->reactions().at(i)->getFinalizingDebugMessage());
+
+    return fields.rate[i];
+
+}
+
+Reaction *SelectionEngine::getSlotReaction(const uint slot)
+{
+    return m_solver->getSite(slot/nSlotsPerSite)->reactions().at(slot%nSlotsPerSite);
+}
+
+
+thread_local KMCSolver* SelectionEngine::m_solver = NULL;
+
+const uint SelectionEngine::nSlotsPerSite;
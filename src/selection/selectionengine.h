@@ -0,0 +1,110 @@
+#pragma once
+
+#include <sys/types.h>
+
+
+namespace kMC
+{
+
+class KMCSolver;
+class Site;
+class Reaction;
+
+//! Holds the current rates of all active reactions and selects the next reaction to fire.
+//! Sites report rate changes through registerRateChange; structural changes to the system
+//! invalidate the engine, and it is rebuilt from all sites the next time it is validated.
+class SelectionEngine
+{
+public:
+
+    SelectionEngine(const uint type);
+
+    virtual ~SelectionEngine();
+
+    const uint type;
+
+
+    virtual void initialize() = 0;
+
+    virtual void updateSite(const Site * site) = 0;
+
+    //! R is uniformly distributed in [0, totalRate()).
+    virtual Reaction * getReactionChoice(double R) = 0;
+
+    virtual double totalRate() const = 0;
+
+
+    void validate()
+    {
+        if (!m_isValid)
+        {
+            initialize();
+            m_isValid = true;
+        }
+    }
+
+    void invalidate()
+    {
+        m_isValid = false;
+    }
+
+    void registerRateChange(const Site * site)
+    {
+        if (m_isValid)
+        {
+            updateSite(site);
+        }
+    }
+
+    const bool & isValid() const
+    {
+        return m_isValid;
+    }
+
+    //! Time passed by the last selected reaction in units of inverse rate. Engines without
+    //! a clock of their own use the mean residence time.
+    virtual double getTimeStep(const double kTot) const
+    {
+        return 1.0/kTot;
+    }
+
+    static void setMainSolver(KMCSolver * solver);
+
+    static SelectionEngine * create(const uint type);
+
+
+    enum SelectionEngineTypes
+    {
+        RateTree,
+        CompositionRejection,
+        NextReactionMethod
+    };
+
+    //! Engines storing individual reactions address them as siteIndex*nSlotsPerSite + the
+    //! reaction's position in the site's reaction list.
+    static const uint nSlotsPerSite = 26;
+
+private:
+
+    static thread_local KMCSolver * m_solver;
+
+    bool m_isValid;
+
+protected:
+
+    static KMCSolver * solver()
+    {
+        return m_solver;
+    }
+
+    static double getSiteRate(const Site * site);
+
+    //! The rate of reaction i on the site, or zero if the site is inactive or the
+    //! reaction is not allowed.
+    static double getSlotRate(const Site * site, const uint i);
+
+    static Reaction * getSlotReaction(const uint slot);
+
+};
+
+}
@@ -10,6 +10,9 @@
 
 #include "debugger/debugger.h"
 
+#include <new>
+#include <algorithm>
+
 using namespace kMC;
 
 
@@ -23,9 +26,21 @@ Site::Site(uint _x, uint _y, uint _z) :
     m_z(_z),
     m_r({_x, _y, _z}),
     m_energy(0),
-    m_particleState(ParticleStates::solution)
+    m_boltzmannFactor(1),
+    m_energyIsStale(false),
+    m_particleState(ParticleStates::solution),
+    m_particleIndex(NO_PARTICLE),
+    m_activeSiteIndex(NO_PARTICLE),
+    m_nReactions(0),
+    m_affectedStamp(0),
+    m_openDirections(0),
+    m_allowedDirections{0, 0},
+    m_destinationStatus(0),
+    m_nCrystalNeighbors(0),
+    m_nFixedCrystalNeighbors(0),
+    m_nCrystalNeighborsWithinSeparation(0)
 {
-    m_totalDeactiveParticles(ParticleStates::solution)++;
+    m_shared->totalDeactiveParticles(ParticleStates::solution)++;
 }
 
 
@@ -38,13 +53,13 @@ Site::~Site()
 
     if (isActive())
     {
-        m_totalActiveSites--;
-        m_totalActiveParticles(particleState())--;
-        m_totalDeactiveParticles(particleState())++;
+        m_shared->totalActiveSites--;
+        m_shared->totalActiveParticles(particleState())--;
+        m_shared->totalDeactiveParticles(particleState())++;
     }
 
 
-    m_totalDeactiveParticles(particleState())--;
+    m_shared->totalDeactiveParticles(particleState())--;
 
 }
 
@@ -54,26 +69,92 @@ Site::~Site()
 void Site::updateAffectedSites()
 {
 
-    for (Site* site : m_affectedSites)
+    if (DiffusionReaction::batchedRates())
+    {
+        updateAffectedSitesBatched();
+        return;
+    }
+
+    //The rates of different sites are independent, except through the shared rate cache.
+    const int nAffectedSites = m_shared->affectedSites.size();
+
+    Site ** affectedSites = m_shared->affectedSites.data();
+
+    //The workers are pointed at this thread's solver.
+    KMCSolver * solver = m_solver;
+
+#pragma omp parallel if (!DiffusionReaction::rateCacheEnabled() && nAffectedSites >= minAffectedSitesInParallel)
     {
-        if (!site->isActive())
+        solver->makeCurrent();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < nAffectedSites; ++i)
         {
-            continue;
+            if (affectedSites[i]->isActive())
+            {
+                affectedSites[i]->calculateRates();
+            }
+        }
+    }
+
+    for (Site* site : m_shared->affectedSites)
+    {
+        //Released here rather than on deactivation, since the executing reaction
+        //may belong to the deactivated site.
+        if (!site->isActive() && m_solver->reactionsFollowParticles())
+        {
+            site->clearAllReactions();
         }
 
-        site->calculateRates();
+        m_solver->selectionEngine()->registerRateChange(site);
     }
 
-    m_affectedSites.clear();
+    clearAffectedSites();
 
 }
 
 
+void Site::updateAffectedSitesBatched()
+{
+
+    m_shared->rateBatch.clear();
+
+    for (Site* site : m_shared->affectedSites)
+    {
+        if (site->isActive())
+        {
+            for (DiffusionReaction * reaction : site->reactions())
+            {
+                if (reaction->isAllowed())
+                {
+                    m_shared->rateBatch.push_back(reaction);
+                }
+            }
+        }
+
+        else if (m_solver->reactionsFollowParticles())
+        {
+            site->clearAllReactions();
+        }
+    }
+
+    DiffusionReaction::calcRates(m_shared->rateBatch);
+
+    for (Site* site : m_shared->affectedSites)
+    {
+        m_solver->selectionEngine()->registerRateChange(site);
+    }
+
+    clearAffectedSites();
+
+}
+
 
 void Site::setParticleState(int newState)
 {
 
     KMCDebugger_Assert(newState, !=, m_particleState, "switching particle states to same state...", info());
+    KMCDebugger_AssertBool(isWritable(), "changing a site other than the one visited in parallel", info());
 
     /* ################## crystal -> surface | solution ################### */
     if (m_particleState == ParticleStates::crystal)
@@ -163,22 +244,17 @@ bool Site::isLegalToSpawn()
         return false;
     }
 
-    for (Reaction * r : m_reactions)
-    {
-        if (!r->isAllowed())
-        {
-            return false;
-        }
-    }
-
-
-    return true;
+    //Inactive sites do not necessarily hold reactions, but their masks are kept.
+    return m_allowedDirections[0] == m_openDirections;
 
 }
 
 bool Site::qualifiesAsCrystal()
 {
 
+    KMCDebugger_Assert(m_nCrystalNeighbors, ==, countNeighboring(ParticleStates::crystal, 1), "Crystal neighbor counter out of date.", info());
+    KMCDebugger_Assert(m_nFixedCrystalNeighbors, ==, countNeighboring(ParticleStates::fixedCrystal, 1), "Fixed crystal neighbor counter out of date.", info());
+
     if (isFixedCrystalSeed())
     {
         return true;
@@ -189,12 +265,12 @@ bool Site::qualifiesAsCrystal()
         return false;
     }
 
-    else if (hasNeighboring(ParticleStates::fixedCrystal, 1))
+    else if (m_nFixedCrystalNeighbors != 0)
     {
         return true;
     }
 
-    else if (countNeighboring(ParticleStates::crystal, 1) >= m_nNeighborsToCrystallize)
+    else if (m_nCrystalNeighbors >= m_shared->nNeighborsToCrystallize)
     {
         return true;
     }
@@ -205,7 +281,9 @@ bool Site::qualifiesAsCrystal()
 
 bool Site::qualifiesAsSurface()
 {
-    return !isActive() && hasNeighboring(ParticleStates::crystal, DiffusionReaction::separation()) && !cannotCrystallize();
+    KMCDebugger_Assert(m_nCrystalNeighborsWithinSeparation, ==, countNeighboring(ParticleStates::crystal, std::min(DiffusionReaction::separation(), m_shared->nNeighborsLimit)), "Crystal neighbor counter out of date.", info());
+
+    return !isActive() && (m_nCrystalNeighborsWithinSeparation != 0) && !cannotCrystallize();
 }
 
 
@@ -238,7 +316,7 @@ void Site::initializeBoundaries()
 
     for (uint i = 0; i < 3; ++i) {
         for (uint j = 0; j < 2; ++j) {
-            m_boundaries(i, j)->initialize();
+            m_shared->boundaries(i, j)->initialize();
         }
     }
 
@@ -249,7 +327,7 @@ void Site::updateBoundaries()
 {
     for (uint i = 0; i < 3; ++i) {
         for (uint j = 0; j < 2; ++j) {
-            m_boundaries(i, j)->update();
+            m_shared->boundaries(i, j)->update();
         }
     }
 }
@@ -258,12 +336,22 @@ void Site::updateBoundaries()
 void Site::clearAllReactions()
 {
 
-    for (Reaction * reaction : m_reactions)
+    if (m_particleIndex == NO_PARTICLE)
+    {
+        return;
+    }
+
+    //Reactions are constructed in place in the solver's reaction table.
+    for (DiffusionReaction * reaction : reactions())
     {
-        delete reaction;
+        reaction->~DiffusionReaction();
     }
 
-    m_reactions.clear();
+    m_solver->releaseReactionBlock(m_particleIndex);
+
+    m_particleIndex = NO_PARTICLE;
+
+    m_nReactions = 0;
 
 }
 
@@ -297,183 +385,234 @@ void Site::deactivateFixedCrystal()
 
 void Site::forEachNeighborDo(function<void (Site *)> applyFunction) const
 {
+    forEachNeighborDo<function<void (Site *)> &>(applyFunction);
+}
+
+void Site::forEachNeighborDo_sendIndices(function<void (Site *, uint, uint, uint)> applyFunction) const
+{
+    forEachNeighborDo_sendIndices<function<void (Site *, uint, uint, uint)> &>(applyFunction);
+}
 
-    Site * neighbor;
+void Site::forEachActiveReactionDo(function<void (Reaction *)> applyFunction) const
+{
+    forEachActiveReactionDo<function<void (Reaction *)> &>(applyFunction);
+}
 
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
+void Site::forEachActiveReactionDo_sendIndex(function<void (Reaction *, uint)> applyFunction) const
+{
+    forEachActiveReactionDo_sendIndex<function<void (Reaction *, uint)> &>(applyFunction);
+}
+
+uint Site::nActiveReactions() const
+{
+
+    if (!m_active || m_nReactions == 0)
     {
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
-        {
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
-            {
+        return 0;
+    }
 
-                neighbor = neighborhood(i, j, k);
+    //The reactions cover the open directions.
+    return __builtin_popcount(m_allowedDirections[1]);
+}
 
-                if (neighbor == NULL)
-                {
-                    continue;
-                }
 
-                else if (neighbor == this) {
-                    assert(i == j && j == k && k == m_nNeighborsLimit);
-                    continue;
-                }
+void Site::crystallize()
+{
 
+    KMCDebugger_AssertBool(isActive(), "crystallization must occure on active or currently activating site.", info());
+
+    if (qualifiesAsCrystal())
+    {
+        //No need to test if it has neigh crystals because
+        //diffusion reactions deactivates old spot before activating new spot.
+        //Which will remove access surface.
+        setNewParticleState(ParticleStates::crystal);
 
-                applyFunction(neighbor);
+        propagateToNeighbors(ParticleStates::solution, ParticleStates::surface, DiffusionReaction::separation());
+    }
+    else
+    {
+        KMCDebugger_AssertBool(!(DiffusionReaction::separation() == 1 && Site::nNeighborsToCrystallize() == 1 && !cannotCrystallize()), "With a single neighboring crystal needed, everything should crystallize if asked.", info());
 
+        setNewParticleState(ParticleStates::solution);
 
-            }
-        }
     }
 }
 
-void Site::forEachNeighborDo_sendIndices(function<void (Site *, uint, uint, uint)> applyFunction) const
+void Site::decrystallize()
 {
 
-    Site * neighbor;
+    if (qualifiesAsSurface())
+    {
+        setNewParticleState(ParticleStates::surface);
+        propagateToNeighbors(ParticleStates::any, ParticleStates::solution, DiffusionReaction::separation());
+    }
 
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
+    else if (!qualifiesAsCrystal())
     {
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
-        {
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
-            {
+        setNewParticleState(ParticleStates::solution);
+        propagateToNeighbors(ParticleStates::any, ParticleStates::solution, DiffusionReaction::separation());
+    }
 
-                neighbor = neighborhood(i, j, k);
+}
 
-                if (neighbor == NULL)
-                {
-                    continue;
-                }
 
-                else if (neighbor == this) {
-                    assert(i == j && j == k && k == m_nNeighborsLimit);
-                    continue;
-                }
+void Site::calculateRates()
+{
 
+    if (!m_active || m_nReactions == 0)
+    {
+        return;
+    }
 
-                applyFunction(neighbor, i, j, k);
+    ReactionFields & fields = reactionFields();
 
+    const SiteReactions siteReactions = reactions();
 
-            }
+    //Only saddles flagged as changed are recomputed, one reaction at a time.
+    for (uint slot = 0; slot < m_nReactions; ++slot)
+    {
+        if (isAllowedDirection(fields.direction[slot]))
+        {
+            siteReactions.at(slot)->updateSaddleBoltzmannFactor();
         }
     }
-}
 
-void Site::forEachActiveReactionDo(function<void (Reaction *)> applyFunction) const
-{
-    if (!m_active)
-    {
-        return;
-    }
+    //The rates then follow from the slot fields alone.
+    const double siteFactor = Reaction::linearRateScale()*boltzmannFactor();
+
+    const double E = energy();
 
-    for (Reaction * reaction : m_reactions)
+    for (uint slot = 0; slot < m_nReactions; ++slot)
     {
-        if (reaction->isAllowed())
+        if (isAllowedDirection(fields.direction[slot]))
         {
-            applyFunction(reaction);
+            fields.rate[slot] = siteFactor*fields.saddleBoltzmannFactor[slot];
+
+            fields.lastUsedEnergy[slot] = E;
+
+            fields.updateFlag[slot] = Reaction::UNSET_UPDATE_FLAG;
         }
     }
+
 }
 
-void Site::forEachActiveReactionDo_sendIndex(function<void (Reaction *, uint)> applyFunction) const
+double Site::rateSum() const
 {
-    if (!m_active)
+
+    if (!m_active || m_nReactions == 0)
     {
-        return;
+        return 0;
     }
 
-    uint i = 0;
+    const ReactionFields & fields = reactionFields();
+
+    double R = 0;
 
-    for (Reaction * reaction : m_reactions)
+    for (uint slot = 0; slot < m_nReactions; ++slot)
     {
-        if (reaction->isAllowed())
+        if (isAllowedDirection(fields.direction[slot]))
         {
-            applyFunction(reaction, i);
-        }
+            KMCDebugger_Assert(fields.rate[slot], !=, Reaction::UNSET_RATE, "Reaction rate should not be unset at this point.", reactions().at(slot)->getFinalizingDebugMessage());
 
-        i++;
+            R += fields.rate[slot];
+        }
     }
+
+    return R;
+
 }
 
-uint Site::nActiveReactions() const
+uint Site::selectSlot(const double R) const
 {
 
-    uint nActiveReactions = 0;
+    KMCDebugger_AssertBool(m_active, "Selecting a reaction on a deactive site.", info());
 
-    forEachActiveReactionDo([&nActiveReactions] (Reaction * r)
-    {
-        (void) r;
-        nActiveReactions++;
-    });
+    const ReactionFields & fields = reactionFields();
 
-    return nActiveReactions;
-}
+    uint lastAllowedSlot = m_nReactions;
 
+    double accuRates = 0;
 
-void Site::crystallize()
-{
+    for (uint slot = 0; slot < m_nReactions; ++slot)
+    {
+        if (!isAllowedDirection(fields.direction[slot]))
+        {
+            continue;
+        }
 
-    KMCDebugger_AssertBool(isActive(), "crystallization must occure on active or currently activating site.", info());
+        accuRates += fields.rate[slot];
 
-    if (qualifiesAsCrystal())
-    {
-        //No need to test if it has neigh crystals because
-        //diffusion reactions deactivates old spot before activating new spot.
-        //Which will remove access surface.
-        setNewParticleState(ParticleStates::crystal);
+        //If item i in the cumulative rates > R, then reaction i is selected.
+        if (accuRates > R)
+        {
+            return slot;
+        }
 
-        propagateToNeighbors(ParticleStates::solution, ParticleStates::surface, DiffusionReaction::separation());
+        lastAllowedSlot = slot;
     }
-    else
-    {
-        KMCDebugger_AssertBool(!(DiffusionReaction::separation() == 1 && Site::nNeighborsToCrystallize() == 1 && !cannotCrystallize()), "With a single neighboring crystal needed, everything should crystallize if asked.", info());
 
-        setNewParticleState(ParticleStates::solution);
+    KMCDebugger_Assert(lastAllowedSlot, !=, m_nReactions, "Selected site has no active reactions.", info());
+
+    return lastAllowedSlot;
 
-    }
 }
 
-void Site::decrystallize()
+void Site::initializeDiffusionReactions()
 {
 
-    if (qualifiesAsSurface())
+    KMCDebugger_Assert(m_nReactions, ==, 0, "Sitereactions are already set", info());
+
+    KMCDebugger_AssertBool(isFixedCrystalSeed() || m_solver->reactionsFollowParticles() || !isActive(),
+                           "Non FixedCrystal Site should not be active when reactions are initialized.", info());
+
+    if (holdsDiffusionReactions())
     {
-        setNewParticleState(ParticleStates::surface);
-        propagateToNeighbors(ParticleStates::any, ParticleStates::solution, DiffusionReaction::separation());
+        createDiffusionReactions();
     }
 
-    else if (!qualifiesAsCrystal())
+}
+
+void Site::reserveDiffusionReactions()
+{
+
+    KMCDebugger_Assert(m_particleIndex, ==, NO_PARTICLE, "Site already holds a reaction block.", info());
+
+    if (holdsDiffusionReactions())
     {
-        setNewParticleState(ParticleStates::solution);
-        propagateToNeighbors(ParticleStates::any, ParticleStates::solution, DiffusionReaction::separation());
+        m_particleIndex = m_solver->allocateReactionBlock();
     }
 
 }
 
-
-void Site::calculateRates()
+bool Site::holdsDiffusionReactions()
 {
-    forEachActiveReactionDo([] (Reaction* reaction)
+
+    if (isFixedCrystalSeed())
     {
-        reaction->calcRate();
-        reaction->resetUpdateFlag();
-    });
+        return false;
+    }
+
+    //Only occupied sites hold reactions when they follow the particles.
+    return !m_solver->reactionsFollowParticles() || isActive();
+
 }
 
-void Site::initializeDiffusionReactions()
+void Site::createDiffusionReactions()
 {
 
+    KMCDebugger_Assert(m_nReactions, ==, 0, "Sitereactions are already set", info());
 
-    KMCDebugger_Assert(m_reactions.size(), ==, 0, "Sitereactions are already set", info());
-    KMCDebugger_AssertBool(!isActive() || isFixedCrystalSeed(), "Non FixedCrystal Site should not be active when reactions are initialized.", info());
-
-    if (isFixedCrystalSeed())
+    //The block may already be reserved, see reserveDiffusionReactions().
+    if (m_particleIndex == NO_PARTICLE)
     {
-        return;
+        m_particleIndex = m_solver->allocateReactionBlock();
     }
 
+    DiffusionReaction * slot = m_solver->reactionBlock(m_particleIndex);
+
+    ReactionFields * fields = m_solver->reactionFields(m_particleIndex);
+
     Site * destination;
 
     //For each site, loop over all closest neighbors
@@ -491,37 +630,51 @@ void Site::initializeDiffusionReactions()
                 //This ensures that the destination is not blocked by boundaries or equals the origin
                 if (destination != NULL && destination != this)
                 {
+                    new (slot++) DiffusionReaction(this, destination, fields, m_nReactions);
+                    m_nReactions++;
+                }
 
-                        DiffusionReaction* diffusionReaction = new DiffusionReaction(this, destination);
-                        addReaction(diffusionReaction);
+            }
+        }
+    }
 
-                        m_diffusionReactions[i][j][k] = diffusionReaction;
+    KMCDebugger_Assert(m_nReactions, <=, nReactionSlots, "Reaction slots overflowed.", info());
 
-                }
-                else
-                {
-                    m_diffusionReactions[i][j][k] = NULL;
-                }
+}
 
+const SiteReactions Site::reactions() const
+{
 
-            }
-        }
+    if (m_particleIndex == NO_PARTICLE)
+    {
+        return SiteReactions(NULL, 0);
     }
+
+    return SiteReactions(m_solver->reactionBlock(m_particleIndex), m_nReactions);
+
+}
+
+ReactionFields &Site::reactionFields() const
+{
+    KMCDebugger_Assert(m_particleIndex, !=, NO_PARTICLE, "Site holds no reactions.", info());
+
+    return *m_solver->reactionFields(m_particleIndex);
 }
 
 
-void Site::setMainSolver(KMCSolver *solver)
+void Site::setMainSolver(KMCSolver *solver, Shared *shared)
 {
     m_solver = solver;
+    m_shared = shared;
 }
 
 
 void Site::distanceTo(const Site *other, int &dx, int &dy, int &dz, bool absolutes) const
 {
 
-    dx = m_boundaries(0)->getDistanceBetween(other->x(), m_x);
-    dy = m_boundaries(1)->getDistanceBetween(other->y(), m_y);
-    dz = m_boundaries(2)->getDistanceBetween(other->z(), m_z);
+    dx = m_shared->boundaries(0)->getDistanceBetween(other->x(), m_x);
+    dy = m_shared->boundaries(1)->getDistanceBetween(other->y(), m_y);
+    dz = m_shared->boundaries(2)->getDistanceBetween(other->z(), m_z);
 
     if (absolutes) {
         dx = std::abs(dx);
@@ -557,100 +710,163 @@ double Site::potentialBetween(const Site *other)
 void Site::setNeighboringDirectUpdateFlags()
 {
 
-    forEachNeighborDo([this] (Site * neighbor)
+    Site * neighbor;
+
+    const int change = isActive() ? 1 : -1;
+
+    //This site as seen from a neighbor at (i, j, k) is at (2L - i, 2L - j, 2L - k).
+    const uint mirror = 2*m_shared->nNeighborsLimit;
+
+    for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
     {
+        for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
         {
-            if (neighbor->isActive())
+            for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
             {
+
+                neighbor = neighborhood(i, j, k);
+
+                if (neighbor == NULL || neighbor == this || !neighbor->isActive())
+                {
+                    continue;
+                }
+
                 //This approach assumes that recursive updating of non-neighboring sites
                 //WILL NOT ACTIVATE OR DEACTIVATE any sites, simply change their state,
                 //and thus not interfere with any flags set here, not require flags of their own.
-                for (Reaction * reaction : neighbor->reactions())
+                for (DiffusionReaction * reaction : neighbor->reactions())
                 {
-                    reaction->setDirectUpdateFlags(this);
+                    reaction->setDirectUpdateFlags(i + 1, j + 1, k + 1);
+                    reaction->updateSaddleEnergy(mirror - i, mirror - j, mirror - k, change);
                 }
 
-                m_affectedSites.insert(neighbor);
+                neighbor->queueAsAffected();
 
             }
         }
-    });
-
-    //BUGFIX TMP
+    }
 
-    Boundary::setupCurrentBoundaries(x(), y(), z());
 
-    int lim = (int)m_nNeighborsLimit + 1;
+    //Reactions from the shell just outside the neighborhood can end inside it,
+    //in which case their saddle energy has changed.
+    Site * closestNeighbor;
 
-    for (int i = -lim; i <= lim; ++i)
+    for (uint n = 0; n < m_shared->tables->updateShell.n_rows; ++n)
     {
-        for (int j = -lim; j <= lim; ++j)
+
+        closestNeighbor = neighborhood(m_shared->tables->updateShell(n, 0), m_shared->tables->updateShell(n, 1), m_shared->tables->updateShell(n, 2));
+
+        if (closestNeighbor == NULL)
         {
-            for (int k = -lim; k <= lim; ++k)
-            {
+            continue;
+        }
 
-                if (Site::getLevel(abs(i), abs(j), abs(k)) == lim - 1)
-                {
+        neighbor = closestNeighbor->neighborhood(m_shared->tables->updateShell(n, 3), m_shared->tables->updateShell(n, 4), m_shared->tables->updateShell(n, 5));
 
-                    uint xTrans = Boundary::currentBoundaries(0)->transformCoordinate(i + (int)x());
-                    uint yTrans = Boundary::currentBoundaries(1)->transformCoordinate(j + (int)y());
-                    uint zTrans = Boundary::currentBoundaries(2)->transformCoordinate(k + (int)z());
+        if (neighbor == NULL || !neighbor->isActive())
+        {
+            continue;
+        }
 
-                    if (!Boundary::isBlocked(xTrans, yTrans, zTrans))
-                    {
-                        for (Reaction * r : m_solver->getSite(xTrans, yTrans, zTrans)->reactions())
-                        {
+        for (DiffusionReaction * reaction : neighbor->reactions())
+        {
+            reaction->setDirectUpdateFlags(m_shared->tables->updateShell(n, 6), m_shared->tables->updateShell(n, 7), m_shared->tables->updateShell(n, 8));
+        }
 
-                            int xr, yr, zr;
+        neighbor->queueAsAffected();
 
-                            static_cast<DiffusionReaction*>(r)->destinationSite()->distanceTo(this, xr, yr, zr, true);
+    }
 
-                            uint l = Site::getLevel(xr, yr, zr);
+}
 
-                            if (l < Site::nNeighborsLimit() || true)
-                            {
-                                r->registerUpdateFlag(Reaction::defaultUpdateFlag);
-                            }
+void Site::setupUpdateShell()
+{
 
-                            m_affectedSites.insert(m_solver->getSite(xTrans, yTrans, zTrans));
+    int lim = (int)m_shared->nNeighborsLimit + 1;
 
-                        }
-                    }
+    uint nShellSites = (2*lim + 1)*(2*lim + 1)*(2*lim + 1) - m_shared->neighborhoodLength*m_shared->neighborhoodLength*m_shared->neighborhoodLength;
+
+    m_shared->tables->updateShell.set_size(nShellSites, 9);
+
+    uint n = 0;
+
+    ivec3 shellSite, step;
+
+    for (int i = -lim; i <= lim; ++i)
+    {
+        for (int j = -lim; j <= lim; ++j)
+        {
+            for (int k = -lim; k <= lim; ++k)
+            {
+
+                if (getLevel(abs(i), abs(j), abs(k)) != m_shared->nNeighborsLimit)
+                {
+                    continue;
+                }
+
+                shellSite = {i, j, k};
+
+                //Stepping one site towards the origin along each axis lands inside the neighborhood.
+                for (uint xyz = 0; xyz < 3; ++xyz)
+                {
+                    step(xyz) = (shellSite(xyz) > 0) - (shellSite(xyz) < 0);
+
+                    m_shared->tables->updateShell(n, xyz)     = shellSite(xyz) - step(xyz) + m_shared->nNeighborsLimit;
+                    m_shared->tables->updateShell(n, xyz + 3) = step(xyz) + m_shared->nNeighborsLimit;
+                    m_shared->tables->updateShell(n, xyz + 6) = shellSite(xyz) + lim;
                 }
 
+                n++;
 
             }
         }
     }
 
-    //TMP END
-
-
+    KMCDebugger_Assert(n, ==, nShellSites, "Shell size mismatch.");
 
 }
 
-bool Site::hasNeighboring(int state, int range) const
+template<uint R>
+bool Site::hasNeighboringKernel(int state, int range) const
 {
 
+    const uint r = R == 0 ? range : R;
+
+    const uint width = 2*r + 1;
+
+    const int * dx = neighborhoodOffsets(0) + m_shared->nNeighborsLimit - r;
+    const int * dy = neighborhoodOffsets(1) + m_shared->nNeighborsLimit - r;
+    const int * dz = neighborhoodOffsets(2) + m_shared->nNeighborsLimit - r;
+
     Site * nextNeighbor;
 
-    for (int i = -range; i <= range; ++i)
+    for (uint i = 0; i < width; ++i)
     {
-        for (int j = -range; j <= range; ++j)
+
+        if (dx[i] == BLOCKED_NEIGHBOR)
+        {
+            continue;
+        }
+
+        for (uint j = 0; j < width; ++j)
         {
-            for (int k = -range; k <= range; ++k)
+
+            if (dy[j] == BLOCKED_NEIGHBOR)
             {
+                continue;
+            }
 
-                nextNeighbor = neighborhood(i + Site::nNeighborsLimit(),
-                                            j + Site::nNeighborsLimit(),
-                                            k + Site::nNeighborsLimit());
+            for (uint k = 0; k < width; ++k)
+            {
 
-                if (nextNeighbor == NULL)
+                if (dz[k] == BLOCKED_NEIGHBOR)
                 {
                     continue;
                 }
 
-                else if (nextNeighbor == this)
+                nextNeighbor = const_cast<Site*>(this) + dx[i] + dy[j] + dz[k];
+
+                if (nextNeighbor == this)
                 {
                     continue;
                 }
@@ -669,30 +885,68 @@ bool Site::hasNeighboring(int state, int range) const
 
 }
 
+bool Site::hasNeighboring(int state, int range) const
+{
 
-uint Site::countNeighboring(int state, int range) const
+    switch (range)
+    {
+    case 1:
+        return hasNeighboringKernel<1>(state, range);
+    case 2:
+        return hasNeighboringKernel<2>(state, range);
+    case 3:
+        return hasNeighboringKernel<3>(state, range);
+    case 4:
+        return hasNeighboringKernel<4>(state, range);
+    default:
+        return hasNeighboringKernel<0>(state, range);
+    }
+
+}
+
+
+template<uint R>
+uint Site::countNeighboringKernel(int state, int range) const
 {
 
+    const uint r = R == 0 ? range : R;
+
+    const uint width = 2*r + 1;
+
+    const int * dx = neighborhoodOffsets(0) + m_shared->nNeighborsLimit - r;
+    const int * dy = neighborhoodOffsets(1) + m_shared->nNeighborsLimit - r;
+    const int * dz = neighborhoodOffsets(2) + m_shared->nNeighborsLimit - r;
+
     Site * nextNeighbor;
     uint count = 0;
 
-    for (int i = -range; i <= range; ++i)
+    for (uint i = 0; i < width; ++i)
     {
-        for (int j = -range; j <= range; ++j)
+
+        if (dx[i] == BLOCKED_NEIGHBOR)
         {
-            for (int k = -range; k <= range; ++k)
+            continue;
+        }
+
+        for (uint j = 0; j < width; ++j)
+        {
+
+            if (dy[j] == BLOCKED_NEIGHBOR)
             {
+                continue;
+            }
 
-                nextNeighbor = neighborhood(i + Site::nNeighborsLimit(),
-                                            j + Site::nNeighborsLimit(),
-                                            k + Site::nNeighborsLimit());
+            for (uint k = 0; k < width; ++k)
+            {
 
-                if (nextNeighbor == NULL)
+                if (dz[k] == BLOCKED_NEIGHBOR)
                 {
                     continue;
                 }
 
-                else if (nextNeighbor == this)
+                nextNeighbor = const_cast<Site*>(this) + dx[i] + dy[j] + dz[k];
+
+                if (nextNeighbor == this)
                 {
                     continue;
                 }
@@ -711,9 +965,34 @@ uint Site::countNeighboring(int state, int range) const
 
 }
 
+uint Site::countNeighboring(int state, int range) const
+{
+
+    switch (range)
+    {
+    case 1:
+        return countNeighboringKernel<1>(state, range);
+    case 2:
+        return countNeighboringKernel<2>(state, range);
+    case 3:
+        return countNeighboringKernel<3>(state, range);
+    case 4:
+        return countNeighboringKernel<4>(state, range);
+    default:
+        return countNeighboringKernel<0>(state, range);
+    }
+
+}
+
 void Site::activate()
 {
 
+    //A site which was deactivated earlier in the same step still holds its reactions.
+    if (m_solver->reactionsFollowParticles() && m_particleIndex == NO_PARTICLE && !isFixedCrystalSeed())
+    {
+        createDiffusionReactions();
+    }
+
     flipActive();
 
 
@@ -727,17 +1006,20 @@ void Site::activate()
     }
 
 
-    setNeighboringDirectUpdateFlags();
-
-    for (Reaction * reaction : m_reactions)
+    //Left to KMCSolver::finalizeBulkPlacement() when placing in bulk.
+    if (!m_solver->isPlacingInBulk())
     {
-        reaction->setDirectUpdateFlags(this);
+        setNeighboringDirectUpdateFlags();
+
+        registerFullUpdate();
     }
 
 
     KMCDebugger_MarkPartialStep("ACTIVATION COMPLETE");
 
-    m_totalActiveSites++;
+    m_shared->totalActiveSites++;
+
+    m_activeSiteIndex = m_solver->addActiveSite(this);
 
     KMCDebugger_AssertBool(!(isSurface() && isActive()), "surface should not be active.", info());
 
@@ -782,160 +1064,541 @@ void Site::deactivate()
     }
 
 
-    setNeighboringDirectUpdateFlags();
+    if (!m_solver->isPlacingInBulk())
+    {
+        setNeighboringDirectUpdateFlags();
+    }
+
+    KMCDebugger_MarkPartialStep("DEACTIVATION COMPLETE");
+
+    m_shared->totalActiveSites--;
+
+    removeFromActiveSites();
+
+}
+
+void Site::registerFullUpdate()
+{
+
+    for (DiffusionReaction * reaction : reactions())
+    {
+        reaction->setDirectUpdateFlags(m_shared->nNeighborsLimit + 1, m_shared->nNeighborsLimit + 1, m_shared->nNeighborsLimit + 1);
+        reaction->invalidateSaddleEnergy();
+    }
+
+    queueAsAffected();
+
+}
+
+void Site::flipActive()
+{
+
+    KMCDebugger_AssertBool(!m_active, "activating active site", info());
+    KMCDebugger_AssertBool(isWritable(), "changing a site other than the one visited in parallel", info());
+    KMCDebugger_AssertBool(!isCrystal(), "Activating a crystal. (should always be active)", info());
+
+    m_shared->totalDeactiveParticles(particleState())--;
+    m_shared->totalActiveParticles(particleState())++;
+
+
+    m_active = true;
+
+
+    queueAsAffected();
+
+    informNeighborhoodOnChange(+1);
+
+    updateDestinationStatus();
+
+}
+
+void Site::flipDeactive()
+{
+    KMCDebugger_AssertBool(m_active, "deactivating deactive site. ", info());
+    KMCDebugger_AssertBool(isWritable(), "changing a site other than the one visited in parallel", info());
+    KMCDebugger_AssertBool(!isSurface(), "deactivating a surface. (should always be deactive)", info());
+
+    m_shared->totalActiveParticles(particleState())--;
+    m_shared->totalDeactiveParticles(particleState())++;
+
+
+    m_active = false;
+
+
+    //Reactions of deactivated sites must be removed from the rate tree.
+    queueAsAffected();
+
+    informNeighborhoodOnChange(-1);
+
+    updateDestinationStatus();
+
+}
+
+
+void Site::introduceNeighborhood()
+{
+
+    KMCDebugger_Assert(m_shared->nNeighborsLimit, !=, 0, "Neighborlimit must be greater than zero.", info());
+    KMCDebugger_Assert(m_shared->nNeighborsLimit, !=, KMCSolver::UNSET_UINT, "Neighborlimit is not set.", str());
+    KMCDebugger_Assert(m_shared->tables->neighborhoodOffsets.n_elem, !=, 0, "Neighborhood offsets are not set.", str());
+
+
+    Site * neighbor;
+
+
+    m_nNeighbors.zeros(m_shared->nNeighborsLimit);
+
+    m_distanceClassCounts.zeros(nDistanceClasses());
+
+    for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
+    {
+        for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
+        {
+            for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
+            {
+
+                neighbor = neighborhood(i, j, k);
+
+                if (neighbor == NULL || neighbor == this)
+                {
+                    continue;
+                }
+
+                KMCDebugger_AssertBool(!(i == Site::nNeighborsLimit() && j == Site::nNeighborsLimit() && k == Site::nNeighborsLimit()));
+                KMCDebugger_AssertBool(!(neighbor->x() == x() && neighbor->y() == y() && neighbor->z() == z()));
+
+                if (neighbor->isActive())
+                {
+
+                    uint level = m_shared->tables->levelMatrix(i, j, k);
+
+                    m_nNeighbors(level)++;
+
+                    m_nNeighborsSum++;
+
+                    uint distanceClass = m_shared->tables->distanceClassMatrix(i, j, k);
+
+                    m_distanceClassCounts(distanceClass)++;
+
+                }
+
+            }
+        }
+    }
+
+    updateEnergy();
+
+}
+
+void Site::updateEnergy() const
+{
+
+    const double * distanceClassPotential = DiffusionReaction::distanceClassPotential().memptr();
+
+    const mat & boltzmannFactors = DiffusionReaction::boltzmannFactors();
+
+    m_energy = 0;
+
+    m_boltzmannFactor = 1;
+
+    for (uint distanceClass = 0; distanceClass < m_distanceClassCounts.n_elem; ++distanceClass)
+    {
+
+        const uword & count = m_distanceClassCounts(distanceClass);
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        m_energy += count*distanceClassPotential[distanceClass];
+
+        m_boltzmannFactor *= boltzmannFactors.at(count, distanceClass);
+
+    }
+
+    m_energyIsStale = false;
+
+}
+
+uint Site::getDestinationStatus() const
+{
+
+    if (m_active)
+    {
+        return 0;
+    }
+
+    if (DiffusionReaction::separation() == 0 || isSurface())
+    {
+        return 3;
+    }
+
+    //Set up along with the neighborhood.
+    if (m_nNeighbors.n_elem == 0)
+    {
+        return 0;
+    }
+
+    const uint nLevels = std::min(DiffusionReaction::separation(), (uint)m_nNeighbors.n_elem);
+
+    for (uint level = 1; level < nLevels; ++level)
+    {
+        if (m_nNeighbors(level) != 0)
+        {
+            return 0;
+        }
+    }
+
+    //A moving particle is itself the one closest neighbor of its destination.
+    if (m_nNeighbors(0) == 1)
+    {
+        return 2;
+    }
+
+    else if (m_nNeighbors(0) == 0)
+    {
+        return 1;
+    }
+
+    return 0;
+
+}
+
+void Site::updateDestinationStatus()
+{
+
+    const uint status = getDestinationStatus();
+
+    if (status == m_destinationStatus || m_shared->tables->neighborhoodOffsets.n_elem == 0)
+    {
+        return;
+    }
+
+    m_destinationStatus = status;
+
+    Site * origin;
+
+    uint direction;
+
+    for (uint i = 0; i < 3; ++i)
+    {
+        for (uint j = 0; j < 3; ++j)
+        {
+            for (uint k = 0; k < 3; ++k)
+            {
+
+                origin = neighborhood(m_shared->nNeighborsLimit - 1 + i,
+                                      m_shared->nNeighborsLimit - 1 + j,
+                                      m_shared->nNeighborsLimit - 1 + k);
+
+                if (origin == NULL || origin == this)
+                {
+                    continue;
+                }
+
+                //Seen from the origin, this site is in the opposite direction.
+                direction = directionIndex(1 - (int)i, 1 - (int)j, 1 - (int)k);
+
+                for (uint active = 0; active < 2; ++active)
+                {
+                    if ((status >> active) & 1)
+                    {
+                        origin->m_allowedDirections[active] |= 1u << direction;
+                    }
+
+                    else
+                    {
+                        origin->m_allowedDirections[active] &= ~(1u << direction);
+                    }
+                }
+
+            }
+        }
+    }
+
+}
+
+void Site::initializeAllowedDirections()
+{
+
+    m_solver->forEachSiteDo_inParallel([] (Site * site)
+    {
+        site->m_destinationStatus = site->getDestinationStatus();
+    });
+
+    m_solver->forEachSiteDo_inParallel([] (Site * site)
+    {
+
+        Site * destination;
+
+        uint direction;
+
+        site->m_openDirections = 0;
+        site->m_allowedDirections[0] = 0;
+        site->m_allowedDirections[1] = 0;
+
+        for (uint i = 0; i < 3; ++i)
+        {
+            for (uint j = 0; j < 3; ++j)
+            {
+                for (uint k = 0; k < 3; ++k)
+                {
+
+                    destination = site->neighborhood(m_shared->nNeighborsLimit - 1 + i,
+                                                     m_shared->nNeighborsLimit - 1 + j,
+                                                     m_shared->nNeighborsLimit - 1 + k);
+
+                    if (destination == NULL || destination == site)
+                    {
+                        continue;
+                    }
+
+                    direction = directionIndex((int)i - 1, (int)j - 1, (int)k - 1);
+
+                    site->m_openDirections |= 1u << direction;
+
+                    for (uint active = 0; active < 2; ++active)
+                    {
+                        if ((destination->m_destinationStatus >> active) & 1)
+                        {
+                            site->m_allowedDirections[active] |= 1u << direction;
+                        }
+                    }
 
-    KMCDebugger_MarkPartialStep("DEACTIVATION COMPLETE");
+                }
+            }
+        }
 
-    m_totalActiveSites--;
+    });
 
 }
 
-void Site::flipActive()
+void Site::initializeTotalDistanceClassCounts()
 {
 
-    KMCDebugger_AssertBool(!m_active, "activating active site", info());
-    KMCDebugger_AssertBool(!isCrystal(), "Activating a crystal. (should always be active)", info());
-
-    m_totalDeactiveParticles(particleState())--;
-    m_totalActiveParticles(particleState())++;
+    m_shared->totalDistanceClassCounts.zeros(nDistanceClasses());
 
+    m_solver->forEachSiteDo([] (Site * site)
+    {
+        if (site->m_distanceClassCounts.n_elem == m_shared->totalDistanceClassCounts.n_elem)
+        {
+            m_shared->totalDistanceClassCounts += site->m_distanceClassCounts;
+        }
+    });
 
-    m_active = true;
+}
 
+void Site::initializeCrystalNeighborCounts()
+{
 
-    m_affectedSites.insert(this);
+    const uint separation = std::min(DiffusionReaction::separation(), m_shared->nNeighborsLimit);
 
-    informNeighborhoodOnChange(+1);
+    m_solver->forEachSiteDo_inParallel([&separation] (Site * site)
+    {
+        site->m_nCrystalNeighbors = site->countNeighboring(ParticleStates::crystal, 1);
+        site->m_nFixedCrystalNeighbors = site->countNeighboring(ParticleStates::fixedCrystal, 1);
+        site->m_nCrystalNeighborsWithinSeparation = site->countNeighboring(ParticleStates::crystal, separation);
+    });
 
 }
 
-void Site::flipDeactive()
+void Site::informNeighborhoodOnCrystalChange(const int crystalChange, const int fixedCrystalChange)
 {
-    KMCDebugger_AssertBool(m_active, "deactivating deactive site. ", info());
-    KMCDebugger_AssertBool(!isSurface(), "deactivating a surface. (should always be deactive)", info());
 
-    m_totalActiveParticles(particleState())--;
-    m_totalDeactiveParticles(particleState())++;
+    KMCDebugger_AssertBool(m_visitedSite == NULL, "changing the neighbors of a site visited in parallel", info());
 
+    //Set up along with the neighborhood, see initializeCrystalNeighborCounts().
+    if (m_shared->tables->neighborhoodOffsets.n_elem == 0)
+    {
+        return;
+    }
 
-    m_active = false;
+    const int separation = std::min(DiffusionReaction::separation(), m_shared->nNeighborsLimit);
 
+    const int range = std::max(separation, 1);
 
-    informNeighborhoodOnChange(-1);
+    const uint width = 2*range + 1;
 
-}
+    const int * dx = neighborhoodOffsets(0) + m_shared->nNeighborsLimit - range;
+    const int * dy = neighborhoodOffsets(1) + m_shared->nNeighborsLimit - range;
+    const int * dz = neighborhoodOffsets(2) + m_shared->nNeighborsLimit - range;
 
+    Site * neighbor;
+    int distance;
 
-void Site::introduceNeighborhood()
-{
+    for (uint i = 0; i < width; ++i)
+    {
 
-    KMCDebugger_Assert(m_nNeighborsLimit, !=, 0, "Neighborlimit must be greater than zero.", info());
-    KMCDebugger_Assert(m_nNeighborsLimit, !=, KMCSolver::UNSET_UINT, "Neighborlimit is not set.", str());
+        if (dx[i] == BLOCKED_NEIGHBOR)
+        {
+            continue;
+        }
 
+        for (uint j = 0; j < width; ++j)
+        {
 
-    uint xTrans, yTrans, zTrans;
+            if (dy[j] == BLOCKED_NEIGHBOR)
+            {
+                continue;
+            }
 
-    Site * neighbor;
+            for (uint k = 0; k < width; ++k)
+            {
 
+                if (dz[k] == BLOCKED_NEIGHBOR)
+                {
+                    continue;
+                }
 
-    m_nNeighbors.zeros(m_nNeighborsLimit);
+                neighbor = this + dx[i] + dy[j] + dz[k];
 
-    Boundary::setupCurrentBoundaries(x(), y(), z());
+                if (neighbor == this)
+                {
+                    continue;
+                }
 
-    m_neighborhood = new Site***[m_neighborhoodLength];
+                distance = std::max({std::abs((int)i - range), std::abs((int)j - range), std::abs((int)k - range)});
 
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
-    {
+                if (distance == 1)
+                {
+                    neighbor->m_nCrystalNeighbors += crystalChange;
+                    neighbor->m_nFixedCrystalNeighbors += fixedCrystalChange;
+                }
 
-        xTrans = Boundary::currentBoundaries(0)->transformCoordinate((int)m_x + m_originTransformVector(i));
+                if (distance <= separation)
+                {
+                    neighbor->m_nCrystalNeighborsWithinSeparation += crystalChange;
+                }
 
-        m_neighborhood[i] = new Site**[m_neighborhoodLength];
+            }
+        }
+    }
 
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
-        {
+}
 
-            yTrans = Boundary::currentBoundaries(1)->transformCoordinate((int)m_y + m_originTransformVector(j));
+bool Site::keepsStateAgainst(const int newState)
+{
 
-            m_neighborhood[i][j] = new Site*[m_neighborhoodLength];
+    if (newState == ParticleStates::surface)
+    {
+        //Deactive solution sites are always turned, active ones only if they crystallize.
+        return m_particleState == ParticleStates::solution && isActive() && !qualifiesAsCrystal();
+    }
 
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
-            {
+    else if (newState == ParticleStates::solution)
+    {
+        return (isSurface() && qualifiesAsSurface()) || (isCrystal() && qualifiesAsCrystal());
+    }
 
-                zTrans = Boundary::currentBoundaries(2)->transformCoordinate((int)m_z + m_originTransformVector(k));
+    return false;
 
-                if (Boundary::isBlocked(xTrans, yTrans, zTrans))
-                {
-                    m_neighborhood[i][j][k] = NULL;
-                }
+}
 
-                else
-                {
+void Site::setupNeighborhoodOffsets()
+{
 
-                    neighbor = m_solver->getSite(xTrans, yTrans, zTrans);
+    KMCDebugger_Assert(m_shared->neighborhoodLength, !=, KMCSolver::UNSET_UINT, "Neighborlimit is not set.");
 
-                    m_neighborhood[i][j][k] = neighbor;
+    uvec3 N = {NX(), NY(), NZ()};
+    uvec3 strides = {NY()*NZ(), NZ(), 1};
 
-                    if (neighbor != this)
-                    {
+    unshareTables();
 
-                        KMCDebugger_AssertBool(!(i == Site::nNeighborsLimit() && j == Site::nNeighborsLimit() && k == Site::nNeighborsLimit()));
-                        KMCDebugger_AssertBool(!(neighbor->x() == x() && neighbor->y() == y() && neighbor->z() == z()));
-                        KMCDebugger_AssertBool(!(xTrans == x() && yTrans == y() && zTrans == z()));
+    m_shared->tables->neighborhoodOffsets.set_size(3);
 
-                        if (neighbor->isActive())
-                        {
+    for (uint xyz = 0; xyz < 3; ++xyz)
+    {
+
+        imat & offsets = m_shared->tables->neighborhoodOffsets(xyz);
 
-                            uint level = m_levelMatrix(i, j, k);
+        offsets.set_size(m_shared->neighborhoodLength, N(xyz));
 
-                            m_nNeighbors(level)++;
+        const uint n = N(xyz);
 
-                            m_nNeighborsSum++;
+        KMCSolver * solver = m_solver;
 
-                            double dE = DiffusionReaction::potential(i,  j,  k);
+        //Each column is written by one thread, with its own current boundaries.
+#pragma omp parallel
+        {
+            solver->makeCurrent();
 
-                            m_energy += dE;
+#pragma omp for schedule(static)
+            for (uint xi = 0; xi < n; ++xi)
+            {
 
-                            m_totalEnergy += dE;
+                //The boundary in use depends only on the coordinate along this axis.
+                Boundary::setupCurrentBoundaries(xi, xi, xi);
 
-                        }
+                for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
+                {
 
+                    const uint xTrans = Boundary::currentBoundaries(xyz)->transformCoordinate((int)xi + m_shared->tables->originTransformVector(i));
+
+                    if (Boundary::isBlocked(xTrans))
+                    {
+                        offsets(i, xi) = BLOCKED_NEIGHBOR;
+                    }
+
+                    else
+                    {
+                        offsets(i, xi) = ((int)xTrans - (int)xi)*(int)strides(xyz);
                     }
-                }
 
+                }
             }
         }
     }
 
 }
 
-void Site::propagateToNeighbors(int reqOldState, int newState, int range)
+template<uint R>
+void Site::propagateToNeighborsKernel(int reqOldState, int newState, int range)
 {
 
-    Site *nextNeighbor;
-
     KMCDebugger_Assert(range, <=, (int)Site::nNeighborsLimit(), "cannot propagate information beyond neighbor limit.");
 
+    const uint r = R == 0 ? range : R;
+
+    const uint width = 2*r + 1;
+
+    const int * dx = neighborhoodOffsets(0) + m_shared->nNeighborsLimit - r;
+    const int * dy = neighborhoodOffsets(1) + m_shared->nNeighborsLimit - r;
+    const int * dz = neighborhoodOffsets(2) + m_shared->nNeighborsLimit - r;
+
     bool acceptAnything = reqOldState == ParticleStates::any;
 
-    for (int i = -range; i <= range; ++i)
+    Site *nextNeighbor;
+
+    for (uint i = 0; i < width; ++i)
     {
-        for (int j = -range; j <= range; ++j)
+
+        if (dx[i] == BLOCKED_NEIGHBOR)
         {
-            for (int k = -range; k <= range; ++k)
+            continue;
+        }
+
+        for (uint j = 0; j < width; ++j)
+        {
+
+            if (dy[j] == BLOCKED_NEIGHBOR)
             {
+                continue;
+            }
 
-                nextNeighbor = neighborhood(i + Site::nNeighborsLimit(),
-                                            j + Site::nNeighborsLimit(),
-                                            k + Site::nNeighborsLimit());
+            for (uint k = 0; k < width; ++k)
+            {
 
-                if (nextNeighbor == NULL)
+                if (dz[k] == BLOCKED_NEIGHBOR)
                 {
                     continue;
                 }
 
-                else if (nextNeighbor == this)
+                nextNeighbor = this + dx[i] + dy[j] + dz[k];
+
+                if (nextNeighbor == this)
                 {
-                    assert(i == j && j == k && k == 0);
+                    assert(i == j && j == k && k == r);
                     continue;
                 }
 
@@ -946,6 +1609,11 @@ void Site::propagateToNeighbors(int reqOldState, int newState, int range)
 
                 else if (nextNeighbor->particleState() == reqOldState || acceptAnything)
                 {
+                    if (nextNeighbor->keepsStateAgainst(newState))
+                    {
+                        continue;
+                    }
+
                     nextNeighbor->setParticleState(newState);
                 }
 
@@ -955,35 +1623,90 @@ void Site::propagateToNeighbors(int reqOldState, int newState, int range)
 
 }
 
-void Site::informNeighborhoodOnChange(int change)
+void Site::propagateToNeighbors(int reqOldState, int newState, int range)
+{
+
+    KMCDebugger_AssertBool(m_visitedSite == NULL, "changing the neighbors of a site visited in parallel", info());
+
+    switch (range)
+    {
+    case 1:
+        propagateToNeighborsKernel<1>(reqOldState, newState, range);
+        break;
+    case 2:
+        propagateToNeighborsKernel<2>(reqOldState, newState, range);
+        break;
+    case 3:
+        propagateToNeighborsKernel<3>(reqOldState, newState, range);
+        break;
+    case 4:
+        propagateToNeighborsKernel<4>(reqOldState, newState, range);
+        break;
+    default:
+        propagateToNeighborsKernel<0>(reqOldState, newState, range);
+        break;
+    }
+
+}
+
+template<uint L>
+void Site::informNeighborhoodOnChangeKernel(int change)
 {
 
+    const uint length = L == 0 ? m_shared->neighborhoodLength : 2*L + 1;
+
+    const int * dx = neighborhoodOffsets(0);
+    const int * dy = neighborhoodOffsets(1);
+    const int * dz = neighborhoodOffsets(2);
+
+    //The level and distance class matrices share the column-major neighborhood layout.
+    const uword * levels = m_shared->tables->levelMatrix.memptr();
+    const uword * distanceClasses = m_shared->tables->distanceClassMatrix.memptr();
+
     Site *neighbor;
+    uint n;
     uint level;
-    double dE;
+    uint distanceClass;
 
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
+    //Only the closer levels decide where particles may move.
+    const uint separation = DiffusionReaction::separation();
+
+    for (uint i = 0; i < length; ++i)
     {
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
+
+        if (dx[i] == BLOCKED_NEIGHBOR)
         {
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
+            continue;
+        }
+
+        for (uint j = 0; j < length; ++j)
+        {
+
+            if (dy[j] == BLOCKED_NEIGHBOR)
             {
+                continue;
+            }
 
-                neighbor = neighborhood(i, j, k);
+            for (uint k = 0; k < length; ++k)
+            {
 
-                if (neighbor == NULL)
+                if (dz[k] == BLOCKED_NEIGHBOR)
                 {
                     continue;
                 }
 
-                else if (neighbor == this) {
-                    assert(i == j && j == k && k == m_nNeighborsLimit);
+                neighbor = this + dx[i] + dy[j] + dz[k];
+
+                if (neighbor == this) {
+                    assert(i == j && j == k && k == m_shared->nNeighborsLimit);
                     continue;
                 }
 
                 KMCDebugger_AssertBool(!((change < 0) && (neighbor->nNeighborsSum() == 0)), "Call initiated to set negative nNeighbors.", neighbor->info());
 
-                level = m_levelMatrix(i, j, k);
+                n = i + length*(j + length*k);
+
+                level = levels[n];
 
                 KMCDebugger_AssertBool(!((change < 0) && (neighbor->nNeighbors(level) == 0)), "Call initiated to set negative neighbor.", neighbor->info());
 
@@ -991,11 +1714,18 @@ void Site::informNeighborhoodOnChange(int change)
                 neighbor->m_nNeighborsSum += change;
 
 
-                dE = change*DiffusionReaction::potential(i,  j,  k);
+                distanceClass = distanceClasses[n];
+
+                neighbor->m_distanceClassCounts(distanceClass) += change;
+
+                m_shared->totalDistanceClassCounts(distanceClass) += change;
 
-                neighbor->m_energy += dE;
+                neighbor->m_energyIsStale = true;
 
-                m_totalEnergy += dE;
+                if (level < separation)
+                {
+                    neighbor->updateDestinationStatus();
+                }
 
             }
         }
@@ -1004,44 +1734,77 @@ void Site::informNeighborhoodOnChange(int change)
 
 }
 
+void Site::informNeighborhoodOnChange(int change)
+{
+
+    KMCDebugger_AssertBool(m_visitedSite == NULL, "changing the neighbors of a site visited in parallel", info());
+
+    switch (m_shared->nNeighborsLimit)
+    {
+    case 1:
+        informNeighborhoodOnChangeKernel<1>(change);
+        break;
+    case 2:
+        informNeighborhoodOnChangeKernel<2>(change);
+        break;
+    case 3:
+        informNeighborhoodOnChangeKernel<3>(change);
+        break;
+    case 4:
+        informNeighborhoodOnChangeKernel<4>(change);
+        break;
+    default:
+        informNeighborhoodOnChangeKernel<0>(change);
+        break;
+    }
+
+}
+
 void Site::queueAffectedSites()
 {
+
+    if (m_solver->isPlacingInBulk())
+    {
+        return;
+    }
+
     forEachNeighborDo([] (Site * neighbor)
     {
         {
             if (neighbor->isActive())
             {
 
-                for (Reaction * reaction : neighbor->reactions())
+                //The default flag triumphs over any other.
+                if (neighbor->m_nReactions != 0)
                 {
-                    reaction->registerUpdateFlag(Reaction::defaultUpdateFlag);
+                    ReactionFields & fields = neighbor->reactionFields();
+
+                    for (uint slot = 0; slot < neighbor->m_nReactions; ++slot)
+                    {
+                        fields.updateFlag[slot] = Reaction::defaultUpdateFlag;
+                    }
                 }
 
-                m_affectedSites.insert(neighbor);
+                neighbor->queueAsAffected();
             }
         }
     });
 }
 
 
-//! Sets the site energy to zero. Used to avoid round-off error zeros.
-void Site::setZeroEnergy()
-{
-    KMCDebugger_Assert(m_nNeighborsSum, ==, 0, "Energy is not zero.", info());
-    m_energy = 0;
-}
-
 void Site::reset()
 {
 
     if (isActive())
     {
-        m_totalActiveSites--;
+        m_shared->totalActiveSites--;
+
+        removeFromActiveSites();
 
         m_active = false;
 
-        m_totalActiveParticles(particleState())--;
-        m_totalDeactiveParticles(particleState())++;
+        m_shared->totalActiveParticles(particleState())--;
+        m_shared->totalDeactiveParticles(particleState())++;
 
     }
 
@@ -1054,57 +1817,68 @@ void Site::reset()
 
     m_cannotCrystallize = false;
 
-    m_totalDeactiveParticles(particleState())--;
+    m_shared->totalDeactiveParticles(particleState())--;
 
     m_particleState = ParticleStates::solution;
 
-    m_totalDeactiveParticles(ParticleStates::solution)++;
+    m_shared->totalDeactiveParticles(ParticleStates::solution)++;
 
     m_nNeighbors.zeros();
 
-    m_totalEnergy -= m_energy;
-
     m_nNeighborsSum = 0;
 
-    setZeroEnergy();
+    m_shared->totalDistanceClassCounts -= m_distanceClassCounts;
+
+    m_distanceClassCounts.zeros();
 
+    updateEnergy();
+
+
+    if (m_solver->reactionsFollowParticles())
+    {
+        clearAllReactions();
+    }
 
-    for (Reaction * reaction : reactions())
+    for (DiffusionReaction * reaction : reactions())
     {
         reaction->reset();
     }
 
 }
 
-void Site::clearNeighborhood()
+void Site::removeFromActiveSites()
 {
 
-    m_totalEnergy -= m_energy;
+    KMCDebugger_Assert(m_solver->activeSites().at(m_activeSiteIndex), ==, this, "Active site list is out of date.", info());
 
-    m_energy = 0;
+    Site * moved = m_solver->removeActiveSite(m_activeSiteIndex);
 
+    moved->m_activeSiteIndex = m_activeSiteIndex;
 
-    m_nNeighbors.reset();
+    m_activeSiteIndex = NO_PARTICLE;
 
-    m_nNeighborsSum = 0;
+}
 
+void Site::clearNeighborhood()
+{
 
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
+    if (m_distanceClassCounts.n_elem == m_shared->totalDistanceClassCounts.n_elem)
     {
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
-        {
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
-            {
-                m_neighborhood[i][j][k] = NULL;
-            }
+        m_shared->totalDistanceClassCounts -= m_distanceClassCounts;
+    }
 
-            delete [] m_neighborhood[i][j];
-        }
+    m_distanceClassCounts.reset();
 
-        delete [] m_neighborhood[i];
-    }
+    m_energy = 0;
+
+    m_boltzmannFactor = 1;
+
+    m_energyIsStale = false;
 
-    delete [] m_neighborhood;
+
+    m_nNeighbors.reset();
+
+    m_nNeighborsSum = 0;
 
 }
 
@@ -1183,22 +1957,21 @@ umat Site::getCurrentCrystalBoxTopology()
 void Site::clearAll()
 {
 
-    m_nNeighborsToCrystallize = KMCSolver::UNSET_UINT;
-    m_nNeighborsLimit = KMCSolver::UNSET_UINT;
-    m_neighborhoodLength = KMCSolver::UNSET_UINT;
+    m_shared->nNeighborsToCrystallize = KMCSolver::UNSET_UINT;
+    m_shared->nNeighborsLimit = KMCSolver::UNSET_UINT;
+    m_shared->neighborhoodLength = KMCSolver::UNSET_UINT;
 
-    m_totalActiveSites = 0;
-    m_totalEnergy = 0;
-    m_totalActiveParticles.zeros();
-    m_totalDeactiveParticles.zeros();
-    m_levelMatrix.reset();
-    m_originTransformVector.reset();
+    m_shared->totalActiveSites = 0;
+    m_shared->totalDistanceClassCounts.reset();
+    m_shared->totalActiveParticles.zeros();
+    m_shared->totalDeactiveParticles.zeros();
+    m_shared->tables = make_shared<Tables>();
 
     clearAffectedSites();
     clearBoundaries();
 
-    m_boundaryConfigs.clear();
-    m_boundaryTypes.clear();
+    m_shared->boundaryConfigs.clear();
+    m_shared->boundaryTypes.clear();
 
 }
 
@@ -1255,11 +2028,11 @@ void Site::clearBoundaries()
     {
         for (uint j = 0; j < 2; ++j)
         {
-            delete m_boundaries(i, j);
+            delete m_shared->boundaries(i, j);
         }
     }
 
-    m_boundaries.clear();
+    m_shared->boundaries.clear();
 }
 
 void Site::finalizeBoundaries()
@@ -1268,19 +2041,39 @@ void Site::finalizeBoundaries()
     {
         for (uint j = 0; j < 2; ++j)
         {
-            m_boundaries(i, j)->finalize();
+            m_shared->boundaries(i, j)->finalize();
         }
     }
 }
 
 void Site::clearAffectedSites()
 {
-    m_affectedSites.clear();
+    m_shared->affectedSites.clear();
+
+    //Stamps from the previous lap of the epoch would be taken as current.
+    if (++m_shared->affectedEpoch == 0)
+    {
+        m_solver->forEachSiteDo([] (Site * site)
+        {
+            site->m_affectedStamp = 0;
+        });
+
+        m_shared->affectedEpoch = 1;
+    }
 }
 
-void Site::setZeroTotalEnergy()
+double Site::totalEnergy()
 {
-    m_totalEnergy = 0;
+
+    double totalEnergy = 0;
+
+    for (uint distanceClass = 0; distanceClass < m_shared->totalDistanceClassCounts.n_elem; ++distanceClass)
+    {
+        totalEnergy += m_shared->totalDistanceClassCounts(distanceClass)*DiffusionReaction::distanceClassPotential()(distanceClass);
+    }
+
+    return totalEnergy;
+
 }
 
 
@@ -1317,15 +2110,15 @@ const string Site::info(int xr, int yr, int zr, string desc) const
     uint _min = ParticleStates::surface + 1;
 
     ucube nN;
-    nN.copy_size(m_levelMatrix);
+    nN.copy_size(m_shared->tables->levelMatrix);
     nN.fill(_min);
 
     Site * currentSite;
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
+    for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
     {
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
+        for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
         {
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
+            for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
             {
 
                 currentSite = neighborhood(i, j, k);
@@ -1365,9 +2158,9 @@ const string Site::info(int xr, int yr, int zr, string desc) const
     umat A;
     stringstream ss;
 
-    for (int j = m_neighborhoodLength - 1; j >= 0; --j)
+    for (int j = m_shared->neighborhoodLength - 1; j >= 0; --j)
     {
-        for(uint i = 0; i < m_neighborhoodLength; ++i)
+        for(uint i = 0; i < m_shared->neighborhoodLength; ++i)
         {
             A = nN.slice(i).t();
 
@@ -1378,7 +2171,7 @@ const string Site::info(int xr, int yr, int zr, string desc) const
                 ss << val << " ";
             }
 
-            if (i != m_neighborhoodLength - 1) ss << " | ";
+            if (i != m_shared->neighborhoodLength - 1) ss << " | ";
         }
 
         ss << "\n";
@@ -1453,35 +2246,117 @@ void Site::setInitialNNeighborsLimit(const uint &nNeighborsLimit, bool check)
     }
 
 
-    m_nNeighborsLimit = nNeighborsLimit;
+    unshareTables();
+
+    m_shared->nNeighborsLimit = nNeighborsLimit;
 
-    m_neighborhoodLength = 2*m_nNeighborsLimit + 1;
+    m_shared->neighborhoodLength = 2*m_shared->nNeighborsLimit + 1;
 
-    m_levelMatrix.set_size(m_neighborhoodLength, m_neighborhoodLength, m_neighborhoodLength);
+    m_shared->tables->levelMatrix.set_size(m_shared->neighborhoodLength, m_shared->neighborhoodLength, m_shared->neighborhoodLength);
 
-    m_originTransformVector = linspace<ivec>(-(int)m_nNeighborsLimit, m_nNeighborsLimit, m_neighborhoodLength);
+    m_shared->tables->originTransformVector = linspace<ivec>(-(int)m_shared->nNeighborsLimit, m_shared->nNeighborsLimit, m_shared->neighborhoodLength);
 
-    for (uint i = 0; i < m_neighborhoodLength; ++i)
+    for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
     {
-        for (uint j = 0; j < m_neighborhoodLength; ++j)
+        for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
         {
-            for (uint k = 0; k < m_neighborhoodLength; ++k)
+            for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
             {
-                if (i == m_nNeighborsLimit && j == m_nNeighborsLimit && k == m_nNeighborsLimit)
+                if (i == m_shared->nNeighborsLimit && j == m_shared->nNeighborsLimit && k == m_shared->nNeighborsLimit)
                 {
-                    m_levelMatrix(i, j, k) = m_nNeighborsLimit + 1;
+                    m_shared->tables->levelMatrix(i, j, k) = m_shared->nNeighborsLimit + 1;
                     continue;
                 }
 
-                m_levelMatrix(i, j, k) = getLevel(std::abs(m_originTransformVector(i)),
-                                                  std::abs(m_originTransformVector(j)),
-                                                  std::abs(m_originTransformVector(k)));
+                m_shared->tables->levelMatrix(i, j, k) = getLevel(std::abs(m_shared->tables->originTransformVector(i)),
+                                                  std::abs(m_shared->tables->originTransformVector(j)),
+                                                  std::abs(m_shared->tables->originTransformVector(k)));
             }
         }
     }
 
+    setupUpdateShell();
+
+    setupDistanceClasses();
+
     DiffusionReaction::setupPotential();
 
+    DiffusionReaction::setupUpdateFlagStencil();
+
+}
+
+void Site::unshareTables()
+{
+    //Solvers copied from this one keep reading the old tables.
+    if (m_shared->tables.use_count() > 1)
+    {
+        m_shared->tables = make_shared<Tables>(*m_shared->tables);
+    }
+}
+
+void Site::setupDistanceClasses()
+{
+
+    vector<uint> squaredDistances;
+
+    ivec3 r;
+
+    for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
+    {
+        for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
+        {
+            for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
+            {
+                r = {m_shared->tables->originTransformVector(i), m_shared->tables->originTransformVector(j), m_shared->tables->originTransformVector(k)};
+
+                squaredDistances.push_back(r(0)*r(0) + r(1)*r(1) + r(2)*r(2));
+            }
+        }
+    }
+
+    vector<uint> classes = squaredDistances;
+
+    sort(classes.begin(), classes.end());
+
+    classes.erase(unique(classes.begin(), classes.end()), classes.end());
+
+    //The site itself, at squared distance zero, is not a class.
+    classes.erase(classes.begin());
+
+    m_shared->tables->distanceClassMatrix.set_size(m_shared->neighborhoodLength, m_shared->neighborhoodLength, m_shared->neighborhoodLength);
+
+    m_shared->tables->distanceClassMultiplicities.zeros(classes.size());
+
+    uint n = 0;
+
+    for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
+    {
+        for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
+        {
+            for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
+            {
+
+                if (squaredDistances.at(n) == 0)
+                {
+                    m_shared->tables->distanceClassMatrix(i, j, k) = classes.size();
+                    n++;
+                    continue;
+                }
+
+                uint distanceClass = lower_bound(classes.begin(), classes.end(), squaredDistances.at(n)) - classes.begin();
+
+                m_shared->tables->distanceClassMatrix(i, j, k) = distanceClass;
+
+                m_shared->tables->distanceClassMultiplicities(distanceClass)++;
+
+                n++;
+
+            }
+        }
+    }
+
+    m_shared->totalDistanceClassCounts.zeros(classes.size());
+
 }
 
 void Site::setInitialNNeighborsToCrystallize(const uint &nNeighborsToCrystallize)
@@ -1498,7 +2373,7 @@ void Site::setInitialNNeighborsToCrystallize(const uint &nNeighborsToCrystallize
         KMCSolver::exit();
     }
 
-    m_nNeighborsToCrystallize = nNeighborsToCrystallize;
+    m_shared->nNeighborsToCrystallize = nNeighborsToCrystallize;
 
 }
 
@@ -1510,27 +2385,38 @@ void Site::setNewParticleState(int newState)
     if (isActive())
     {
 
-        KMCDebugger_Assert(m_totalActiveParticles(particleState()), !=, 0, "trying to reduce particle type count below zero", info());
+        KMCDebugger_Assert(m_shared->totalActiveParticles(particleState()), !=, 0, "trying to reduce particle type count below zero", info());
 
-        m_totalActiveParticles(particleState())--;
+        m_shared->totalActiveParticles(particleState())--;
 
-        m_totalActiveParticles(newState)++;
+        m_shared->totalActiveParticles(newState)++;
 
     }
 
     else
     {
 
-        KMCDebugger_Assert(m_totalDeactiveParticles(particleState()), !=, 0, "trying to reduce particle type count below zero", info());
+        KMCDebugger_Assert(m_shared->totalDeactiveParticles(particleState()), !=, 0, "trying to reduce particle type count below zero", info());
 
-        m_totalDeactiveParticles(particleState())--;
+        m_shared->totalDeactiveParticles(particleState())--;
 
-        m_totalDeactiveParticles(newState)++;
+        m_shared->totalDeactiveParticles(newState)++;
 
     }
 
+    const int crystalChange = (int)(newState == ParticleStates::crystal || newState == ParticleStates::fixedCrystal) - (int)isCrystal();
+
+    const int fixedCrystalChange = (int)(newState == ParticleStates::fixedCrystal) - (int)(m_particleState == ParticleStates::fixedCrystal);
+
     m_particleState = newState;
 
+    if (crystalChange != 0 || fixedCrystalChange != 0)
+    {
+        informNeighborhoodOnCrystalChange(crystalChange, fixedCrystalChange);
+    }
+
+    updateDestinationStatus();
+
     KMCDebugger_PushImplication(this, particleStateName().c_str());
 
 }
@@ -1538,40 +2424,40 @@ void Site::setNewParticleState(int newState)
 void Site::setInitialBoundaries(const umat &boundaryMatrix)
 {
 
-    m_boundaryTypes = boundaryMatrix;
+    m_shared->boundaryTypes = boundaryMatrix;
 
-    m_boundaries.set_size(3, 2);
+    m_shared->boundaries.set_size(3, 2);
 
     for (uint XYZ = 0; XYZ < 3; ++XYZ)
     {
         for (uint orientation = 0; orientation < 2; ++orientation)
         {
 
-            switch (m_boundaryTypes(XYZ, orientation))
+            switch (m_shared->boundaryTypes(XYZ, orientation))
             {
             case Boundary::Periodic:
-                m_boundaries(XYZ, orientation) = new Periodic(XYZ, orientation);
+                m_shared->boundaries(XYZ, orientation) = new Periodic(XYZ, orientation);
 
                 break;
 
             case Boundary::Edge:
-                m_boundaries(XYZ, orientation) = new Edge(XYZ, orientation);
+                m_shared->boundaries(XYZ, orientation) = new Edge(XYZ, orientation);
 
                 break;
 
             case Boundary::Surface:
-                m_boundaries(XYZ, orientation) = new Surface(XYZ, orientation);
+                m_shared->boundaries(XYZ, orientation) = new Surface(XYZ, orientation);
 
                 break;
 
             case Boundary::ConcentrationWall:
-                m_boundaries(XYZ, orientation) = new ConcentrationWall(XYZ, orientation);
+                m_shared->boundaries(XYZ, orientation) = new ConcentrationWall(XYZ, orientation);
 
                 break;
 
             default:
 
-                cerr << "Unknown boundary type " << m_boundaryTypes(XYZ, orientation) << endl;
+                cerr << "Unknown boundary type " << m_shared->boundaryTypes(XYZ, orientation) << endl;
                 KMCSolver::exit();
 
                 break;
@@ -1579,9 +2465,9 @@ void Site::setInitialBoundaries(const umat &boundaryMatrix)
 
         }
 
-        if (!Boundary::isCompatible(m_boundaryTypes(XYZ, 0), m_boundaryTypes(XYZ, 1)))
+        if (!Boundary::isCompatible(m_shared->boundaryTypes(XYZ, 0), m_shared->boundaryTypes(XYZ, 1)))
         {
-            cerr << "Mismatch in boundaries for " << XYZ << "'th dimension: " << m_boundaryTypes.t();
+            cerr << "Mismatch in boundaries for " << XYZ << "'th dimension: " << m_shared->boundaryTypes.t();
             KMCSolver::exit();
         }
     }
@@ -1634,37 +2520,30 @@ const uint &Site::NZ()
 
 
 
-KMCSolver* Site::m_solver;
-
-uint       Site::m_nNeighborsToCrystallize = KMCSolver::UNSET_UINT;
-
-uint       Site::m_nNeighborsLimit = KMCSolver::UNSET_UINT;
-
-uint       Site::m_neighborhoodLength = KMCSolver::UNSET_UINT;
-
-
-ucube      Site::m_levelMatrix;
-
-ivec       Site::m_originTransformVector;
-
-
-uint       Site::m_totalActiveSites = 0;
-
-uvec4      Site::m_totalActiveParticles;
-
-uvec4      Site::m_totalDeactiveParticles;
+Site::Shared::Shared() :
+    nNeighborsLimit(KMCSolver::UNSET_UINT),
+    neighborhoodLength(KMCSolver::UNSET_UINT),
+    nNeighborsToCrystallize(KMCSolver::UNSET_UINT),
+    tables(make_shared<Tables>()),
+    totalActiveSites(0),
+    affectedEpoch(1)
+{
+    totalActiveParticles.zeros();
+    totalDeactiveParticles.zeros();
+}
 
-double     Site::m_totalEnergy = 0;
 
+thread_local KMCSolver*    Site::m_solver = NULL;
 
-set<Site*> Site::m_affectedSites;
+thread_local Site::Shared* Site::m_shared = NULL;
 
+thread_local const Site * Site::m_visitedSite = NULL;
 
-field<Boundary*> Site::m_boundaries;
+const uint Site::nReactionSlots;
 
-field<const Setting*> Site::m_boundaryConfigs;
+const uint Site::NO_PARTICLE;
 
-umat Site::m_boundaryTypes;
+const int  Site::BLOCKED_NEIGHBOR;
 
 
 
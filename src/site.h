@@ -2,11 +2,16 @@
 
 #include "particlestates.h"
 
+#include "reactions/diffusion/diffusionreaction.h"
+
+#include "debugger/debugger.h"
+
 #include <vector>
-#include <set>
+#include <memory>
 #include <sys/types.h>
 #include <armadillo>
 #include <assert.h>
+#include <climits>
 
 #include <libconfig_utils/libconfig_utils.h>
 
@@ -20,9 +25,83 @@ namespace kMC
 
 class KMCSolver;
 class Reaction;
-class DiffusionReaction;
 class Boundary;
 
+
+//! A site's reactions, stored consecutively in a block of the solver's reaction table.
+class SiteReactions
+{
+public:
+
+    class iterator
+    {
+    public:
+
+        iterator(DiffusionReaction * reaction) :
+            m_reaction(reaction)
+        {
+
+        }
+
+        DiffusionReaction * operator * () const
+        {
+            return m_reaction;
+        }
+
+        iterator & operator ++ ()
+        {
+            ++m_reaction;
+            return *this;
+        }
+
+        bool operator != (const iterator & other) const
+        {
+            return m_reaction != other.m_reaction;
+        }
+
+    private:
+
+        DiffusionReaction * m_reaction;
+
+    };
+
+    SiteReactions(DiffusionReaction * first, const uint n) :
+        m_first(first),
+        m_n(n)
+    {
+
+    }
+
+    iterator begin() const
+    {
+        return iterator(m_first);
+    }
+
+    iterator end() const
+    {
+        return iterator(m_first + m_n);
+    }
+
+    uint size() const
+    {
+        return m_n;
+    }
+
+    DiffusionReaction * at(const uint i) const
+    {
+        KMCDebugger_Assert(i, <, m_n, "Reaction slot out of range.");
+        return m_first + i;
+    }
+
+private:
+
+    DiffusionReaction * m_first;
+
+    const uint m_n;
+
+};
+
+
 class Site
 {
 public:
@@ -31,11 +110,108 @@ public:
 
     ~Site();
 
+    //! One slot for each closest neighbor. A site's reactions are stored in consecutive
+    //! slots of a block in the solver's reaction table, and their rates, saddle factors
+    //! and update flags in the matching slots of the block's ReactionFields.
+    const static uint nReactionSlots = ReactionFields::nSlots;
+
+    //! Below this many affected sites, rates are updated on a single thread.
+    const static int minAffectedSitesInParallel = 1024;
+
+    //! Particle index of a site which holds no reaction block.
+    const static uint NO_PARTICLE = UINT_MAX;
+
+    //! Marks neighborhood offsets which are blocked by the boundaries.
+    static const int BLOCKED_NEIGHBOR = INT_MIN;
+
+    //! The bit of the closest neighbor at (dx, dy, dz) in the allowed direction masks.
+    static uint directionIndex(const int dx, const int dy, const int dz)
+    {
+        const uint n = (dx + 1) + 3*((dy + 1) + 3*(dz + 1));
+
+        //The site itself is at 13.
+        return n < 13 ? n : n - 1;
+    }
+
+    //! The neighborhood tables, which follow from the neighbor reach, the box size and
+    //! the boundaries. They are read-only once set up, and shared by the solvers copied
+    //! from one another; a solver which sets them up again first takes a copy of its own.
+    struct Tables
+    {
+        ucube levelMatrix;
+
+        ucube distanceClassMatrix;
+
+        uvec distanceClassMultiplicities;
+
+        ivec originTransformVector;
+
+        //! Each row locates a site in the shell just outside the neighborhood: Its closest
+        //! neighbor inside the neighborhood (columns 0-2), the shell site's position in the
+        //! neighborhood of that neighbor (columns 3-5) and in the update stencil (columns 6-8).
+        umat updateShell;
+
+        //! Per axis, the index offset from a site at coordinate xi to its neighbor at
+        //! neighborhood position i is stored at (i, xi). Shared by all sites.
+        field<imat> neighborhoodOffsets;
+    };
+
+    //! The state shared by all sites of one solver. Each solver owns one, and
+    //! KMCSolver::makeCurrent() points the calling thread at it.
+    struct Shared
+    {
+        Shared();
+
+        field<Boundary*> boundaries;
+
+        field<const Setting*> boundaryConfigs;
+
+        umat boundaryTypes;
+
+
+        uint nNeighborsLimit;
+
+        uint neighborhoodLength;
+
+
+        uint nNeighborsToCrystallize;
+
+
+        shared_ptr<Tables> tables;
+
+
+        uint totalActiveSites;
+
+        uvec4 totalActiveParticles;
+
+        uvec4 totalDeactiveParticles;
+
+        //! The total energy is kept as neighbor counts per distance class, so it does not drift.
+        uvec totalDistanceClassCounts;
+
+
+        vector<Site*> affectedSites;
+
+        //! A site is in affectedSites when its stamp equals the current epoch, which is
+        //! advanced each time the list is cleared.
+        uint affectedEpoch;
+
+        //! The allowed reactions of the affected sites, gathered for DiffusionReaction::calcRates().
+        vector<DiffusionReaction*> rateBatch;
+    };
+
     /*
      * Static non-trivial functions
      */
 
-    static void setMainSolver(KMCSolver* solver);
+    static void setMainSolver(KMCSolver* solver, Shared * shared);
+
+    //! Marks the site KMCSolver::forEachSiteDo_inParallel() is visiting on this thread, or
+    //! NULL between visits. Debug builds use it to assert that no other site is changed.
+    static void setVisitedSite(const Site * site)
+    {
+        m_visitedSite = site;
+    }
 
     static void loadConfig(const Setting & setting);
 
@@ -94,8 +270,14 @@ public:
 
     static void finalizeBoundaries();
 
+    //! Recomputes every site's allowed direction masks from scratch.
+    static void initializeAllowedDirections();
 
-    static void setZeroTotalEnergy();
+    //! Recounts the crystal neighbors of every site from scratch.
+    static void initializeCrystalNeighborCounts();
+
+    //! Sums the distance class counts of every site, once all neighborhoods are introduced.
+    static void initializeTotalDistanceClassCounts();
 
     /*
      * Non-trivial functions
@@ -107,6 +289,7 @@ public:
     bool isLegalToSpawn();
 
 
+    //! O(1) from the crystal neighbor counters.
     bool qualifiesAsCrystal();
 
     bool qualifiesAsSurface();
@@ -131,23 +314,29 @@ public:
 
     void deactivate();
 
+    //! Flags all the site's reactions for a full rate recalculation.
+    void registerFullUpdate();
+
     void flipActive();
 
     void flipDeactive();
 
 
-    void addReaction(Reaction* reaction)
-    {
-        m_reactions.push_back(reaction);
-    }
-
     void calculateRates();
 
 
     void initializeDiffusionReactions();
 
+    //! Allocates the reaction block initializeDiffusionReactions() would fill, so that
+    //! the reactions of all sites can be constructed in parallel afterwards.
+    void reserveDiffusionReactions();
+
     void introduceNeighborhood();
 
+    static void setupNeighborhoodOffsets();
+
+
+    //These switch to kernels with the stencil bounds as compile-time constants.
 
     bool hasNeighboring(int state, int range) const;
 
@@ -169,8 +358,6 @@ public:
 
     void queueAffectedSites();
 
-    void setZeroEnergy();
-
     void reset();
 
     void clearNeighborhood();
@@ -179,6 +366,102 @@ public:
     const string info(int xr = 0, int yr = 0, int zr = 0, string desc = "X") const;
 
 
+    //The iteration helpers take any callable, which is inlined into the loop. The
+    //std::function overloads forward to these.
+
+    template<typename Visitor>
+    void forEachNeighborDo(Visitor && visit) const
+    {
+        forEachNeighborDo_sendIndices([&visit] (Site * neighbor, uint i, uint j, uint k)
+        {
+            (void) i;
+            (void) j;
+            (void) k;
+
+            visit(neighbor);
+        });
+    }
+
+    template<typename Visitor>
+    void forEachNeighborDo_sendIndices(Visitor && visit) const
+    {
+
+        const int * dx = neighborhoodOffsets(0);
+        const int * dy = neighborhoodOffsets(1);
+        const int * dz = neighborhoodOffsets(2);
+
+        Site * neighbor;
+
+        for (uint i = 0; i < m_shared->neighborhoodLength; ++i)
+        {
+
+            if (dx[i] == BLOCKED_NEIGHBOR)
+            {
+                continue;
+            }
+
+            for (uint j = 0; j < m_shared->neighborhoodLength; ++j)
+            {
+
+                if (dy[j] == BLOCKED_NEIGHBOR)
+                {
+                    continue;
+                }
+
+                for (uint k = 0; k < m_shared->neighborhoodLength; ++k)
+                {
+
+                    if (dz[k] == BLOCKED_NEIGHBOR)
+                    {
+                        continue;
+                    }
+
+                    neighbor = const_cast<Site*>(this) + dx[i] + dy[j] + dz[k];
+
+                    if (neighbor == this) {
+                        assert(i == j && j == k && k == m_shared->nNeighborsLimit);
+                        continue;
+                    }
+
+                    visit(neighbor, i, j, k);
+
+                }
+            }
+        }
+    }
+
+    template<typename Visitor>
+    void forEachActiveReactionDo(Visitor && visit) const
+    {
+        forEachActiveReactionDo_sendIndex([&visit] (Reaction * reaction, uint i)
+        {
+            (void) i;
+
+            visit(reaction);
+        });
+    }
+
+    template<typename Visitor>
+    void forEachActiveReactionDo_sendIndex(Visitor && visit) const
+    {
+        if (!m_active)
+        {
+            return;
+        }
+
+        uint i = 0;
+
+        for (DiffusionReaction * reaction : reactions())
+        {
+            if (reaction->isAllowed())
+            {
+                visit(reaction, i);
+            }
+
+            i++;
+        }
+    }
+
     void forEachNeighborDo(function<void (Site *)> applyFunction) const;
 
     void forEachNeighborDo_sendIndices(function<void (Site *, uint, uint, uint)> applyFunction) const;
@@ -195,88 +478,108 @@ public:
 
     static const uint & nSurfaces()
     {
-        return m_totalDeactiveParticles.memptr()[ParticleStates::surface];
+        return m_shared->totalDeactiveParticles.memptr()[ParticleStates::surface];
     }
 
     static uint nCrystals()
     {
-        return m_totalActiveParticles(ParticleStates::crystal) + m_totalActiveParticles(ParticleStates::fixedCrystal);
+        return m_shared->totalActiveParticles(ParticleStates::crystal) + m_shared->totalActiveParticles(ParticleStates::fixedCrystal);
     }
 
     static const uint & nSolutionParticles()
     {
-        return m_totalActiveParticles.memptr()[ParticleStates::solution];
+        return m_shared->totalActiveParticles.memptr()[ParticleStates::solution];
     }
 
 
     static const uint &boundaryTypes(const uint i, const uint j = 0)
     {
-        return m_boundaryTypes(i, j);
+        return m_shared->boundaryTypes(i, j);
     }
 
     static const uint &nNeighborsToCrystallize()
     {
-        return m_nNeighborsToCrystallize;
+        return m_shared->nNeighborsToCrystallize;
     }
 
     static const uint &nNeighborsLimit()
     {
-        return m_nNeighborsLimit;
+        return m_shared->nNeighborsLimit;
     }
 
     static const uint &neighborhoodLength()
     {
-        return m_neighborhoodLength;
+        return m_shared->neighborhoodLength;
+    }
+
+    //! The update stencil centered at a changed site spans the neighborhood and the shell
+    //! of sites just outside it.
+    static uint updateStencilLength()
+    {
+        return m_shared->neighborhoodLength + 2;
     }
 
     static const uint &levelMatrix(const uint i, const uint j, const uint k)
     {
-        return m_levelMatrix(i, j, k);
+        return m_shared->tables->levelMatrix(i, j, k);
+    }
+
+    //! Neighbors at the same squared distance contribute equally to the site energy.
+    static const uint &distanceClassMatrix(const uint i, const uint j, const uint k)
+    {
+        return m_shared->tables->distanceClassMatrix(i, j, k);
+    }
+
+    static const uvec &distanceClassMultiplicities()
+    {
+        return m_shared->tables->distanceClassMultiplicities;
+    }
+
+    static uint nDistanceClasses()
+    {
+        return m_shared->tables->distanceClassMultiplicities.n_elem;
     }
 
     static uint originTransformVector(const uint i)
     {
-        return m_originTransformVector(i);
+        return m_shared->tables->originTransformVector(i);
     }
 
     static const uint & totalActiveSites()
     {
-        return m_totalActiveSites;
+        return m_shared->totalActiveSites;
     }
 
     static const uvec4 & totalActiveParticlesVector()
     {
-        return m_totalActiveParticles;
+        return m_shared->totalActiveParticles;
     }
 
     static const uvec4 & totalDeactiveParticlesVector()
     {
-        return m_totalDeactiveParticles;
+        return m_shared->totalDeactiveParticles;
     }
 
     static const uint & totalActiveParticles(const uint i)
     {
-        return m_totalActiveParticles(i);
+        return m_shared->totalActiveParticles(i);
     }
 
     static const uint & totalDeactiveParticles(const uint i)
     {
-        return m_totalDeactiveParticles(i);
+        return m_shared->totalDeactiveParticles(i);
     }
 
-    static const double & totalEnergy()
-    {
-        return m_totalEnergy;
-    }
+    static double totalEnergy();
 
     static const Boundary * boundaries(const uint xyz, const uint loc)
     {
-        return m_boundaries(xyz, loc);
+        return m_shared->boundaries(xyz, loc);
     }
 
     static const field<Boundary*> & boundaryField()
     {
-        return m_boundaries;
+        return m_shared->boundaries;
     }
 
 
@@ -300,8 +603,32 @@ public:
         return m_nNeighbors(level);
     }
 
+    //! Crystal (including fixed crystal) neighbors among the closest neighbors.
+    uint nCrystalNeighbors() const
+    {
+        return m_nCrystalNeighbors;
+    }
+
+    uint nFixedCrystalNeighbors() const
+    {
+        return m_nFixedCrystalNeighbors;
+    }
+
+    //! Crystal (including fixed crystal) neighbors within DiffusionReaction::separation().
+    uint nCrystalNeighborsWithinSeparation() const
+    {
+        return m_nCrystalNeighborsWithinSeparation;
+    }
+
     uint nActiveReactions() const;
 
+    //! Whether a particle here could move to the closest neighbor at the given direction
+    //! index, see DiffusionReaction::isAllowed(). Kept up to date as the neighbors change.
+    bool isAllowedDirection(const uint direction) const
+    {
+        return (m_allowedDirections[m_active] >> direction) & 1;
+    }
+
     uint nNeighborsSum() const;
 
     bool isCrystal() const
@@ -340,27 +667,96 @@ public:
         return m_r(i);
     }
 
-    const vector<Reaction*> & reactions() const
+    const SiteReactions reactions() const;
+
+    //! The slot fields of the site's reactions. Only valid while it holds reactions.
+    ReactionFields & reactionFields() const;
+
+    //! The summed rate of the allowed reactions, read from the slot fields.
+    double rateSum() const;
+
+    //! The slot of the allowed reaction whose share of the cumulative rate, summed in
+    //! slot order, holds R. Round-off in R selects the last allowed reaction.
+    uint selectSlot(const double R) const;
+
+    //! The site's position in KMCSolver::activeSites() while active.
+    const uint & activeSiteIndex() const
+    {
+        return m_activeSiteIndex;
+    }
+
+    const uint & particleIndex() const
     {
-        return m_reactions;
+        return m_particleIndex;
     }
 
-    const static set<Site*> & affectedSites()
+    //! The sites whose rates are to be recalculated, in the order they were affected.
+    const static vector<Site*> & affectedSites()
     {
-        return m_affectedSites;
+        return m_shared->affectedSites;
+    }
+
+    bool isAffected() const
+    {
+        return m_affectedStamp == m_shared->affectedEpoch;
     }
 
     Site* neighborhood(const uint x, const uint y, const uint z) const
     {
-        return m_neighborhood[x][y][z];
+
+        const int & dx = m_shared->tables->neighborhoodOffsets(0).at(x, m_x);
+        const int & dy = m_shared->tables->neighborhoodOffsets(1).at(y, m_y);
+        const int & dz = m_shared->tables->neighborhoodOffsets(2).at(z, m_z);
+
+        if (dx == BLOCKED_NEIGHBOR || dy == BLOCKED_NEIGHBOR || dz == BLOCKED_NEIGHBOR)
+        {
+            return NULL;
+        }
+
+        //Sites are stored contiguously by the solver.
+        return const_cast<Site*>(this) + dx + dy + dz;
+
+    }
+
+    //! The offsets from this site to each position of its neighborhood along axis xyz.
+    const int * neighborhoodOffsets(const uint xyz) const
+    {
+        return m_shared->tables->neighborhoodOffsets(xyz).colptr(m_r(xyz));
+    }
+
+    //! The energy and Boltzmann factor are recomputed on next use.
+    void markEnergyStale()
+    {
+        m_energyIsStale = true;
     }
 
     double energy() const
     {
+        if (m_energyIsStale)
+        {
+            updateEnergy();
+        }
+
         return m_energy;
     }
 
-    const bool & isFixedCrystalSeed()
+    //! exp(-beta*energy()), composed from tabulated factors.
+    double boltzmannFactor() const
+    {
+        if (m_energyIsStale)
+        {
+            updateEnergy();
+        }
+
+        return m_boltzmannFactor;
+    }
+
+    const uvec & distanceClassCounts() const
+    {
+        return m_distanceClassCounts;
+    }
+
+    const bool & isFixedCrystalSeed() const
     {
         return m_isFixedCrystalSeed;
     }
@@ -395,71 +791,132 @@ public:
 
 private:
 
-    static field<Boundary*> m_boundaries;
+    //! R is the range, or zero for a range only known at run time.
+    template<uint R>
+    bool hasNeighboringKernel(int state, int range) const;
+
+    template<uint R>
+    uint countNeighboringKernel(int state, int range) const;
+
+    template<uint R>
+    void propagateToNeighborsKernel(int reqOldState, int newState, int range);
 
-    static field<const Setting*> m_boundaryConfigs;
+    //! L is the neighbor limit, or zero for a limit only known at run time.
+    template<uint L>
+    void informNeighborhoodOnChangeKernel(int change);
 
-    static umat m_boundaryTypes;
 
+    //! The shared state of the current solver on this thread.
+    static thread_local Shared * m_shared;
 
-    static uint m_nNeighborsLimit;
+    static thread_local KMCSolver* m_solver;
 
-    static uint m_neighborhoodLength;
+    static thread_local const Site * m_visitedSite;
+
+    //! Whether the site may change: always, except during a parallel visit of another site.
+    bool isWritable() const
+    {
+        return m_visitedSite == NULL || m_visitedSite == this;
+    }
 
 
-    static uint m_nNeighborsToCrystallize;
+    uvec m_nNeighbors;
+
+    uint m_nNeighborsSum;
+
+
+    bool m_active;
 
+    bool m_isFixedCrystalSeed;
 
-    static ucube m_levelMatrix;
+    bool m_cannotCrystallize;
 
-    static ivec m_originTransformVector;
+    const uint m_x;
+    const uint m_y;
+    const uint m_z;
+    const uvec3 m_r;
 
+    //! The number of active neighbors in each distance class. The energy and the
+    //! Boltzmann factor follow from these, and are recomputed when next asked for.
+    uvec m_distanceClassCounts;
 
-    static uint m_totalActiveSites;
+    mutable double m_energy;
 
-    static uvec4 m_totalActiveParticles;
+    mutable double m_boltzmannFactor;
 
-    static uvec4 m_totalDeactiveParticles;
+    mutable bool m_energyIsStale;
 
-    static double m_totalEnergy;
+    int m_particleState = ParticleStates::solution;
 
+    //! Index of the site's block in the solver's reaction table, or NO_PARTICLE.
+    uint m_particleIndex;
 
-    static set<Site*> m_affectedSites;
+    uint m_activeSiteIndex;
 
-    static KMCSolver* m_solver;
+    uint m_nReactions;
 
+    uint m_affectedStamp;
 
-    Site**** m_neighborhood;
+    //! One bit per closest neighbor which is not blocked by the boundaries.
+    uint m_openDirections;
 
-    uvec m_nNeighbors;
+    //! The open directions a particle may move along, for when this site is deactive
+    //! (spawning) and active. A direction is allowed by the state of its destination.
+    uint m_allowedDirections[2];
 
-    uint m_nNeighborsSum;
+    //! Bit n is set if a particle may move here from a site where isActive() == n.
+    uint m_destinationStatus;
 
+    //! Kept up to date by setNewParticleState(), see informNeighborhoodOnCrystalChange().
+    uint m_nCrystalNeighbors;
 
-    bool m_active;
+    uint m_nFixedCrystalNeighbors;
 
-    bool m_isFixedCrystalSeed;
+    uint m_nCrystalNeighborsWithinSeparation;
 
-    bool m_cannotCrystallize;
 
-    const uint m_x;
-    const uint m_y;
-    const uint m_z;
-    const uvec3 m_r;
+    void queueAsAffected()
+    {
+        if (m_affectedStamp != m_shared->affectedEpoch)
+        {
+            m_affectedStamp = m_shared->affectedEpoch;
+            m_shared->affectedSites.push_back(this);
+        }
+    }
 
-    double m_energy;
+    void createDiffusionReactions();
 
-    int m_particleState = ParticleStates::solution;
+    bool holdsDiffusionReactions();
 
-    vector<Reaction*> m_reactions;
+    void removeFromActiveSites();
 
-    DiffusionReaction* m_diffusionReactions[3][3][3];
+    uint getDestinationStatus() const;
 
+    void updateDestinationStatus();
 
     void setNewParticleState(int newState);
 
+    //! Adds the changes in crystal and fixed crystal count to the counters of the
+    //! neighbors within reach, as this site's particle state changes.
+    void informNeighborhoodOnCrystalChange(const int crystalChange, const int fixedCrystalChange);
+
+    //! Whether setParticleState(newState) would leave the site as it is. Propagation
+    //! skips these, so that it only touches sites whose counters crossed a threshold.
+    bool keepsStateAgainst(const int newState);
+
     void deactivateFixedCrystal();
 
+    static void setupUpdateShell();
+
+    static void setupDistanceClasses();
+
+    //! Gives the current solver tables of its own before they are set up again.
+    static void unshareTables();
+
+    static void updateAffectedSitesBatched();
+
+    void updateEnergy() const;
+
 
 };
 
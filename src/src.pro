@@ -12,6 +12,7 @@ HEADERS = RNG/kMCRNG.h \
     kmcsolver.h \
     site.h \
     reactions/diffusion/diffusionreaction.h \
+    reactions/vectorexp.h \
     debugger/bits/nodebug.h \
     debugger/bits/intrinsicmacros.h \
     debugger/bits/debug_api.h \
@@ -22,20 +23,35 @@ HEADERS = RNG/kMCRNG.h \
     boundary/concentrationwall/concentrationwall.h \
     boundary/edge/edge.h \
     boundary/surface/surface.h \
-    particlestates.h
+    particlestates.h \
+    selection/selectionengine.h \
+    selection/ratetree/ratetree.h \
+    selection/compositionrejection/compositionrejection.h \
+    selection/nextreactionmethod/nextreactionmethod.h \
+    parallel/sublattice/sublatticeengine.h \
+    parallel/brick.h \
+    parallel/timewarp/timewarpengine.h
 
 SOURCES += \
     reactions/reaction.cpp \
     kmcsolver.cpp \
     site.cpp \
     reactions/diffusion/diffusionreaction.cpp \
+    reactions/vectorexp.cpp \
     RNG/kMCRNG.cpp \
     debugger/bits/debugger_class.cpp \
     boundary/boundary.cpp \
     boundary/periodic/periodic.cpp \
     boundary/concentrationwall/concentrationwall.cpp \
     boundary/surface/surface.cpp \
-    particlestates.cpp
+    particlestates.cpp \
+    selection/selectionengine.cpp \
+    selection/ratetree/ratetree.cpp \
+    selection/compositionrejection/compositionrejection.cpp \
+    selection/nextreactionmethod/nextreactionmethod.cpp \
+    parallel/sublattice/sublatticeengine.cpp \
+    parallel/brick.cpp \
+    parallel/timewarp/timewarpengine.cpp
 
 RNG_ZIG {
 
@@ -47,6 +63,14 @@ SOURCES += RNG/zigrandom.cpp \
 
 }
 
+MPI {
+
+HEADERS += parallel/distributed/distributedengine.h
+
+SOURCES += parallel/distributed/distributedengine.cpp
+
+}
+
 
 !equals(PWD, $${OUT_PWD}) {
     QMAKE_POST_LINK += $(COPY_DIR) $$OUT_PWD/../lib $$TOP_PWD